@@ -0,0 +1,174 @@
+// MegaHash v1.0
+// Copyright (c) 2019 Joseph Huckaby
+// Based on DeepHash, (c) 2003 Joseph Huckaby
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "Arena.h"
+
+void *Arena::alloc(size_t size) {
+	// allocate block of memory (serialized in concurrent mode)
+	if (!lock) return allocUnlocked(size);
+	
+	lock->lock();
+	void *ptr = allocUnlocked(size);
+	lock->unlock();
+	return ptr;
+}
+
+void Arena::release(void *ptr, size_t size) {
+	// release block of memory (serialized in concurrent mode)
+	if (!lock) {
+		releaseUnlocked(ptr, size);
+		return;
+	}
+	
+	lock->lock();
+	releaseUnlocked(ptr, size);
+	lock->unlock();
+}
+
+void Arena::setConcurrent(unsigned char enabled) {
+	// allow blocks to be allocated and released from multiple threads, or go back to unlocked
+	// (must only be called while no other thread is using the arena)
+	if (enabled && !lock) lock = new std::mutex();
+	else if (!enabled && lock) {
+		delete lock;
+		lock = NULL;
+	}
+}
+
+void *Arena::allocUnlocked(size_t size) {
+	// internal method: allocate block of memory, carve from chunk if small enough
+	if (size > MH_ARENA_MAX_SIZE) return allocLarge(size);
+	if (size < MH_ARENA_ALIGN) size = MH_ARENA_ALIGN;
+
+	int cls = sizeClass(size);
+	void *ptr = freeLists[cls];
+
+	if (ptr) {
+		// reuse freed block from same class
+		freeLists[cls] = *((void **)ptr);
+		return ptr;
+	}
+
+	size = roundSize(size);
+	if (size > chunkAvail) {
+		if (!addChunk()) return NULL;
+	}
+
+	ptr = (void *)chunkPtr;
+	chunkPtr += size;
+	chunkAvail -= size;
+	return ptr;
+}
+
+void Arena::releaseUnlocked(void *ptr, size_t size) {
+	// internal method: release block back to its class freelist (or to the system if large)
+	if (size > MH_ARENA_MAX_SIZE) {
+		releaseLarge(ptr);
+		return;
+	}
+	if (size < MH_ARENA_ALIGN) size = MH_ARENA_ALIGN;
+
+	int cls = sizeClass(size);
+	*((void **)ptr) = freeLists[cls];
+	freeLists[cls] = ptr;
+}
+
+int Arena::fits(void *ptr, size_t oldSize, size_t newSize) {
+	// check if block allocated for oldSize can be reused in place for newSize
+	// it must also be released correctly as newSize later, so small blocks must stay in the same class
+	if (oldSize > MH_ARENA_MAX_SIZE) {
+		// large blocks can shrink a little, but not enough to strand most of the block
+		ArenaLarge *large = (ArenaLarge *)(((unsigned char *)ptr) - sizeof(ArenaLarge));
+		return (newSize > MH_ARENA_MAX_SIZE) && (newSize <= large->size) && (newSize >= large->size / 2);
+	}
+	if (newSize > MH_ARENA_MAX_SIZE) return 0;
+	
+	if (oldSize < MH_ARENA_ALIGN) oldSize = MH_ARENA_ALIGN;
+	if (newSize < MH_ARENA_ALIGN) newSize = MH_ARENA_ALIGN;
+	return sizeClass(oldSize) == sizeClass(newSize);
+}
+
+void Arena::reset() {
+	// release all chunks and large blocks at once
+	ArenaChunk *chunk;
+	ArenaLarge *large;
+	if (lock) lock->lock();
+
+	while (chunks) {
+		chunk = chunks;
+		chunks = chunk->next;
+		free((void *)chunk);
+	}
+
+	while (larges) {
+		large = larges;
+		larges = large->next;
+		free((void *)large);
+	}
+
+	reservedSize = 0;
+	init();
+	if (lock) lock->unlock();
+}
+
+int Arena::addChunk() {
+	// internal method: allocate new chunk to carve from
+	// leftover space in current chunk goes into the freelist for its class
+	if (chunkAvail >= MH_ARENA_ALIGN) {
+		int cls = sizeClass(chunkAvail);
+		*((void **)chunkPtr) = freeLists[cls];
+		freeLists[cls] = (void *)chunkPtr;
+	}
+	chunkPtr = NULL;
+	chunkAvail = 0;
+
+	size_t chunkSize = nextChunkSize;
+	ArenaChunk *chunk = (ArenaChunk *)malloc( chunkSize );
+	if (!chunk) return 0;
+
+	chunk->next = chunks;
+	chunk->size = chunkSize;
+	chunks = chunk;
+	reservedSize += chunkSize;
+
+	chunkPtr = ((unsigned char *)chunk) + roundSize(sizeof(ArenaChunk));
+	chunkAvail = chunkSize - roundSize(sizeof(ArenaChunk));
+
+	// grow chunks as the hash grows, so small hashes stay small
+	if (nextChunkSize < MH_ARENA_MAX_CHUNK) nextChunkSize *= 2;
+
+	return 1;
+}
+
+void *Arena::allocLarge(size_t size) {
+	// internal method: allocate large block directly from system, with tracking header
+	ArenaLarge *large = (ArenaLarge *)malloc( sizeof(ArenaLarge) + size );
+	if (!large) return NULL;
+
+	large->prev = NULL;
+	large->next = larges;
+	large->size = size;
+	if (larges) larges->prev = large;
+	larges = large;
+	reservedSize += sizeof(ArenaLarge) + size;
+
+	return (void *)(((unsigned char *)large) + sizeof(ArenaLarge));
+}
+
+void Arena::releaseLarge(void *ptr) {
+	// internal method: release large block back to system
+	ArenaLarge *large = (ArenaLarge *)(((unsigned char *)ptr) - sizeof(ArenaLarge));
+
+	if (large->prev) large->prev->next = large->next;
+	else larges = large->next;
+	if (large->next) large->next->prev = large->prev;
+
+	reservedSize -= sizeof(ArenaLarge) + large->size;
+	free((void *)large);
+}
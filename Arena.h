@@ -0,0 +1,99 @@
+// MegaHash v1.0
+// Copyright (c) 2019 Joseph Huckaby
+// Based on DeepHash, (c) 2003 Joseph Huckaby
+
+#ifndef MH_ARENA_H
+#define MH_ARENA_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <mutex>
+
+/** Alignment and granularity of arena size classes, in bytes. */
+#define MH_ARENA_ALIGN 8
+/** Largest block carved from chunks.  Anything bigger goes straight to malloc. */
+#define MH_ARENA_MAX_SIZE 1024
+/** Number of size classes (one freelist each). */
+#define MH_ARENA_NUM_CLASSES (MH_ARENA_MAX_SIZE / MH_ARENA_ALIGN)
+/** Size of first chunk, doubles for each new chunk up to max. */
+#define MH_ARENA_MIN_CHUNK (64 * 1024)
+/** Maximum chunk size. */
+#define MH_ARENA_MAX_CHUNK (4 * 1024 * 1024)
+
+class ArenaChunk {
+public:
+	// header for one chunk, which small blocks are carved from
+	ArenaChunk *next;
+	size_t size;
+};
+
+class ArenaLarge {
+public:
+	// header for one large block (malloc'ed separately)
+	// doubly linked so blocks can be released individually and also all at once
+	ArenaLarge *prev;
+	ArenaLarge *next;
+	size_t size;
+};
+
+class Arena {
+public:
+	// slab allocator with size classes, owned by one hash
+	// small blocks are carved from large chunks, and freed blocks go back to per-class freelists
+	ArenaChunk *chunks;
+	ArenaLarge *larges;
+	unsigned char *chunkPtr;
+	size_t chunkAvail;
+	size_t nextChunkSize;
+	void *freeLists[MH_ARENA_NUM_CLASSES];
+	uint64_t reservedSize; /**< Total bytes currently reserved from the system. */
+	std::mutex *lock; /**< Only allocated in concurrent mode. */
+
+	Arena() {
+		chunks = NULL;
+		larges = NULL;
+		reservedSize = 0;
+		lock = NULL;
+		init();
+	}
+
+	~Arena() {
+		reset();
+		if (lock) delete lock;
+	}
+
+	void init() {
+		chunkPtr = NULL;
+		chunkAvail = 0;
+		nextChunkSize = MH_ARENA_MIN_CHUNK;
+		for (int idx = 0; idx < MH_ARENA_NUM_CLASSES; idx++) freeLists[idx] = NULL;
+	}
+
+	// public methods:
+	void *alloc(size_t size);
+	void release(void *ptr, size_t size);
+	void reset();
+	int fits(void *ptr, size_t oldSize, size_t newSize);
+	void setConcurrent(unsigned char enabled = 1);
+
+	// internal methods:
+	void *allocUnlocked(size_t size);
+	void releaseUnlocked(void *ptr, size_t size);
+	int addChunk();
+	void *allocLarge(size_t size);
+	void releaseLarge(void *ptr);
+
+	static size_t roundSize(size_t size) {
+		// round size up to nearest class boundary
+		return (size + (MH_ARENA_ALIGN - 1)) & ~((size_t)MH_ARENA_ALIGN - 1);
+	}
+
+	static int sizeClass(size_t size) {
+		// get freelist index for size (must be <= MH_ARENA_MAX_SIZE)
+		return (int)(roundSize(size) / MH_ARENA_ALIGN) - 1;
+	}
+
+}; // Arena
+
+#endif
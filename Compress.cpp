@@ -0,0 +1,331 @@
+// MegaHash v1.0
+// Copyright (c) 2019 Joseph Huckaby
+// Based on DeepHash, (c) 2003 Joseph Huckaby
+
+// Value compression in the LZ4 block format (https://github.com/lz4/lz4/blob/dev/doc/lz4_Block_format.md).
+// This is a small self-contained implementation of the format, with a greedy single-probe match finder
+// like LZ4's fast mode, so any LZ4 block decoder can read the blocks (after the varint length header).
+// A dictionary is treated as data preceding every value, so matches may point back into it.
+// Blocks are a series of sequences, each one:
+//   token (high 4 bits literal length, low 4 bits match length - 4, 15 means more length bytes follow),
+//   [more literal length bytes], literals, match offset (16 bits LE), [more match length bytes]
+// and the last sequence is just literals.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+#include "Compress.h"
+#include "wyhash.h"
+
+static inline uint32_t read32(const unsigned char *ptr) {
+	uint32_t value;
+	memcpy( (void *)&value, (void *)ptr, 4 );
+	return value;
+}
+
+static inline uint64_t read64(const unsigned char *ptr) {
+	uint64_t value;
+	memcpy( (void *)&value, (void *)ptr, 8 );
+	return value;
+}
+
+static inline size_t sameBytes(uint64_t diff) {
+	// number of leading bytes in memory order that matched, given non-zero XOR of two 8 byte reads
+	#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+	return (size_t)__builtin_clzll(diff) >> 3;
+	#elif defined(_MSC_VER)
+	unsigned long bit;
+	_BitScanForward64( &bit, diff );
+	return (size_t)bit >> 3;
+	#else
+	return (size_t)__builtin_ctzll(diff) >> 3;
+	#endif
+}
+
+static inline uint32_t hashAt(const unsigned char *ptr, int bits) {
+	// hash next 4 bytes for match finder table (Fibonacci hashing)
+	return (read32(ptr) * 2654435761U) >> (32 - bits);
+}
+
+static inline size_t matchLength(const unsigned char *ptr, const unsigned char *ref, const unsigned char *limit) {
+	// count bytes matching at ptr and ref, up to limit (for ptr), 8 at a time where possible
+	const unsigned char *start = ptr;
+	while (ptr + 8 <= limit) {
+		uint64_t diff = read64(ptr) ^ read64(ref);
+		if (diff) return (ptr - start) + sameBytes(diff);
+		ptr += 8; ref += 8;
+	}
+	while ((ptr < limit) && (*ptr == *ref)) { ptr++; ref++; }
+	return ptr - start;
+}
+
+static inline void copyBytes(unsigned char *dest, const unsigned char *src, size_t length, const unsigned char *srcEnd, const unsigned char *destEnd) {
+	// copy short runs 8 bytes at a time when both sides have room to run over (much faster than memcpy for these)
+	if ((length <= 32) && (srcEnd - src >= 32) && (destEnd - dest >= 32)) {
+		unsigned char *end = dest + length;
+		do { memcpy( (void *)dest, (void *)src, 8 ); dest += 8; src += 8; } while (dest < end);
+	}
+	else memcpy( (void *)dest, (void *)src, length );
+}
+
+static inline unsigned char *putLength(unsigned char *op, size_t length) {
+	// write extra length bytes following a token nibble of 15
+	while (length >= 255) { *op++ = 255; length -= 255; }
+	*op++ = (unsigned char)length;
+	return op;
+}
+
+Compressor::Compressor(uint32_t newMinLength, const unsigned char *newDict, size_t newDictLength) {
+	// set up compression for values of at least newMinLength bytes, with an optional dictionary
+	// (only the last 64 KB of a longer dictionary can be reached by matches, so only that is kept)
+	minLength = newMinLength;
+	dictId = 0;
+	dictTable = NULL;
+	
+	if (newDict && newDictLength) {
+		if (newDictLength > MH_COMPRESS_MAX_DICT) {
+			newDict += newDictLength - MH_COMPRESS_MAX_DICT;
+			newDictLength = MH_COMPRESS_MAX_DICT;
+		}
+		dict.assign( (const char *)newDict, newDictLength );
+		dictId = (uint32_t)wyhash( (const void *)newDict, newDictLength, 0, _wyp ) | 1;
+		
+		// prime match finder with every dictionary position (table entries are position + 1, so 0 is empty)
+		dictTable = (uint32_t *)calloc( (size_t)1 << MH_COMPRESS_HASH_BITS, sizeof(uint32_t) );
+		const unsigned char *base = (const unsigned char *)dict.data();
+		for (size_t pos = 0; pos + MH_COMPRESS_MIN_MATCH <= newDictLength; pos++) {
+			dictTable[ hashAt(base + pos, MH_COMPRESS_HASH_BITS) ] = (uint32_t)pos + 1;
+		}
+	}
+}
+
+Compressor::~Compressor() {
+	if (dictTable) free( (void *)dictTable );
+}
+
+int Compressor::compress(const unsigned char *src, uint32_t srcLength, std::string &out) {
+	// compress value into out, returns 0 if it is too short, or would not shrink by at least 1/8
+	// (then it should be stored as is, and out is left with junk)
+	if ((srcLength < minLength) || (srcLength <= MH_COMPRESS_MATCH_LIMIT)) return 0;
+	
+	uint32_t dictLength = (uint32_t)dict.size();
+	const unsigned char *dictBase = (const unsigned char *)dict.data();
+	uint32_t table[ 1 << MH_COMPRESS_HASH_BITS ];
+	int bits = MH_COMPRESS_HASH_BITS;
+	
+	if (dictLength) memcpy( (void *)table, (void *)dictTable, sizeof(table) );
+	else {
+		// short values get a smaller table, which is cheaper to clear
+		for (bits = 8; (bits < MH_COMPRESS_HASH_BITS) && (((uint32_t)2 << bits) < srcLength); bits++) ;
+		memset( (void *)table, 0, sizeof(uint32_t) << bits );
+	}
+	
+	// output is given up as soon as it would pass maxLength, so it never needs to grow
+	size_t maxLength = srcLength - (srcLength / 8);
+	out.resize( maxLength );
+	unsigned char *base = (unsigned char *)&out[0];
+	unsigned char *oend = base + maxLength;
+	unsigned char *op = base;
+	
+	uint32_t rawLength = srcLength;
+	while (rawLength >= 0x80) { *op++ = (unsigned char)(rawLength | 0x80); rawLength >>= 7; }
+	*op++ = (unsigned char)rawLength;
+	
+	// positions are counted from the start of the dictionary, as if it came right before the value
+	const unsigned char *ip = src;
+	const unsigned char *anchor = src;
+	const unsigned char *iend = src + srcLength;
+	const unsigned char *mflimit = iend - MH_COMPRESS_MATCH_LIMIT;
+	const unsigned char *matchLimit = iend - MH_COMPRESS_LAST_LITERALS;
+	
+	table[ hashAt(ip, bits) ] = dictLength + 1;
+	ip++;
+	
+	for (;;) {
+		// find next match, skipping ahead faster the longer nothing matches
+		const unsigned char *ref = NULL;
+		int inDict = 0;
+		uint32_t offset = 0;
+		uint32_t attempts = 1 << 6;
+		
+		while (!ref) {
+			if (ip > mflimit) goto lastLiterals;
+			
+			uint32_t hash = hashAt(ip, bits);
+			uint32_t here = dictLength + (uint32_t)(ip - src) + 1;
+			uint32_t found = table[hash];
+			table[hash] = here;
+			
+			if (found && (here - found <= MH_COMPRESS_MAX_OFFSET)) {
+				inDict = (found - 1 < dictLength);
+				const unsigned char *candidate = inDict ? (dictBase + found - 1) : (src + (found - 1 - dictLength));
+				if (read32(candidate) == read32(ip)) {
+					ref = candidate;
+					offset = here - found;
+					break;
+				}
+			}
+			ip += attempts++ >> 6;
+		}
+		
+		// extend match backwards over pending literals, then forwards (from the dictionary on into the value)
+		while ((ip > anchor) && (ref > (inDict ? dictBase : src)) && (ip[-1] == ref[-1])) { ip--; ref--; }
+		
+		size_t length;
+		if (inDict) {
+			size_t dictLeft = (dictBase + dictLength) - ref;
+			const unsigned char *limit = ((size_t)(matchLimit - ip) > dictLeft) ? (ip + dictLeft) : matchLimit;
+			length = matchLength( ip, ref, limit );
+			if ((length == dictLeft) && (limit != matchLimit)) length += matchLength( ip + length, src, matchLimit );
+		}
+		else length = matchLength( ip, ref, matchLimit );
+		
+		// emit sequence, making sure it fits first
+		size_t literals = ip - anchor;
+		if (op + 1 + (literals / 255) + 1 + literals + 2 + ((length - MH_COMPRESS_MIN_MATCH) / 255) + 1 > oend) return 0;
+		
+		unsigned char *token = op++;
+		if (literals >= 15) { *token = 15 << 4; op = putLength( op, literals - 15 ); }
+		else *token = (unsigned char)(literals << 4);
+		copyBytes( op, anchor, literals, iend, oend );
+		op += literals;
+		
+		*op++ = (unsigned char)(offset & 0xFF);
+		*op++ = (unsigned char)(offset >> 8);
+		
+		size_t extra = length - MH_COMPRESS_MIN_MATCH;
+		if (extra >= 15) { *token |= 15; op = putLength( op, extra - 15 ); }
+		else *token |= (unsigned char)extra;
+		
+		ip += length;
+		anchor = ip;
+		if (ip > mflimit) break;
+		
+		// fill in one position from inside the match, which helps the next search
+		table[ hashAt(ip - 2, bits) ] = dictLength + (uint32_t)(ip - 2 - src) + 1;
+	}
+	
+	lastLiterals:
+	size_t literals = iend - anchor;
+	if (op + 1 + (literals / 255) + 1 + literals > oend) return 0;
+	
+	unsigned char *token = op++;
+	if (literals >= 15) { *token = 15 << 4; op = putLength( op, literals - 15 ); }
+	else *token = (unsigned char)(literals << 4);
+	memcpy( (void *)op, (void *)anchor, literals );
+	op += literals;
+	
+	out.resize( op - base );
+	return 1;
+}
+
+int Compressor::rawLength(const unsigned char *src, uint32_t srcLength, uint32_t *length) {
+	// read original length from start of compressed value, returns size of the header (0 if malformed)
+	uint32_t value = 0;
+	for (uint32_t idx = 0; (idx < 5) && (idx < srcLength); idx++) {
+		value |= (uint32_t)(src[idx] & 0x7F) << (idx * 7);
+		if (src[idx] < 0x80) {
+			length[0] = value;
+			return (int)idx + 1;
+		}
+	}
+	return 0;
+}
+
+int Compressor::decompress(const unsigned char *src, uint32_t srcLength, unsigned char *dest, uint32_t destLength, const std::string *dict) {
+	// decompress value into dest, which must be exactly its original length (see rawLength)
+	// every read and write is bounds checked, returns 0 if the data is malformed,
+	// or needs a dictionary that was not provided
+	uint32_t length = 0;
+	int headerSize = rawLength( src, srcLength, &length );
+	if (!headerSize || (length != destLength)) return 0;
+	
+	const unsigned char *ip = src + headerSize;
+	const unsigned char *iend = src + srcLength;
+	unsigned char *op = dest;
+	unsigned char *oend = dest + destLength;
+	size_t dictLength = dict ? dict->size() : 0;
+	
+	while (ip < iend) {
+		unsigned char token = *ip++;
+		
+		size_t literals = token >> 4;
+		if ((literals < 15) && ((size_t)(iend - ip) >= 16) && ((size_t)(oend - op) >= 16)) {
+			// common case of a few literals, copied as a fixed 16 bytes
+			memcpy( (void *)op, (void *)ip, 16 );
+		}
+		else {
+			if (literals == 15) {
+				unsigned char more;
+				do {
+					if (ip >= iend) return 0;
+					more = *ip++;
+					literals += more;
+				} while (more == 255);
+			}
+			if (((size_t)(iend - ip) < literals) || ((size_t)(oend - op) < literals)) return 0;
+			copyBytes( op, ip, literals, iend, oend );
+		}
+		ip += literals;
+		op += literals;
+		
+		// last sequence has no match
+		if (ip == iend) break;
+		
+		if (iend - ip < 2) return 0;
+		size_t offset = ip[0] | ((size_t)ip[1] << 8);
+		ip += 2;
+		if (!offset) return 0;
+		
+		size_t length = token & 15;
+		if (length == 15) {
+			unsigned char more;
+			do {
+				if (ip >= iend) return 0;
+				more = *ip++;
+				length += more;
+			} while (more == 255);
+		}
+		length += MH_COMPRESS_MIN_MATCH;
+		if ((size_t)(oend - op) < length) return 0;
+		
+		size_t written = op - dest;
+		if (offset > written) {
+			// match starts in the dictionary, and may run on into the value
+			size_t back = offset - written;
+			if (back > dictLength) return 0;
+			size_t fromDict = (length < back) ? length : back;
+			memcpy( (void *)op, (void *)(dict->data() + dictLength - back), fromDict );
+			op += fromDict;
+			length -= fromDict;
+			for (unsigned char *ref = dest; length; length--) *op++ = *ref++;
+		}
+		else if ((offset >= 16) && (length <= 16) && ((size_t)(oend - op) >= 16)) {
+			// common case of a short match that does not overlap itself, copied as a fixed 16 bytes
+			memcpy( (void *)op, (void *)(op - offset), 16 );
+			op += length;
+		}
+		else if ((offset >= 8) && ((size_t)(oend - op) >= length + 8)) {
+			// 8 byte steps are safe even when the match overlaps itself, as each one only reads finished bytes
+			unsigned char *ref = op - offset;
+			unsigned char *end = op + length;
+			do { memcpy( (void *)op, (void *)ref, 8 ); op += 8; ref += 8; } while (op < end);
+			op = end;
+		}
+		else if (offset >= length) {
+			memcpy( (void *)op, (void *)(op - offset), length );
+			op += length;
+		}
+		else {
+			// overlapping match repeats the last offset bytes
+			for (unsigned char *ref = op - offset; length; length--) *op++ = *ref++;
+		}
+	}
+	
+	return (op == oend) ? 1 : 0;
+}
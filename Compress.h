@@ -0,0 +1,43 @@
+// MegaHash v1.0
+// Copyright (c) 2019 Joseph Huckaby
+// Based on DeepHash, (c) 2003 Joseph Huckaby
+
+#ifndef MH_COMPRESS_H
+#define MH_COMPRESS_H
+
+#include <stdint.h>
+#include <string>
+
+/** Default smallest value compressed, in bytes (shorter values rarely shrink enough to be worth it). */
+#define MH_COMPRESS_MIN_LENGTH 128
+/** Bits of the match finder hash table (4096 entries). */
+#define MH_COMPRESS_HASH_BITS 12
+/** Shortest match, and the bytes the match finder hashes. */
+#define MH_COMPRESS_MIN_MATCH 4
+/** Farthest back a match may point (offsets are 16 bits). */
+#define MH_COMPRESS_MAX_OFFSET 65535
+/** Largest dictionary used (matches can only reach this far back anyway). */
+#define MH_COMPRESS_MAX_DICT MH_COMPRESS_MAX_OFFSET
+/** The block format ends with at least this many literals, and the last match starts this far from the end. */
+#define MH_COMPRESS_LAST_LITERALS 5
+#define MH_COMPRESS_MATCH_LIMIT 12
+
+class Compressor {
+public:
+	// LZ4 block format compression for values, with an optional shared dictionary
+	// compressed values start with the original length as a varint, followed by the block
+	uint32_t minLength; /**< Values shorter than this are stored as is. */
+	std::string dict;
+	uint32_t dictId; /**< Identifies the dictionary in snapshots (0 for none). */
+	uint32_t *dictTable; /**< Match finder table primed with the dictionary, copied for each value. */
+	
+	Compressor(uint32_t newMinLength, const unsigned char *newDict, size_t newDictLength);
+	~Compressor();
+	
+	int compress(const unsigned char *src, uint32_t srcLength, std::string &out);
+	
+	static int rawLength(const unsigned char *src, uint32_t srcLength, uint32_t *length);
+	static int decompress(const unsigned char *src, uint32_t srcLength, unsigned char *dest, uint32_t destLength, const std::string *dict);
+};
+
+#endif
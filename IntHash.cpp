@@ -0,0 +1,261 @@
+// MegaHash v1.0
+// Copyright (c) 2019 Joseph Huckaby
+// Based on DeepHash, (c) 2003 Joseph Huckaby
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "IntHash.h"
+
+Response IntHash::store(uint64_t key, unsigned char *content, MH_LEN_T contentLength, unsigned char flags) {
+	// store key/value pair in hash, returns MH_ADD or MH_REPLACE (or MH_ERR if out of memory)
+	Response resp;
+	if (old.slots) migrate( MH_INT_MIGRATE_STEP );
+	
+	// a key which has not moved to the new table yet is simply replaced where it is
+	IntSlot *slot = findSlot( &table, key );
+	if (!slot && old.slots) slot = findSlot( &old, key );
+	
+	if (slot) {
+		MH_LEN_T oldLength = slot->length;
+		if (!setValue(slot, content, contentLength, flags)) {
+			resp.result = MH_ERR;
+			return resp;
+		}
+		
+		resp.result = MH_REPLACE;
+		stats->dataSize -= oldLength;
+		stats->dataSize += contentLength;
+		return resp;
+	}
+	
+	// keys still in the old table count towards the load, as they will all end up in this one
+	if ((table.numFull + table.numDeleted + old.numFull + 1) * 256 > table.numSlots * MH_INT_MAX_LOAD) {
+		if (!resize()) {
+			resp.result = MH_ERR;
+			return resp;
+		}
+	}
+	
+	slot = insertSlot( key );
+	if (!setValue(slot, content, contentLength, flags)) {
+		slot->state = MH_SLOT_DELETED;
+		table.numFull--;
+		table.numDeleted++;
+		resp.result = MH_ERR;
+		return resp;
+	}
+	
+	resp.result = MH_ADD;
+	stats->dataSize += sizeof(uint64_t) + contentLength;
+	stats->numKeys++;
+	return resp;
+}
+
+Response IntHash::fetch(uint64_t key) {
+	// fetch value given key
+	// content points into the slot (or arena), so it is only valid until the hash is next modified
+	Response resp;
+	
+	IntSlot *slot = findSlot( &table, key );
+	if (!slot && old.slots) slot = findSlot( &old, key );
+	
+	if (slot) {
+		resp.result = MH_OK;
+		resp.content = slotGetContent(slot);
+		resp.contentLength = slot->length;
+		resp.flags = slot->flags;
+	}
+	else resp.result = MH_ERR;
+	
+	return resp;
+}
+
+Response IntHash::remove(uint64_t key) {
+	// remove key/value pair given key
+	// the slot is only marked deleted, so no other key moves
+	Response resp;
+	if (old.slots) migrate( MH_INT_MIGRATE_STEP );
+	
+	IntTable *fromTable = &table;
+	IntSlot *slot = findSlot( &table, key );
+	if (!slot && old.slots) {
+		fromTable = &old;
+		slot = findSlot( &old, key );
+	}
+	
+	if (!slot) {
+		resp.result = MH_ERR;
+		return resp;
+	}
+	
+	stats->dataSize -= sizeof(uint64_t) + slot->length;
+	stats->numKeys--;
+	
+	freeValue( slot );
+	slot->state = MH_SLOT_DELETED;
+	fromTable->numFull--;
+	fromTable->numDeleted++;
+	
+	resp.result = MH_OK;
+	return resp;
+}
+
+void IntHash::clear() {
+	// clear ALL keys/values
+	// values live in the arena, so release whole chunks at once instead of walking the table
+	arena->reset();
+	freeTable( &table );
+	freeTable( &old );
+	migrateIndex = 0;
+	
+	stats->numKeys = 0;
+	stats->dataSize = 0;
+	initTable( &table, MH_INT_MIN_SLOTS );
+}
+
+void IntHash::cursorNext(uint64_t *position, size_t maxKeys, std::vector<IntSlot *> *slots) {
+	// gather next batch of slots, starting at position in the table (0 to start), and advance position
+	// an empty batch means the end
+	// any resize in progress is finished first, so every key is in the one table,
+	// and keys only move when the table is resized again (i.e. new keys were added between batches)
+	if (old.slots) migrate( UINT64_MAX );
+	
+	for (; (position[0] < table.numSlots) && (slots->size() < maxKeys); position[0]++) {
+		IntSlot *slot = &table.slots[ position[0] ];
+		if (slot->state == MH_SLOT_FULL) slots->push_back( slot );
+	}
+}
+
+int IntHash::initTable(IntTable *newTable, uint64_t numSlots) {
+	// allocate empty table with numSlots slots (power of 2)
+	// calloc leaves every slot MH_SLOT_EMPTY, and large tables get lazily zeroed pages from the system
+	newTable->slots = (IntSlot *)calloc( numSlots, sizeof(IntSlot) );
+	if (!newTable->slots) return 0;
+	
+	newTable->numSlots = numSlots;
+	newTable->numFull = 0;
+	newTable->numDeleted = 0;
+	for (newTable->bits = 0; ((uint64_t)1 << newTable->bits) < numSlots; newTable->bits++) ;
+	
+	stats->indexSize += numSlots * sizeof(IntSlot);
+	stats->numIndexes++;
+	return 1;
+}
+
+void IntHash::freeTable(IntTable *oldTable) {
+	// free table slots (values must already be released or moved)
+	if (!oldTable->slots) return;
+	
+	stats->indexSize -= oldTable->numSlots * sizeof(IntSlot);
+	stats->numIndexes--;
+	
+	free( (void *)oldTable->slots );
+	oldTable[0] = IntTable();
+}
+
+IntSlot *IntHash::findSlot(IntTable *fromTable, uint64_t key) {
+	// find slot holding key, or NULL if not found
+	// tables never fill up, so every probe ends at an empty slot
+	uint64_t mask = fromTable->numSlots - 1;
+	
+	for (uint64_t idx = slotFor(fromTable, key); ; idx = (idx + 1) & mask) {
+		IntSlot *slot = &fromTable->slots[idx];
+		if (slot->state == MH_SLOT_EMPTY) return NULL;
+		if ((slot->state == MH_SLOT_FULL) && (slot->key == key)) return slot;
+	}
+}
+
+IntSlot *IntHash::insertSlot(uint64_t key) {
+	// claim slot in current table for a key known not to be there yet
+	// takes the first deleted or empty slot along the probe
+	uint64_t mask = table.numSlots - 1;
+	
+	for (uint64_t idx = slotFor(&table, key); ; idx = (idx + 1) & mask) {
+		IntSlot *slot = &table.slots[idx];
+		if (slot->state == MH_SLOT_FULL) continue;
+		
+		if (slot->state == MH_SLOT_DELETED) table.numDeleted--;
+		slot->key = key;
+		slot->data = 0;
+		slot->length = 0;
+		slot->flags = 0;
+		slot->state = MH_SLOT_FULL;
+		table.numFull++;
+		return slot;
+	}
+}
+
+int IntHash::resize() {
+	// start moving all keys into a new table, with room for twice as many
+	// if the table is mostly deleted slots, the new one may be the same size (which just cleans them out)
+	// only one resize runs at a time, so finish the previous one first (normally long done by now)
+	if (old.slots) migrate( UINT64_MAX );
+	
+	uint64_t numSlots = table.numSlots;
+	while (table.numFull * 2 * 256 > numSlots * MH_INT_MAX_LOAD) numSlots *= 2;
+	
+	IntTable newTable;
+	if (!initTable(&newTable, numSlots)) return 0;
+	
+	old = table;
+	table = newTable;
+	migrateIndex = 0;
+	return 1;
+}
+
+void IntHash::migrate(uint64_t maxSlots) {
+	// move up to maxSlots old table slots into the current table, and free the old table once done
+	// moved slots are left deleted, so probes for keys which have not moved yet still get past them
+	for (; maxSlots && (migrateIndex < old.numSlots); maxSlots--, migrateIndex++) {
+		IntSlot *from = &old.slots[migrateIndex];
+		if (from->state != MH_SLOT_FULL) continue;
+		
+		IntSlot *slot = insertSlot( from->key );
+		slot->data = from->data;
+		slot->length = from->length;
+		slot->flags = from->flags;
+		
+		from->state = MH_SLOT_DELETED;
+		old.numFull--;
+		old.numDeleted++;
+	}
+	
+	if (migrateIndex >= old.numSlots) {
+		freeTable( &old );
+		migrateIndex = 0;
+	}
+}
+
+int IntHash::setValue(IntSlot *slot, unsigned char *content, MH_LEN_T contentLength, unsigned char flags) {
+	// replace slot value, keeping small values inline, and reusing the arena block if the new value fits
+	// returns 0 if out of memory (old value is left intact)
+	if (contentLength <= MH_INT_INLINE_SIZE) {
+		uint64_t data = 0;
+		memcpy( (void *)&data, (void *)content, contentLength );
+		freeValue( slot );
+		slot->data = data;
+	}
+	else if ((slot->length > MH_INT_INLINE_SIZE) && arena->fits( (void *)slotGetContent(slot), slot->length, contentLength )) {
+		memmove( (void *)slotGetContent(slot), (void *)content, contentLength );
+	}
+	else {
+		unsigned char *ptr = (unsigned char *)arena->alloc( contentLength );
+		if (!ptr) return 0;
+		memcpy( (void *)ptr, (void *)content, contentLength );
+		freeValue( slot );
+		slot->data = (uint64_t)(uintptr_t)ptr;
+	}
+	
+	slot->length = contentLength;
+	slot->flags = flags;
+	return 1;
+}
+
+void IntHash::freeValue(IntSlot *slot) {
+	// release slot value back to arena, if it was not inline
+	if (slot->length > MH_INT_INLINE_SIZE) arena->release( (void *)slotGetContent(slot), slot->length );
+	slot->length = 0;
+}
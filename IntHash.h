@@ -0,0 +1,114 @@
+// MegaHash v1.0
+// Copyright (c) 2019 Joseph Huckaby
+// Based on DeepHash, (c) 2003 Joseph Huckaby
+
+#ifndef MH_INTHASH_H
+#define MH_INTHASH_H
+
+#include "MegaHash.h"
+
+/** Initial number of slots in an IntHash table (always a power of 2). */
+#define MH_INT_MIN_SLOTS 16
+/** Max load of a table (full and deleted slots), in 256ths, before it is resized. */
+#define MH_INT_MAX_LOAD 192
+/** Number of old table slots moved into the new table on each write, while a resize is in progress. */
+#define MH_INT_MIGRATE_STEP 32
+/** Values up to this many bytes are stored in the slot itself. */
+#define MH_INT_INLINE_SIZE 8
+
+/** \name IntHash slot states: */
+//@{
+/** Slot has never been used (ends a probe). */
+#define MH_SLOT_EMPTY 0
+/** Slot holds a key. */
+#define MH_SLOT_FULL 1
+/** Key was removed or moved to the new table (probes continue past it). */
+#define MH_SLOT_DELETED 2
+//@}
+
+class IntSlot {
+public:
+	// one slot in an IntHash table: the key, plus the value itself if it is small, or a pointer to it
+	uint64_t key;
+	uint64_t data; /**< Value bytes (up to MH_INT_INLINE_SIZE), or pointer to value in arena. */
+	MH_LEN_T length;
+	unsigned char flags;
+	unsigned char state;
+};
+
+class IntTable {
+public:
+	// one open addressing table (linear probing), numSlots is always a power of 2
+	IntSlot *slots;
+	uint64_t numSlots;
+	uint64_t numFull;
+	uint64_t numDeleted;
+	unsigned char bits;
+	
+	IntTable() {
+		slots = NULL;
+		numSlots = 0;
+		numFull = 0;
+		numDeleted = 0;
+		bits = 0;
+	}
+};
+
+class IntHash {
+public:
+	// hash table for unsigned 64-bit integer keys, using open addressing
+	// all keys live in one flat table, so a lookup is usually a single cache miss
+	// tables are resized incrementally: writes go to the new table, and a few old slots move over on each write,
+	// so there is never a stall to rehash everything at once
+	// removed keys leave a deleted slot behind, so other keys never move except when the table is resized
+	IntTable table; /**< Current table, all new keys go here. */
+	IntTable old; /**< Previous table, while a resize is in progress (slots is NULL otherwise). */
+	uint64_t migrateIndex; /**< Next old slot to move. */
+	Stats *stats;
+	Arena *arena;
+	
+	IntHash() {
+		stats = new Stats();
+		arena = new Arena();
+		migrateIndex = 0;
+		initTable( &table, MH_INT_MIN_SLOTS );
+	}
+	
+	~IntHash() {
+		// values live in the arena, so only the tables need freeing
+		freeTable( &table );
+		freeTable( &old );
+		delete arena;
+		delete stats;
+	}
+	
+	// public methods:
+	Response store(uint64_t key, unsigned char *content, MH_LEN_T contentLength, unsigned char flags = 0);
+	Response fetch(uint64_t key);
+	Response remove(uint64_t key);
+	void clear();
+	void cursorNext(uint64_t *position, size_t maxKeys, std::vector<IntSlot *> *slots);
+	
+	// internal methods:
+	int initTable(IntTable *newTable, uint64_t numSlots);
+	void freeTable(IntTable *oldTable);
+	IntSlot *findSlot(IntTable *fromTable, uint64_t key);
+	IntSlot *insertSlot(uint64_t key);
+	int resize();
+	void migrate(uint64_t maxSlots);
+	int setValue(IntSlot *slot, unsigned char *content, MH_LEN_T contentLength, unsigned char flags);
+	void freeValue(IntSlot *slot);
+	
+	uint64_t slotFor(IntTable *fromTable, uint64_t key) {
+		// home slot for key: Fibonacci hashing, which spreads sequential IDs evenly over the table
+		return (key * 0x9E3779B97F4A7C15ULL) >> (64 - fromTable->bits);
+	}
+	
+	unsigned char *slotGetContent(IntSlot *slot) {
+		// get pointer to slot value (inline, or in arena)
+		return (slot->length <= MH_INT_INLINE_SIZE) ? (unsigned char *)&slot->data : (unsigned char *)(uintptr_t)slot->data;
+	}
+
+}; // IntHash
+
+#endif
@@ -6,115 +6,237 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdint.h>
+#include <algorithm>
+#include <thread>
 
 #include "MegaHash.h"
 
-Response Hash::store(unsigned char *key, MH_KLEN_T keyLength, unsigned char *content, MH_LEN_T contentLength, unsigned char flags) {
-	// store key/value pair in hash
-	unsigned char digest[MH_DIGEST_SIZE];
-	Response resp;
+thread_local uint32_t OpTimer::tick = 0;
+thread_local int OpTimer::depth = 0;
+
+Response Hash::store(unsigned char *key, MH_KLEN_T keyLength, unsigned char *content, MH_LEN_T contentLength, unsigned char flags, uint64_t expires) {
+	// store key/value pair in hash, optionally expiring at a time in ms since epoch (0 = never)
+	OpTimer timer( instrument, MH_OP_STORE );
 	
-	// first digest key
-	digestKey(key, keyLength, digest);
+	return storeWithDigest( key, keyLength, content, contentLength, flags, digestKey(key, keyLength), expires );
+}
+
+void Hash::storeMany(BulkRecord *records, size_t count, unsigned char *results, unsigned int numThreads) {
+	// store many key/value pairs using up to numThreads threads, with result code for each one (same as store)
+	// records are grouped by main index slot, and each thread claims whole slots (like load), so threads never
+	// share index nodes, and pairs with the same key are still stored in the order given
+	// in concurrent mode each slot's stripe is held while its records are stored, otherwise the hash must not be
+	// in use by any other thread until this returns
+	if (numThreads > count / MH_BULK_THREAD_MIN) numThreads = (unsigned int)(count / MH_BULK_THREAD_MIN);
 	
-	// combine key and content together, with length prefixes, into single blob
-	// this reduces malloc bashing and memory frag
-	MH_LEN_T payloadSize = sizeof(Bucket) + MH_KLEN_SIZE + keyLength + MH_LEN_SIZE + contentLength;
-	MH_LEN_T offset = sizeof(Bucket);
-	unsigned char *payload = (unsigned char *)malloc(payloadSize);
+	// without locks, eviction could reach into slots owned by other threads
+	if (maxBytes && !locks) numThreads = 1;
 	
-	// check for malloc error here
-	if (!payload) {
+	// counting sort by slot, which keeps records in order within each slot
+	std::vector<uint64_t> digests( count );
+	std::vector<size_t> order( count );
+	size_t starts[ MH_INDEX_SIZE + 1 ];
+	size_t ends[ MH_INDEX_SIZE ];
+	memset( (void *)starts, 0, sizeof(starts) );
+	
+	for (size_t idx = 0; idx < count; idx++) {
+		digests[idx] = digestKey( records[idx].key, records[idx].keyLength );
+		starts[ digestSlice(digests[idx], 0, 8) + 1 ]++;
+	}
+	for (int slot = 0; slot < MH_INDEX_SIZE; slot++) {
+		starts[slot + 1] += starts[slot];
+		ends[slot] = starts[slot];
+	}
+	for (size_t idx = 0; idx < count; idx++) {
+		order[ ends[ digestSlice(digests[idx], 0, 8) ]++ ] = idx;
+	}
+	
+	std::atomic<int> nextSlot( 0 );
+	auto storeSlots = [this, records, results, &digests, &order, &starts, &nextSlot]() {
+		int slot;
+		while ((slot = nextSlot++) < MH_INDEX_SIZE) {
+			if (starts[slot] == starts[slot + 1]) continue;
+			if (locks) lockStripe( slot, 1 );
+			
+			for (size_t pos = starts[slot]; pos < starts[slot + 1]; pos++) {
+				size_t idx = order[pos];
+				BulkRecord *record = &records[idx];
+				results[idx] = (unsigned char)storeWithDigest( record->key, record->keyLength, record->content, record->contentLength, record->flags, digests[idx], record->expires ).result;
+			}
+			
+			if (locks) unlockStripe( slot, 1 );
+		}
+	};
+	
+	if (numThreads <= 1) {
+		storeSlots();
+		return;
+	}
+	
+	// only the arena is shared between slots, so it must be locked for the duration
+	std::vector<std::thread> threads;
+	int wasConcurrent = (locks != NULL);
+	arena->setConcurrent( 1 );
+	
+	for (unsigned int idx = 0; idx < numThreads; idx++) threads.push_back( std::thread(storeSlots) );
+	for (size_t idx = 0; idx < threads.size(); idx++) threads[idx].join();
+	
+	if (!wasConcurrent) arena->setConcurrent( 0 );
+}
+
+Response Hash::storeWithDigest(unsigned char *key, MH_KLEN_T keyLength, unsigned char *content, MH_LEN_T contentLength, unsigned char flags, uint64_t digest, uint64_t expires) {
+	// store key/value pair given precomputed key digest, compressing the value and making room first
+	// values are compressed up front, so memory limits apply to what is actually stored
+	// (only this decides which values are compressed, so the flag is never taken from the caller)
+	std::string compressed;
+	flags &= ~MH_FLAG_COMPRESSED;
+	if (compressor && compressor->compress(content, contentLength, compressed)) {
+		content = (unsigned char *)compressed.data();
+		contentLength = (MH_LEN_T)compressed.size();
+		flags |= MH_FLAG_COMPRESSED;
+	}
+	
+	if (!makeRoom(keyLength, contentLength, expires, digest)) {
+		Response resp;
 		resp.result = MH_ERR;
 		return resp;
 	}
 	
-	memcpy( (void *)&payload[offset], (void *)&keyLength, MH_KLEN_SIZE ); offset += MH_KLEN_SIZE;
-	memcpy( (void *)&payload[offset], (void *)key, keyLength ); offset += keyLength;
-	memcpy( (void *)&payload[offset], (void *)&contentLength, MH_LEN_SIZE ); offset += MH_LEN_SIZE;
-	memcpy( (void *)&payload[offset], (void *)content, contentLength ); offset += contentLength;
+	return storeDigest( key, keyLength, content, contentLength, flags, digest, expires );
+}
+
+int Hash::makeRoom(MH_KLEN_T keyLength, MH_LEN_T contentLength, uint64_t expires, uint64_t digest) {
+	// in memory-bounded mode, evict keys until a new bucket of this size fits
+	// returns 0 if it could never fit (always 1 when unbounded)
+	if (!maxBytes) return 1;
+	
+	uint64_t bytesNeeded = bucketMetaSizeFor( keyLength, contentLength, expires ? 1 : 0 ) + keyLength + contentLength;
+	if (bytesNeeded > maxBytes) return 0;
+	if (bytesUsed() + bytesNeeded > maxBytes) evict( bytesNeeded, digestSlice(digest, 0, 8) );
+	return 1;
+}
+
+Response Hash::storeDigest(unsigned char *key, MH_KLEN_T keyLength, unsigned char *content, MH_LEN_T contentLength, unsigned char flags, uint64_t digest, uint64_t expires) {
+	// store key/value pair in hash, given precomputed key digest
+	// replacing a key also replaces (or removes) its expiry time
+	Response resp;
+	
+	flags &= (MH_FLAGS_VALUE | MH_FLAG_COMPRESSED);
+	if (expires) flags |= MH_FLAG_EXPIRES;
 	
-	unsigned char digestIndex = 0;
+	// in memory-bounded mode, new and replaced keys start referenced, so they last at least one turn of the eviction hand
+	if (maxBytes) flags |= MH_FLAG_REFERENCED;
+	
+	unsigned char digestShift = 0;
 	unsigned char ch;
 	unsigned char bucketIndex = 0;
 	Tag *tag = (Tag *)index;
+	Tag *rootTag = tag;
+	Tag **levelRef = &rootTag;
+	Tag **slot;
 	Index *level, *newLevel;
 	Bucket *bucket, *newBucket, *lastBucket;
 	
 	while (tag && (tag->type == MH_SIG_INDEX)) {
 		level = (Index *)tag;
-		ch = digest[digestIndex];
-		tag = level->data[ch];
+		ch = digestSlice(digest, digestShift, level->bits);
+		slot = indexFind(level, ch);
+		tag = slot ? slot[0] : NULL;
+		
 		if (!tag) {
-			// create new bucket list here
-			bucket = (Bucket *)payload;
-			bucket->init();
-			bucket->flags = flags;
-			level->data[ch] = (Tag *)bucket;
+			// create new bucket list (or group) here
+			// (this may grow the index, which replaces it in the parent slot)
+			newBucket = newBucketFor(key, keyLength, content, contentLength, flags, digest, expires);
+			if (!newBucket) {
+				resp.result = MH_ERR;
+				return resp;
+			}
+			
+			// (leaf stays NULL if its group could not be allocated)
+			Tag *leaf = (Tag *)newBucket;
+			if (engine == MH_ENGINE_SWISS) {
+				leaf = NULL;
+				groupAppend( &leaf, newBucket );
+			}
+			
+			slot = leaf ? indexInsert(levelRef, ch) : NULL;
+			if (!slot) {
+				if (leaf && (leaf != (Tag *)newBucket)) freeGroup( (BucketGroup *)leaf );
+				arena->release( (void *)newBucket, bucketGetSize(newBucket) );
+				resp.result = MH_ERR;
+				return resp;
+			}
+			slot[0] = leaf;
 			
 			resp.result = MH_ADD;
 			stats->dataSize += keyLength + contentLength;
-			stats->metaSize += sizeof(Bucket) + MH_KLEN_SIZE + MH_LEN_SIZE;
+			stats->metaSize += bucketGetMetaSize(newBucket);
 			stats->numKeys++;
+			countCompressed( flags, content, contentLength, 1 );
 			tag = NULL; // break
 		}
-		else if (tag->type == MH_SIG_BUCKET) {
+		else if (tag->type & MH_SIG_BUCKET) {
 			// found bucket list, append
 			bucket = (Bucket *)tag;
 			lastBucket = NULL;
 			
 			while (bucket) {
-				if (bucketKeyEquals(bucket, key, keyLength)) {
-					// replace
-					newBucket = (Bucket *)payload;
-					newBucket->init();
-					newBucket->flags = flags;
-					newBucket->next = bucket->next;
+				if (bucketKeyEquals(bucket, key, keyLength, digest)) {
+					// replace (an expired key counts as added, as it was already gone)
+					resp.result = bucketExpired(bucket, nowMS()) ? MH_ADD : MH_REPLACE;
+					newBucket = bucketReplace( bucket, key, keyLength, content, contentLength, flags, digest, expires );
+					if (!newBucket) {
+						resp.result = MH_ERR;
+						return resp;
+					}
 					
 					if (lastBucket) lastBucket->next = newBucket;
-					else level->data[ch] = (Tag *)newBucket;
-					
-					resp.result = MH_REPLACE;
-					stats->dataSize -= (bucketGetKeyLength(bucket) + bucketGetContentLength(bucket));
-					stats->dataSize += keyLength + contentLength;
-					
-					free((void *)bucket);
+					else slot[0] = (Tag *)newBucket;
 					bucket = NULL; // break
 				}
 				else if (!bucket->next) {
 					// append here
-					newBucket = (Bucket *)payload;
-					newBucket->init();
-					newBucket->flags = flags;
+					newBucket = newBucketFor(key, keyLength, content, contentLength, flags, digest, expires);
+					if (!newBucket) {
+						resp.result = MH_ERR;
+						return resp;
+					}
 					bucket->next = newBucket;
 					resp.result = MH_ADD;
 					
 					stats->dataSize += keyLength + contentLength;
-					stats->metaSize += sizeof(Bucket) + MH_KLEN_SIZE + MH_LEN_SIZE;
+					stats->metaSize += bucketGetMetaSize(newBucket);
 					stats->numKeys++;
+					countCompressed( flags, content, contentLength, 1 );
 					bucket = NULL; // break
 					
 					// possibly reindex here
-					if ((bucketIndex >= maxBuckets + (ch % reindexScatter)) && (digestIndex < MH_DIGEST_SIZE - 1)) {
+					if ((bucketIndex >= maxBuckets + (ch % reindexScatter)) && (digestShift + level->bits + 4 <= digestBits)) {
 						// deeper we go
-						digestIndex++;
-						newLevel = new Index();
-						
-						// check for malloc error here
-						if (!newLevel) {
-							resp.result = MH_ERR;
-							return resp;
-						}
-						
-						stats->indexSize += sizeof(Index);
-						
-						bucket = (Bucket *)tag;
-						level->data[ch] = (Tag *)newLevel;
+						// new levels start at 4 bits, sized to fit all the slots the list will scatter into
+						digestShift += level->bits;
+						newLevel = newIndex( countSlices((Bucket *)tag, digestShift, 4), 4 );
 						
-						while (bucket) {
-							lastBucket = bucket;
-							bucket = bucket->next;
-							reindexBucket(lastBucket, newLevel, digestIndex);
+						// check for malloc error here (list just stays long)
+						if (newLevel) {
+							Tag *newTag = (Tag *)newLevel;
+							bucket = (Bucket *)tag;
+							
+							while (bucket) {
+								lastBucket = bucket;
+								bucket = bucket->next;
+								reindexBucket(lastBucket, &newTag, digestShift);
+								stats->reindexedKeys++;
+							}
+							
+							slot[0] = newTag;
+							stats->numReindexes++;
+							
+							// once a 4-bit level fills up with sub-indexes, merge them into one 8-bit level
+							if ((level->bits == 4) && (level->count == 16)) {
+								indexWiden(levelRef);
+								stats->numWidens++;
+							}
 						}
 					} // reindex
 				}
@@ -127,144 +249,1104 @@ Response Hash::store(unsigned char *key, MH_KLEN_T keyLength, unsigned char *con
 			
 			tag = NULL; // break
 		}
+		else if (tag->type == MH_SIG_GROUP) {
+			// found group, match control bytes
+			BucketGroup *group = (BucketGroup *)tag;
+			int pos = groupFind( &group, key, keyLength, digest, NULL );
+			
+			if (pos >= 0) {
+				// replace (an expired key counts as added, as it was already gone)
+				bucket = group->buckets[pos];
+				resp.result = bucketExpired(bucket, nowMS()) ? MH_ADD : MH_REPLACE;
+				newBucket = bucketReplace( bucket, key, keyLength, content, contentLength, flags, digest, expires );
+				if (!newBucket) {
+					resp.result = MH_ERR;
+					return resp;
+				}
+				if (newBucket != bucket) groupReplace( tag, group, pos, newBucket );
+			}
+			else if ((group->count < MH_GROUP_SIZE) || (digestShift + level->bits + 4 > digestBits)) {
+				// room in last group (or no digest bits left to split on, so it overflows into another group)
+				newBucket = newBucketFor(key, keyLength, content, contentLength, flags, digest, expires);
+				if (!newBucket) {
+					resp.result = MH_ERR;
+					return resp;
+				}
+				if (!groupAppend(slot, newBucket)) {
+					arena->release( (void *)newBucket, bucketGetSize(newBucket) );
+					resp.result = MH_ERR;
+					return resp;
+				}
+				resp.result = MH_ADD;
+				
+				stats->dataSize += keyLength + contentLength;
+				stats->metaSize += bucketGetMetaSize(newBucket);
+				stats->numKeys++;
+				countCompressed( flags, content, contentLength, 1 );
+			}
+			else {
+				// group is full, so split it into a new level, then start over from the top
+				// (widening may replace the level we are in, and the key may land in another full group)
+				if (!groupSplit(slot, digestShift + level->bits)) {
+					resp.result = MH_ERR;
+					return resp;
+				}
+				if ((level->bits == 4) && (level->count == 16)) {
+					indexWiden(levelRef);
+					stats->numWidens++;
+				}
+				return storeDigest( key, keyLength, content, contentLength, flags, digest, expires );
+			}
+			
+			tag = NULL; // break
+		}
 		else {
-			digestIndex++;
+			levelRef = slot;
+			digestShift += level->bits;
 		}
 	} // while tag
 	
 	return resp;
 }
 
-void Hash::reindexBucket(Bucket *bucket, Index *index, unsigned char digestIndex) {
+Bucket *Hash::bucketReplace(Bucket *bucket, unsigned char *key, MH_KLEN_T keyLength, unsigned char *content, MH_LEN_T contentLength, unsigned char flags, uint64_t digest, uint64_t expires) {
+	// replace value of existing bucket, overwriting it in place if the new one fits (no allocator traffic),
+	// otherwise with a new bucket that takes over its next link, for the caller to put in its place (the old one is released)
+	// flags must already be set the way storeDigest sets them, returns NULL if out of memory (bucket is left alone)
+	MH_LEN_T oldSize = bucketGetSize(bucket);
+	MH_LEN_T oldMetaSize = bucketGetMetaSize(bucket);
+	MH_LEN_T oldContentLength = bucketGetContentLength(bucket);
+	MH_LEN_T newMetaSize = bucketMetaSizeFor( keyLength, contentLength, flags & MH_FLAG_EXPIRES );
+	MH_LEN_T newSize = newMetaSize + keyLength + contentLength;
+	Bucket *newBucket = bucket;
+	countCompressed( bucket->type, bucketGetContent(bucket), oldContentLength, 0 );
+	
+	if ((oldMetaSize == newMetaSize) && arena->fits( (void *)bucket, oldSize, newSize )) {
+		bucketRewrite( bucket, keyLength, content, contentLength, flags, expires );
+	}
+	else {
+		newBucket = newBucketFor(key, keyLength, content, contentLength, flags, digest, expires);
+		if (!newBucket) {
+			countCompressed( bucket->type, bucketGetContent(bucket), oldContentLength, 1 );
+			return NULL;
+		}
+		newBucket->next = bucket->next;
+		arena->release( (void *)bucket, oldSize );
+	}
+	
+	stats->dataSize -= oldContentLength;
+	stats->dataSize += contentLength;
+	stats->metaSize -= oldMetaSize;
+	stats->metaSize += newMetaSize;
+	countCompressed( flags, content, contentLength, 1 );
+	return newBucket;
+}
+
+Bucket *Hash::newBucketFor(unsigned char *key, MH_KLEN_T keyLength, unsigned char *content, MH_LEN_T contentLength, unsigned char flags, uint64_t digest, uint64_t expires) {
+	// allocate and fill new bucket for key/value pair (not linked anywhere yet)
+	// key and content are combined together, with varint length prefixes, into single blob
+	// the expiry time is only stored if there is one (flags must already have MH_FLAG_EXPIRES to match)
+	// this is carved from the arena, to reduce malloc bashing and memory frag
+	MH_LEN_T payloadSize = bucketMetaSizeFor( keyLength, contentLength, flags & MH_FLAG_EXPIRES ) + keyLength + contentLength;
+	unsigned char *payload = (unsigned char *)arena->alloc(payloadSize);
+	
+	// check for malloc error here
+	if (!payload) return NULL;
+	
+	unsigned char *ptr = payload + sizeof(Bucket);
+	if (expires) { memcpy( (void *)ptr, (void *)&expires, MH_EXPIRES_SIZE ); ptr += MH_EXPIRES_SIZE; }
+	ptr = varintPut( ptr, keyLength );
+	memcpy( (void *)ptr, (void *)key, keyLength ); ptr += keyLength;
+	ptr = varintPut( ptr, contentLength );
+	memcpy( (void *)ptr, (void *)content, contentLength );
+	
+	Bucket *bucket = (Bucket *)payload;
+	bucket->init();
+	bucket->type = MH_SIG_BUCKET | flags;
+	bucket->digest = digest;
+	return bucket;
+}
+
+void Hash::reindexBucket(Bucket *bucket, Tag **levelRef, unsigned char digestShift) {
 	// reindex existing bucket into new subindex level
-	unsigned char digest[MH_DIGEST_SIZE];
-	MH_KLEN_T keyLength = bucketGetKeyLength(bucket);
-	unsigned char *key = bucketGetKey(bucket);
-	digestKey(key, keyLength, digest);
-	unsigned char ch = digest[digestIndex];
-	
-	Tag *tag = index->data[ch];
-	if (!tag) {
+	// (uses digest stored in bucket, so no rehashing is needed)
+	unsigned char ch = digestSlice(bucket->digest, digestShift, ((Index *)levelRef[0])->bits);
+	Tag **slot = indexFind( (Index *)levelRef[0], ch );
+	bucket->next = NULL;
+	
+	if (!slot) {
 		// create new bucket list here
-		index->data[ch] = (Tag *)bucket;
-		bucket->next = NULL;
+		// (index was sized by countSlices(), so this never has to grow)
+		slot = indexInsert(levelRef, ch);
+		slot[0] = (Tag *)bucket;
 	}
 	else {
 		// traverse list, append to end
-		Bucket *current = (Bucket *)tag;
+		Bucket *current = (Bucket *)slot[0];
 		while (current->next) {
 			current = current->next;
 		}
 		current->next = bucket;
-		bucket->next = NULL;
 	}
 }
 
+unsigned int Hash::countSlices(Bucket *bucket, unsigned char digestShift, unsigned char bits) {
+	// count unique digest slices in bucket list, for sizing a new index
+	uint64_t seen[4] = { 0, 0, 0, 0 };
+	unsigned int count = 0;
+	unsigned char ch;
+	
+	while (bucket) {
+		ch = digestSlice(bucket->digest, digestShift, bits);
+		if (!(seen[ch >> 6] & (1ULL << (ch & 63)))) {
+			seen[ch >> 6] |= (1ULL << (ch & 63));
+			count++;
+		}
+		bucket = bucket->next;
+	}
+	
+	return count;
+}
+
+Index *Hash::newIndex(unsigned int numSlots, unsigned char bits) {
+	// allocate new index from arena, using the smallest kind that fits numSlots
+	// 4-bit levels go straight from 4 sorted slots to 16 direct ones
+	unsigned char kind = MH_INDEX_256;
+	if (numSlots <= 4) kind = MH_INDEX_4;
+	else if (bits == 4) kind = MH_INDEX_16D;
+	else if (numSlots <= 16) kind = MH_INDEX_16;
+	else if (numSlots <= 48) kind = MH_INDEX_48;
+	
+	size_t size = indexSizeOf(kind);
+	Index *level = (Index *)arena->alloc( size );
+	if (!level) return NULL;
+	
+	memset( (void *)level, 0, size );
+	level->type = MH_SIG_INDEX;
+	level->kind = kind;
+	level->bits = bits;
+	level->count = 0;
+	
+	stats->indexSize += size;
+	stats->numIndexes++;
+	return level;
+}
+
+void Hash::freeIndex(Index *level) {
+	// release index back to arena (does not touch slots)
+	size_t size = indexSizeOf(level->kind);
+	stats->indexSize -= size;
+	stats->numIndexes--;
+	arena->release( (void *)level, size );
+}
+
+Tag **Hash::indexFind(Index *level, unsigned char ch) {
+	// locate slot for key in index, return NULL if not in use
+	int idx;
+	
+	switch (level->kind) {
+		case MH_INDEX_4: {
+			Index4 *node = (Index4 *)level;
+			for (idx = 0; idx < node->count; idx++) {
+				if (node->keys[idx] == ch) return &node->data[idx];
+			}
+			return NULL;
+		}
+		
+		case MH_INDEX_16: {
+			Index16 *node = (Index16 *)level;
+			for (idx = 0; idx < node->count; idx++) {
+				if (node->keys[idx] == ch) return &node->data[idx];
+			}
+			return NULL;
+		}
+		
+		case MH_INDEX_48: {
+			Index48 *node = (Index48 *)level;
+			idx = node->slots[ch];
+			return idx ? &node->data[idx - 1] : NULL;
+		}
+		
+		case MH_INDEX_16D: {
+			Index16D *node = (Index16D *)level;
+			return node->data[ch] ? &node->data[ch] : NULL;
+		}
+	}
+	
+	Index256 *node = (Index256 *)level;
+	return node->data[ch] ? &node->data[ch] : NULL;
+}
+
+Tag **Hash::indexInsert(Tag **levelRef, unsigned char ch) {
+	// add new slot for key (must not already exist), grow index if full
+	// caller must immediately store a non-null tag into the returned slot
+	Index *level = (Index *)levelRef[0];
+	int idx, pos;
+	
+	if (((level->kind == MH_INDEX_4) && (level->count >= 4)) || 
+		((level->kind == MH_INDEX_16) && (level->count >= 16)) || 
+		((level->kind == MH_INDEX_48) && (level->count >= 48))) {
+		level = indexGrow(levelRef);
+		if (!level) return NULL;
+	}
+	
+	switch (level->kind) {
+		case MH_INDEX_4:
+		case MH_INDEX_16: {
+			// keep keys sorted, so iteration visits slots in order
+			unsigned char *keys = (level->kind == MH_INDEX_4) ? ((Index4 *)level)->keys : ((Index16 *)level)->keys;
+			Tag **data = (level->kind == MH_INDEX_4) ? ((Index4 *)level)->data : ((Index16 *)level)->data;
+			
+			for (pos = 0; (pos < level->count) && (keys[pos] < ch); pos++) ;
+			for (idx = level->count; idx > pos; idx--) {
+				keys[idx] = keys[idx - 1];
+				data[idx] = data[idx - 1];
+			}
+			
+			keys[pos] = ch;
+			data[pos] = NULL;
+			level->count++;
+			return &data[pos];
+		}
+		
+		case MH_INDEX_48: {
+			// find free position (removals may leave holes)
+			Index48 *node = (Index48 *)level;
+			for (pos = 0; node->data[pos]; pos++) ;
+			node->slots[ch] = pos + 1;
+			node->count++;
+			return &node->data[pos];
+		}
+		
+		case MH_INDEX_16D: {
+			Index16D *node = (Index16D *)level;
+			node->count++;
+			return &node->data[ch];
+		}
+	}
+	
+	// the main index does not track its count, as its slots belong to separate stripes in concurrent mode
+	Index256 *node = (Index256 *)level;
+	if (level != index) node->count++;
+	return &node->data[ch];
+}
+
+Index *Hash::indexGrow(Tag **levelRef) {
+	// replace full index with next larger kind, and relink it in parent slot
+	Index *level = (Index *)levelRef[0];
+	return indexResize( levelRef, level->count + 1 );
+}
+
+Index *Hash::indexResize(Tag **levelRef, unsigned int numSlots) {
+	// replace index with the smallest kind that fits numSlots, and relink it in parent slot
+	Index *level = (Index *)levelRef[0];
+	Index *newLevel = newIndex( numSlots, level->bits );
+	if (!newLevel) return NULL;
+	
+	Tag *newTag = (Tag *)newLevel;
+	Tag *child;
+	
+	for (int ch = 0; (child = indexNext(level, &ch)); ch++) {
+		indexInsert(&newTag, (unsigned char)ch)[0] = child;
+	}
+	
+	freeIndex(level);
+	levelRef[0] = newTag;
+	return newLevel;
+}
+
+int Hash::indexCollapse(Tag **levelRef, unsigned int maxMerge) {
+	// shrink one index below the main one, after keys were removed under it
+	// frees it if empty, merges it back into a single bucket list if it holds maxMerge keys or less,
+	// or else moves it to a smaller kind once that would be no more than half full
+	// returns 1 if the index is gone (slot now holds a bucket list, or NULL if empty)
+	Index *level = (Index *)levelRef[0];
+	Tag *child;
+	Bucket *bucket, *tail;
+	unsigned int numKeys = 0;
+	int ch;
+	
+	if (level == index) return 0;
+	
+	if (!level->count) {
+		freeIndex(level);
+		levelRef[0] = NULL;
+		return 1;
+	}
+	
+	if (level->count <= maxMerge) {
+		// only lists and groups can be merged (sub-indexes below here were already collapsed if they could be)
+		for (ch = 0; (numKeys <= maxMerge) && (child = indexNext(level, &ch)); ch++) {
+			if (child->type == MH_SIG_INDEX) numKeys = maxMerge + 1;
+			else for (bucket = leafList(child); bucket && (numKeys <= maxMerge); bucket = bucket->next) numKeys++;
+		}
+		
+		if ((numKeys <= maxMerge) && (engine == MH_ENGINE_SWISS)) {
+			// gather buckets into one group in slot order (maxMerge is always below MH_GROUP_SIZE, so they fit)
+			BucketGroup *group = newGroup( (numKeys > MH_GROUP_MIN) ? MH_GROUP_SIZE : MH_GROUP_MIN );
+			BucketGroup *old, *next;
+			if (!group) return 0;
+			levelRef[0] = (Tag *)group;
+			
+			for (ch = 0; (child = indexNext(level, &ch)); ch++) {
+				for (bucket = leafList(child); bucket; bucket = tail) {
+					tail = bucket->next;
+					groupAppend( levelRef, bucket );
+				}
+				for (old = (BucketGroup *)child; old; old = next) {
+					next = old->next;
+					freeGroup(old);
+				}
+			}
+			
+			freeIndex(level);
+			return 1;
+		}
+		
+		if (numKeys <= maxMerge) {
+			// chain lists together in slot order (buckets keep their digests, so nothing is rehashed)
+			levelRef[0] = NULL;
+			tail = NULL;
+			
+			for (ch = 0; (child = indexNext(level, &ch)); ch++) {
+				if (tail) tail->next = (Bucket *)child;
+				else levelRef[0] = child;
+				for (tail = (Bucket *)child; tail->next; tail = tail->next) ;
+			}
+			
+			freeIndex(level);
+			return 1;
+		}
+	}
+	
+	switch (level->kind) {
+		case MH_INDEX_256: if (level->count <= 24) indexResize( levelRef, level->count ); break;
+		case MH_INDEX_48: if (level->count <= 8) indexResize( levelRef, level->count ); break;
+		case MH_INDEX_16:
+		case MH_INDEX_16D: if (level->count <= 2) indexResize( levelRef, level->count ); break;
+	}
+	return 0;
+}
+
+void Hash::compactTag(Tag **levelRef, unsigned int maxMerge) {
+	// internal method: collapse index and everything below it, bottom up
+	Index *level = (Index *)levelRef[0];
+	Tag **slot;
+	Tag *child;
+	
+	for (int ch = 0; (child = indexNext(level, &ch)); ch++) {
+		if (child->type == MH_SIG_INDEX) {
+			slot = indexFind(level, (unsigned char)ch);
+			compactTag( slot, maxMerge );
+			if (!slot[0]) indexRemove(level, (unsigned char)ch);
+		}
+	}
+	
+	indexCollapse( levelRef, maxMerge );
+}
+
+void Hash::indexRemove(Index *level, unsigned char ch) {
+	// remove slot for key from index (must exist)
+	int idx, pos;
+	
+	switch (level->kind) {
+		case MH_INDEX_4:
+		case MH_INDEX_16: {
+			unsigned char *keys = (level->kind == MH_INDEX_4) ? ((Index4 *)level)->keys : ((Index16 *)level)->keys;
+			Tag **data = (level->kind == MH_INDEX_4) ? ((Index4 *)level)->data : ((Index16 *)level)->data;
+			
+			for (pos = 0; (pos < level->count) && (keys[pos] != ch); pos++) ;
+			if (pos >= level->count) return;
+			
+			for (idx = pos; idx < level->count - 1; idx++) {
+				keys[idx] = keys[idx + 1];
+				data[idx] = data[idx + 1];
+			}
+			
+			level->count--;
+			keys[level->count] = 0;
+			data[level->count] = NULL;
+		}
+		break;
+		
+		case MH_INDEX_48: {
+			Index48 *node = (Index48 *)level;
+			if (!node->slots[ch]) return;
+			node->data[ node->slots[ch] - 1 ] = NULL;
+			node->slots[ch] = 0;
+			node->count--;
+		}
+		break;
+		
+		case MH_INDEX_256: {
+			Index256 *node = (Index256 *)level;
+			if (!node->data[ch]) return;
+			node->data[ch] = NULL;
+			if (level != index) node->count--;
+		}
+		break;
+		
+		case MH_INDEX_16D: {
+			Index16D *node = (Index16D *)level;
+			if (!node->data[ch]) return;
+			node->data[ch] = NULL;
+			node->count--;
+		}
+		break;
+	}
+}
+
+Tag *Hash::indexNext(Index *level, int *ch) {
+	// find first slot in use with key >= ch, in key order
+	// sets ch to the key found, returns NULL at end of index
+	int idx;
+	
+	switch (level->kind) {
+		case MH_INDEX_4:
+		case MH_INDEX_16: {
+			unsigned char *keys = (level->kind == MH_INDEX_4) ? ((Index4 *)level)->keys : ((Index16 *)level)->keys;
+			Tag **data = (level->kind == MH_INDEX_4) ? ((Index4 *)level)->data : ((Index16 *)level)->data;
+			
+			for (idx = 0; idx < level->count; idx++) {
+				if (keys[idx] >= ch[0]) {
+					ch[0] = keys[idx];
+					return data[idx];
+				}
+			}
+			return NULL;
+		}
+		
+		case MH_INDEX_48: {
+			Index48 *node = (Index48 *)level;
+			for (idx = ch[0]; idx < MH_INDEX_SIZE; idx++) {
+				if (node->slots[idx]) {
+					ch[0] = idx;
+					return node->data[ node->slots[idx] - 1 ];
+				}
+			}
+			return NULL;
+		}
+		
+		case MH_INDEX_16D: {
+			Index16D *node = (Index16D *)level;
+			for (idx = ch[0]; idx < 16; idx++) {
+				if (node->data[idx]) {
+					ch[0] = idx;
+					return node->data[idx];
+				}
+			}
+			return NULL;
+		}
+	}
+	
+	Index256 *node = (Index256 *)level;
+	for (idx = ch[0]; idx < MH_INDEX_SIZE; idx++) {
+		if (node->data[idx]) {
+			ch[0] = idx;
+			return node->data[idx];
+		}
+	}
+	return NULL;
+}
+
+void Hash::indexWiden(Tag **levelRef) {
+	// merge full 4-bit index with its 16 child 4-bit indexes into one 8-bit index
+	// this saves a level on every lookup below here (and the child headers)
+	// only done if every slot holds a 4-bit index, otherwise the level is left alone
+	Index *level = (Index *)levelRef[0];
+	Index *child;
+	Tag *grandChild;
+	unsigned int numSlots = 0;
+	int ch, sub;
+	
+	for (ch = 0; (child = (Index *)indexNext(level, &ch)); ch++) {
+		if ((child->type != MH_SIG_INDEX) || (child->bits != 4)) return;
+		numSlots += child->count;
+	}
+	
+	Index *newLevel = newIndex( numSlots, 8 );
+	if (!newLevel) return; // not fatal, just stay narrow
+	Tag *newTag = (Tag *)newLevel;
+	
+	// low nibble of new key is our slice, high nibble is the child slice
+	for (ch = 0; (child = (Index *)indexNext(level, &ch)); ch++) {
+		for (sub = 0; (grandChild = indexNext(child, &sub)); sub++) {
+			indexInsert(&newTag, (unsigned char)(ch | (sub << 4)))[0] = grandChild;
+		}
+		freeIndex(child);
+	}
+	
+	freeIndex(level);
+	levelRef[0] = newTag;
+}
+
+BucketGroup *Hash::newGroup(unsigned char capacity) {
+	// allocate new empty bucket group from arena (counted in indexSize, as it takes the place of index slots)
+	size_t size = groupSizeOf(capacity);
+	BucketGroup *group = (BucketGroup *)arena->alloc( size );
+	if (!group) return NULL;
+	
+	memset( (void *)group, 0, size );
+	memset( (void *)group->ctrl, MH_CTRL_EMPTY, MH_GROUP_SIZE );
+	group->type = MH_SIG_GROUP;
+	group->capacity = capacity;
+	
+	stats->indexSize += size;
+	return group;
+}
+
+void Hash::freeGroup(BucketGroup *group) {
+	// release group back to arena (does not touch buckets or overflow groups)
+	size_t size = groupSizeOf(group->capacity);
+	stats->indexSize -= size;
+	arena->release( (void *)group, size );
+}
+
+BucketGroup *Hash::groupGrow(BucketGroup *group) {
+	// replace full small group with one of MH_GROUP_SIZE, for the caller to put in its place
+	// returns NULL if out of memory (group is left alone)
+	BucketGroup *bigger = newGroup( MH_GROUP_SIZE );
+	if (!bigger) return NULL;
+	
+	bigger->count = group->count;
+	bigger->next = group->next;
+	memcpy( (void *)bigger->ctrl, (void *)group->ctrl, group->count );
+	memcpy( (void *)bigger->buckets, (void *)group->buckets, group->count * sizeof(Bucket *) );
+	
+	freeGroup(group);
+	return bigger;
+}
+
+int Hash::groupFind(BucketGroup **groupRef, unsigned char *key, MH_KLEN_T keyLength, uint64_t digest, uint64_t *numProbes) {
+	// find key in group (or its overflow groups), comparing keys only where control bytes match
+	// returns position and sets groupRef to the group holding it, or -1 with groupRef set to the last group
+	// numProbes (if not NULL) counts the keys compared
+	unsigned char control = groupControl(digest);
+	BucketGroup *group = groupRef[0];
+	uint32_t matches;
+	int pos;
+	
+	while (1) {
+		for (matches = groupMatch(group, control); matches; matches &= matches - 1) {
+			pos = lowestBit(matches);
+			if (numProbes) numProbes[0]++;
+			if (bucketKeyEquals(group->buckets[pos], key, keyLength, digest)) {
+				groupRef[0] = group;
+				return pos;
+			}
+		}
+		if (!group->next) break;
+		group = group->next;
+	}
+	
+	groupRef[0] = group;
+	return -1;
+}
+
+int Hash::groupAppend(Tag **leafRef, Bucket *bucket) {
+	// add bucket after the last one in leaf, starting a new group if leafRef is empty or an overflow group if the last one is full
+	// it is also linked after the last bucket, so the leaf still reads as one list
+	// returns 0 if a new group was needed and could not be allocated
+	BucketGroup *group = (BucketGroup *)leafRef[0];
+	Bucket *last = NULL;
+	bucket->next = NULL;
+	
+	if (group) {
+		while (group->next) group = group->next;
+		if (group->count) last = group->buckets[ group->count - 1 ];
+	}
+	if (group && (group->count >= group->capacity) && (group->capacity < MH_GROUP_SIZE)) {
+		// only the first group can be small (overflow groups start out full size)
+		group = groupGrow(group);
+		if (!group) return 0;
+		leafRef[0] = (Tag *)group;
+	}
+	else if (!group || (group->count >= MH_GROUP_SIZE)) {
+		BucketGroup *extra = newGroup( group ? MH_GROUP_SIZE : MH_GROUP_MIN );
+		if (!extra) return 0;
+		if (group) group->next = extra;
+		else leafRef[0] = (Tag *)extra;
+		group = extra;
+	}
+	
+	group->ctrl[ group->count ] = groupControl(bucket->digest);
+	group->buckets[ group->count ] = bucket;
+	group->count++;
+	if (last) last->next = bucket;
+	return 1;
+}
+
+void Hash::groupReplace(Tag *leaf, BucketGroup *group, int pos, Bucket *bucket) {
+	// put new bucket for the same key in place of the one at pos (bucketReplace already gave it the old next link)
+	Bucket *prev = groupPrev( (BucketGroup *)leaf, group, pos );
+	if (prev) prev->next = bucket;
+	group->buckets[pos] = bucket;
+}
+
+void Hash::groupRemove(Tag **leafRef, BucketGroup *group, int pos) {
+	// unlink bucket at pos from leaf (does not release it), closing the gap so positions stay packed
+	// frees the group if that leaves it empty, which sets leafRef to NULL if it was the only one
+	Bucket *bucket = group->buckets[pos];
+	Bucket *prev = groupPrev( (BucketGroup *)leafRef[0], group, pos );
+	if (prev) prev->next = bucket->next;
+	
+	group->count--;
+	memmove( (void *)&group->ctrl[pos], (void *)&group->ctrl[pos + 1], group->count - pos );
+	memmove( (void *)&group->buckets[pos], (void *)&group->buckets[pos + 1], (group->count - pos) * sizeof(Bucket *) );
+	group->ctrl[ group->count ] = MH_CTRL_EMPTY;
+	group->buckets[ group->count ] = NULL;
+	if (group->count) return;
+	
+	BucketGroup *first = (BucketGroup *)leafRef[0];
+	if (group == first) leafRef[0] = (Tag *)group->next;
+	else {
+		while (first->next != group) first = first->next;
+		first->next = group->next;
+	}
+	freeGroup(group);
+}
+
+Bucket *Hash::groupPrev(BucketGroup *first, BucketGroup *group, int pos) {
+	// bucket linked just before position pos, which may be the last one in the previous group, or NULL if there is none
+	if (pos) return group->buckets[pos - 1];
+	if (first == group) return NULL;
+	while (first->next != group) first = first->next;
+	return first->buckets[ first->count - 1 ];
+}
+
+int Hash::groupSplit(Tag **slot, unsigned char digestShift) {
+	// split full group into a new 4-bit index level, with a group for each slice (like a list is reindexed)
+	// this moves MH_GROUP_SIZE buckets at most, and they keep their digests, so nothing is rehashed and it never stalls
+	// everything is allocated up front, so returns 0 with the group left as it was if out of memory
+	BucketGroup *group = (BucketGroup *)slot[0];
+	BucketGroup *groups[16];
+	unsigned int counts[16];
+	unsigned int numSlices = 0;
+	Bucket *bucket, *next;
+	unsigned char ch;
+	int idx;
+	
+	memset( (void *)counts, 0, sizeof(counts) );
+	for (bucket = group->buckets[0]; bucket; bucket = bucket->next) {
+		counts[ digestSlice(bucket->digest, digestShift, 4) ]++;
+	}
+	for (idx = 0; idx < 16; idx++) {
+		if (counts[idx]) numSlices++;
+	}
+	
+	Index *newLevel = newIndex( numSlices, 4 );
+	if (!newLevel) return 0;
+	
+	for (idx = 0; idx < 16; idx++) {
+		groups[idx] = counts[idx] ? newGroup( (counts[idx] > MH_GROUP_MIN) ? MH_GROUP_SIZE : MH_GROUP_MIN ) : NULL;
+		if (counts[idx] && !groups[idx]) {
+			while (idx--) if (groups[idx]) freeGroup( groups[idx] );
+			freeIndex(newLevel);
+			return 0;
+		}
+	}
+	
+	// index was sized for all the slices, so it never has to grow, and each new group has room for its buckets
+	Tag *newTag = (Tag *)newLevel;
+	Tag **sub;
+	
+	for (bucket = group->buckets[0]; bucket; bucket = next) {
+		next = bucket->next;
+		ch = digestSlice(bucket->digest, digestShift, 4);
+		sub = indexFind(newLevel, ch);
+		if (!sub) {
+			sub = indexInsert(&newTag, ch);
+			sub[0] = (Tag *)groups[ch];
+		}
+		groupAppend( sub, bucket );
+		stats->reindexedKeys++;
+	}
+	
+	freeGroup(group);
+	slot[0] = newTag;
+	stats->numReindexes++;
+	return 1;
+}
+
 Response Hash::fetch(unsigned char *key, MH_KLEN_T keyLength) {
 	// fetch value given key
-	unsigned char digest[MH_DIGEST_SIZE];
+	// when instrumented, levels passed and keys compared are counted as we go
+	OpTimer timer( instrument, MH_OP_FETCH );
 	Response resp;
 	
 	// first digest key
-	digestKey(key, keyLength, digest);
+	uint64_t digest = digestKey(key, keyLength);
 	
-	unsigned char digestIndex = 0;
-	unsigned char ch;
+	uint32_t contentLength;
+	uint64_t numLevels = 0;
+	uint64_t numProbes = 0;
+	Bucket *bucket = findBucket( key, keyLength, digest, &numLevels, &numProbes );
 	
-	Tag *tag = (Tag *)index;
-	Index *level;
-	Bucket *bucket;
+	if (!bucket) {
+		// not found
+		resp.result = MH_ERR;
+	}
+	else if (bucketExpired(bucket, nowMS())) {
+		// expired keys are misses, and are reclaimed right away unless other threads may be reading
+		// (in concurrent mode, sweep() or the next store/remove reclaims them)
+		resp.result = MH_ERR;
+		if (instrument) instrument->lookup( 0, numLevels, numProbes );
+		if (!locks) remove( key, keyLength );
+		return resp;
+	}
+	else {
+		// found!
+		resp.result = MH_OK;
+		resp.content = varintGet( bucketGetKey(bucket) + keyLength, &contentLength );
+		resp.contentLength = contentLength;
+		
+		resp.flags = bucket->type & (MH_FLAGS_VALUE | MH_FLAG_COMPRESSED);
+		if (maxBytes) bucketTouch(bucket);
+	}
 	
-	unsigned char *bucketData;
-	unsigned char *tempCL;
+	if (instrument) instrument->lookup( resp.result == MH_OK, numLevels, numProbes );
+	return resp;
+}
+
+void Hash::fetchBatch(BulkRecord *records, size_t count, Response *results) {
+	// fetch many keys at once (only key and keyLength are used), with the same result fetch() gives for each one
+	// up to MH_BATCH_WIDTH lookups are in flight, and each round takes every one of them one memory access further,
+	// prefetching what it reads next (see batchStep), so that is usually in cache by the time it comes around again
+	// and the cache misses of a whole round overlap, where fetch() waits on each one in turn
+	// expired keys are misses, and are only reclaimed at the end, as removing them may free groups still being visited
+	// counted by the instrument like fetch(), but not timed (latency samples are for single operations)
+	BatchLookup lanes[ MH_BATCH_WIDTH ];
+	BatchLookup *look;
+	Response *resp;
+	Bucket *bucket;
+	std::vector<size_t> expired;
+	uint64_t now = nowMS();
+	uint32_t contentLength;
+	size_t next = 0;
+	int numLanes = 0;
+	int lane;
 	
-	while (tag && (tag->type == MH_SIG_INDEX)) {
-		level = (Index *)tag;
-		ch = digest[digestIndex];
-		tag = level->data[ch];
-		if (!tag) {
-			// not found
-			resp.result = MH_ERR;
-			tag = NULL; // break
+	while ((next < count) || numLanes) {
+		// start lookups in free lanes (digesting keys here, so that overlaps with the misses too)
+		while ((numLanes < MH_BATCH_WIDTH) && (next < count)) {
+			look = &lanes[ numLanes++ ];
+			look->idx = next++;
+			look->digest = digestKey( records[look->idx].key, records[look->idx].keyLength );
+			look->tag = (Tag *)index;
+			look->bucket = NULL;
+			look->matches = 0;
+			look->digestShift = 0;
+			look->levels = 0;
+			look->probes = 0;
 		}
-		else if (tag->type == MH_SIG_BUCKET) {
-			// found bucket list, append
-			bucket = (Bucket *)tag;
+		
+		for (lane = 0; lane < numLanes; ) {
+			look = &lanes[lane];
+			if (batchStep(look, &records[look->idx])) {
+				lane++;
+				continue;
+			}
 			
-			while (bucket) {
-				if (bucketKeyEquals(bucket, key, keyLength)) {
-					// found!
-					bucketData = ((unsigned char *)bucket) + sizeof(Bucket);
-					tempCL = bucketData + MH_KLEN_SIZE + keyLength;
-					
-					resp.result = MH_OK;
-					resp.contentLength = ((MH_LEN_T *)tempCL)[0];
-					resp.content = bucketData + MH_KLEN_SIZE + keyLength + MH_LEN_SIZE;
-					
-					resp.flags = bucket->flags;
-					bucket = NULL; // break
-				}
-				else if (!bucket->next) {
-					// not found
-					resp.result = MH_ERR;
-					bucket = NULL; // break
+			// lookup done, so fill in its response, and move the last lane into its place (not yet stepped this round)
+			resp = &results[ look->idx ];
+			bucket = look->bucket;
+			*resp = Response();
+			
+			if (!bucket) {
+				resp->result = MH_ERR;
+			}
+			else if (bucketExpired(bucket, now)) {
+				resp->result = MH_ERR;
+				expired.push_back( look->idx );
+			}
+			else {
+				resp->result = MH_OK;
+				resp->content = varintGet( bucketGetKey(bucket) + records[look->idx].keyLength, &contentLength );
+				resp->contentLength = contentLength;
+				resp->flags = bucket->type & (MH_FLAGS_VALUE | MH_FLAG_COMPRESSED);
+				if (maxBytes) bucketTouch(bucket);
+			}
+			
+			if (instrument) instrument->lookup( resp->result == MH_OK, look->levels, look->probes );
+			lanes[lane] = lanes[ --numLanes ];
+		}
+	}
+	
+	// reclaim expired keys, unless other threads may be reading (same as fetch)
+	// this only frees their own buckets, so responses for the other keys stay valid
+	if (!locks) {
+		for (size_t idx = 0; idx < expired.size(); idx++) {
+			remove( records[ expired[idx] ].key, records[ expired[idx] ].keyLength );
+		}
+	}
+}
+
+int Hash::batchStep(BatchLookup *look, BulkRecord *record) {
+	// take one fetchBatch lookup one memory access further (an index level, a group match, or a key compare),
+	// prefetching whatever it reads next
+	// returns 1 while still in flight, or 0 once done, with look->bucket set to the bucket found (NULL if not found)
+	Tag *tag = look->tag;
+	Bucket *bucket;
+	
+	if (tag->type == MH_SIG_INDEX) {
+		// one level down
+		Index *level = (Index *)tag;
+		Tag **slot = indexFind( level, digestSlice(look->digest, look->digestShift, level->bits) );
+		look->levels++;
+		look->digestShift += level->bits;
+		tag = slot ? slot[0] : NULL;
+	}
+	else if (tag->type == MH_SIG_GROUP) {
+		BucketGroup *group = (BucketGroup *)tag;
+		if (!look->matches) {
+			// match control bytes, and prefetch the buckets to compare next round
+			look->matches = groupMatch( group, groupControl(look->digest) );
+			if (look->matches) {
+				for (uint32_t matches = look->matches; matches; matches &= matches - 1) {
+					MH_PREFETCH( group->buckets[ lowestBit(matches) ] );
 				}
-				else {
-					bucket = bucket->next;
+				return 1;
+			}
+		}
+		else {
+			for (; look->matches; look->matches &= look->matches - 1) {
+				bucket = group->buckets[ lowestBit(look->matches) ];
+				look->probes++;
+				if (bucketKeyEquals(bucket, record->key, record->keyLength, look->digest)) {
+					look->bucket = bucket;
+					return 0;
 				}
-			} // while bucket
+			}
+		}
+		tag = (Tag *)group->next;
+	}
+	else {
+		// next bucket in list
+		bucket = (Bucket *)tag;
+		look->probes++;
+		if (bucketKeyEquals(bucket, record->key, record->keyLength, look->digest)) {
+			look->bucket = bucket;
+			return 0;
+		}
+		tag = (Tag *)bucket->next;
+	}
+	
+	if (!tag) return 0;
+	MH_PREFETCH( tag );
+	look->tag = tag;
+	return 1;
+}
+
+Response Hash::modify(unsigned char *key, MH_KLEN_T keyLength, Modifier *modifier) {
+	// read-modify-write one key (see Modifier), overwriting the value in place when the new one fits its allocation
+	// (the usual case for counters), otherwise storing it like store() does, which takes a second lookup
+	// returns MH_ADD or MH_REPLACE if a new value was stored (see Modifier::stored), MH_OK if the modifier left the key alone,
+	// or MH_ERR (with current.flags still marked compressed if the current value could not be decoded)
+	OpTimer timer( instrument, MH_OP_STORE );
+	Response resp;
+	
+	uint64_t digest = digestKey(key, keyLength);
+	Bucket *bucket = findBucket( key, keyLength, digest );
+	unsigned char wasExpired = bucket ? bucketExpired(bucket, nowMS()) : 0;
+	
+	modifier->current = Response();
+	modifier->expires = 0;
+	modifier->stored = 0;
+	if (bucket && !wasExpired) {
+		uint32_t contentLength;
+		modifier->current.result = MH_OK;
+		modifier->current.content = varintGet( bucketGetKey(bucket) + keyLength, &contentLength );
+		modifier->current.contentLength = contentLength;
+		modifier->current.flags = bucket->type & (MH_FLAGS_VALUE | MH_FLAG_COMPRESSED);
+		modifier->expires = bucketGetExpires(bucket);
+		if (maxBytes) bucketTouch(bucket);
+		
+		if (!expand( &modifier->current, &modifier->expanded )) {
+			resp.result = MH_ERR;
+			return resp;
+		}
+	}
+	
+	if (!modifier->apply()) {
+		resp.result = MH_OK;
+		return resp;
+	}
+	modifier->stored = 1;
+	
+	unsigned char *content = (unsigned char *)modifier->value.data();
+	MH_LEN_T contentLength = (MH_LEN_T)modifier->value.size();
+	unsigned char flags = modifier->flags & MH_FLAGS_VALUE;
+	uint64_t expires = modifier->expires;
+	
+	std::string compressed;
+	if (compressor && compressor->compress(content, contentLength, compressed)) {
+		content = (unsigned char *)compressed.data();
+		contentLength = (MH_LEN_T)compressed.size();
+		flags |= MH_FLAG_COMPRESSED;
+	}
+	
+	if (bucket) {
+		MH_LEN_T oldMetaSize = bucketGetMetaSize(bucket);
+		MH_LEN_T newMetaSize = bucketMetaSizeFor( keyLength, contentLength, expires ? 1 : 0 );
+		
+		if ((oldMetaSize == newMetaSize) && arena->fits( (void *)bucket, bucketGetSize(bucket), newMetaSize + keyLength + contentLength )) {
+			// same flags as storeDigest would set
+			if (expires) flags |= MH_FLAG_EXPIRES;
+			if (maxBytes) flags |= MH_FLAG_REFERENCED;
 			
-			tag = NULL; // break
+			MH_LEN_T oldContentLength = bucketGetContentLength(bucket);
+			countCompressed( bucket->type, bucketGetContent(bucket), oldContentLength, 0 );
+			bucketRewrite( bucket, keyLength, content, contentLength, flags, expires );
+			
+			resp.result = wasExpired ? MH_ADD : MH_REPLACE;
+			stats->dataSize -= oldContentLength;
+			stats->dataSize += contentLength;
+			countCompressed( flags, content, contentLength, 1 );
+			return resp;
 		}
-		else {
-			digestIndex++;
+	}
+	
+	if (!makeRoom(keyLength, contentLength, expires, digest)) {
+		resp.result = MH_ERR;
+		return resp;
+	}
+	return storeDigest( key, keyLength, content, contentLength, flags, digest, expires );
+}
+
+Bucket *Hash::findBucket(unsigned char *key, MH_KLEN_T keyLength, uint64_t digest, uint64_t *numLevels, uint64_t *numProbes) {
+	// locate bucket for key given its digest, or NULL if not found (expired keys are still found)
+	// numLevels and numProbes (if not NULL) are set to the index levels passed and keys compared (see Instrument)
+	unsigned char digestShift = 0;
+	Tag *tag = (Tag *)index;
+	Tag **slot;
+	Index *level;
+	Bucket *bucket = NULL;
+	uint64_t levels = 0;
+	uint64_t probes = 0;
+	
+	while (tag && (tag->type == MH_SIG_INDEX)) {
+		level = (Index *)tag;
+		levels++;
+		slot = indexFind( level, digestSlice(digest, digestShift, level->bits) );
+		tag = slot ? slot[0] : NULL;
+		digestShift += level->bits;
+	}
+	
+	if (tag && (tag->type == MH_SIG_GROUP)) {
+		// match whole group at once
+		BucketGroup *group = (BucketGroup *)tag;
+		int pos = groupFind( &group, key, keyLength, digest, &probes );
+		if (pos >= 0) bucket = group->buckets[pos];
+	}
+	else {
+		for (bucket = (Bucket *)tag; bucket; bucket = bucket->next) {
+			probes++;
+			if (bucketKeyEquals(bucket, key, keyLength, digest)) break;
 		}
-	} // while tag
+	}
 	
-	return resp;
+	if (numLevels) numLevels[0] = levels;
+	if (numProbes) numProbes[0] = probes;
+	return bucket;
+}
+
+void Hash::bucketRewrite(Bucket *bucket, MH_KLEN_T keyLength, unsigned char *content, MH_LEN_T contentLength, unsigned char flags, uint64_t expires) {
+	// overwrite value in existing allocation, with no allocator traffic
+	// caller checks it fits, and that the meta size is unchanged (so the same expiry presence and length encoding)
+	unsigned char *tempCL = bucketGetKey(bucket) + keyLength;
+	memmove( (void *)varintPut(tempCL, contentLength), (void *)content, contentLength );
+	if (expires) memcpy( (void *)(((unsigned char *)bucket) + sizeof(Bucket)), (void *)&expires, MH_EXPIRES_SIZE );
+	bucket->type = MH_SIG_BUCKET | flags;
+}
+
+MH_LEN_T Hash::valueLength(Response *resp) {
+	// length of value in response once expanded (the original length, if stored compressed)
+	if (!(resp->flags & MH_FLAG_COMPRESSED)) return resp->contentLength;
+	uint32_t rawLength = 0;
+	Compressor::rawLength( resp->content, resp->contentLength, &rawLength );
+	return rawLength;
+}
+
+int Hash::valueCopy(Response *resp, unsigned char *dest) {
+	// copy value in response to dest (which must hold valueLength bytes), decompressing as needed
+	// returns 0 if a compressed value could not be decoded
+	if (!(resp->flags & MH_FLAG_COMPRESSED)) {
+		if (resp->contentLength) memcpy( (void *)dest, (void *)resp->content, resp->contentLength );
+		return 1;
+	}
+	return Compressor::decompress( resp->content, resp->contentLength, dest, valueLength(resp), compressor ? &compressor->dict : NULL );
+}
+
+int Hash::expand(Response *resp, std::string *out) {
+	// decompress value in response into out, and point the response at it (no-op for plain values)
+	// returns 0 if the value could not be decoded
+	if (!(resp->flags & MH_FLAG_COMPRESSED)) return 1;
+	out->resize( valueLength(resp) );
+	if (!valueCopy( resp, (unsigned char *)&(*out)[0] )) return 0;
+	
+	resp->content = (unsigned char *)out->data();
+	resp->contentLength = (MH_LEN_T)out->size();
+	resp->flags &= ~MH_FLAG_COMPRESSED;
+	return 1;
 }
 
 Response Hash::remove(unsigned char *key, MH_KLEN_T keyLength) {
 	// remove bucket given key
-	unsigned char digest[MH_DIGEST_SIZE];
+	// then shrink the index levels we passed through, deepest first (see indexCollapse)
+	OpTimer timer( instrument, MH_OP_REMOVE );
 	Response resp;
 	
 	// first digest key
-	digestKey(key, keyLength, digest);
+	uint64_t digest = digestKey(key, keyLength);
 	
-	unsigned char digestIndex = 0;
+	unsigned char digestShift = 0;
 	unsigned char ch;
 	
 	Tag *tag = (Tag *)index;
+	Tag **slot;
 	Index *level;
 	Bucket *bucket, *lastBucket;
 	
+	// path of levels walked: each level, the parent slot pointing at it, and the slice taken from it
+	Index *levels[ MH_MAX_DEPTH ];
+	Tag **refs[ MH_MAX_DEPTH ];
+	unsigned char slices[ MH_MAX_DEPTH ];
+	int depth = 0;
+	unsigned char removed = 0;
+	
 	while (tag && (tag->type == MH_SIG_INDEX)) {
 		level = (Index *)tag;
-		ch = digest[digestIndex];
-		tag = level->data[ch];
+		ch = digestSlice(digest, digestShift, level->bits);
+		slot = indexFind(level, ch);
+		tag = slot ? slot[0] : NULL;
+		levels[depth] = level;
+		slices[depth] = ch;
+		
 		if (!tag) {
 			// not found
 			resp.result = MH_ERR;
 			tag = NULL; // break
 		}
-		else if (tag->type == MH_SIG_BUCKET) {
+		else if (tag->type & MH_SIG_BUCKET) {
 			// found bucket list, traverse
 			bucket = (Bucket *)tag;
 			lastBucket = NULL;
 			
 			while (bucket) {
-				if (bucketKeyEquals(bucket, key, keyLength)) {
-					// found!
+				if (bucketKeyEquals(bucket, key, keyLength, digest)) {
+					// found! (if it already expired, it is reclaimed but reported as not found)
 					stats->dataSize -= (bucketGetKeyLength(bucket) + bucketGetContentLength(bucket));
-					stats->metaSize -= (sizeof(Bucket) + MH_KLEN_SIZE + MH_LEN_SIZE);
+					stats->metaSize -= bucketGetMetaSize(bucket);
 					stats->numKeys--;
+					countCompressed( bucket->type, bucketGetContent(bucket), bucketGetContentLength(bucket), 0 );
 					
 					if (lastBucket) lastBucket->next = bucket->next;
-					else level->data[ch] = bucket->next;
+					else if (bucket->next) slot[0] = (Tag *)bucket->next;
+					else indexRemove(level, ch); // list is now empty
 					
-					resp.result = MH_OK;
-					free((void *)bucket);
+					resp.result = bucketExpired(bucket, nowMS()) ? MH_ERR : MH_OK;
+					removed = 1;
+					arena->release( (void *)bucket, bucketGetSize(bucket) );
 					bucket = NULL; // break
 				}
 				else if (!bucket->next) {
@@ -280,56 +1362,197 @@ Response Hash::remove(unsigned char *key, MH_KLEN_T keyLength) {
 			
 			tag = NULL; // break
 		}
+		else if (tag->type == MH_SIG_GROUP) {
+			// found group, match control bytes
+			BucketGroup *group = (BucketGroup *)tag;
+			int pos = groupFind( &group, key, keyLength, digest, NULL );
+			
+			if (pos < 0) {
+				// not found
+				resp.result = MH_ERR;
+			}
+			else {
+				// found! (if it already expired, it is reclaimed but reported as not found)
+				bucket = group->buckets[pos];
+				stats->dataSize -= (bucketGetKeyLength(bucket) + bucketGetContentLength(bucket));
+				stats->metaSize -= bucketGetMetaSize(bucket);
+				stats->numKeys--;
+				countCompressed( bucket->type, bucketGetContent(bucket), bucketGetContentLength(bucket), 0 );
+				
+				// (through a copy of the slot, as indexRemove needs it in use)
+				groupRemove( &tag, group, pos );
+				if (tag) slot[0] = tag;
+				else indexRemove(level, ch); // group is now empty
+				
+				resp.result = bucketExpired(bucket, nowMS()) ? MH_ERR : MH_OK;
+				removed = 1;
+				arena->release( (void *)bucket, bucketGetSize(bucket) );
+			}
+			
+			tag = NULL; // break
+		}
 		else {
-			digestIndex++;
+			digestShift += level->bits;
+			refs[++depth] = slot;
 		}
 	} // while tag
 	
+	if (removed) {
+		// merge back only well below the reindex point, so lists don't flip-flop between the two
+		for (; depth > 0; depth--) {
+			if (!indexCollapse( refs[depth], maxBuckets / 2 )) break;
+			if (!refs[depth][0]) indexRemove( levels[depth - 1], slices[depth - 1] );
+		}
+	}
+	
 	return resp;
 }
 
-void Hash::clear() {
-	// clear ALL keys/values
-	for (int idx = 0; idx < MH_INDEX_SIZE; idx++) {
-		if (index->data[idx]) {
-			clearTag( index->data[idx] );
-			index->data[idx] = NULL;
+uint64_t Hash::sweep(size_t maxWork) {
+	// reclaim expired keys incrementally, looking at about maxWork keys per call (so it never stalls)
+	// each call picks up where the last one left off, and starts over after a full pass
+	// returns number of keys reclaimed
+	std::vector<Bucket *> buckets;
+	std::vector<std::string> expired;
+	uint64_t now = nowMS();
+	
+	if (sweepCursor.done) sweepCursor = Cursor();
+	cursorNext( &sweepCursor, maxWork ? maxWork : 1, &buckets );
+	
+	// copy keys out first, as removing them may merge the lists we are holding
+	for (size_t idx = 0; idx < buckets.size(); idx++) {
+		if (bucketExpired(buckets[idx], now)) {
+			expired.push_back( std::string((char *)bucketGetKey(buckets[idx]), bucketGetKeyLength(buckets[idx])) );
 		}
 	}
+	
+	for (size_t idx = 0; idx < expired.size(); idx++) {
+		remove( (unsigned char *)expired[idx].data(), (MH_KLEN_T)expired[idx].size() );
+	}
+	
+	return expired.size();
 }
 
-void Hash::clear(unsigned char slice) {
-	// clear one "slice" from main index (about 1/256 of total keys)
-	// this is so you can split up the job into pieces and not hang the CPU for too long
-	unsigned char slice1 = slice / 16;
-	unsigned char slice2 = slice % 16;
-	
-	// since our index system is 4-bit, we split the uchar into two pieces
-	// and traverse into a nested index for the 2nd piece, if applicable
-	if (index->data[slice1]) {
-		Tag *tag = index->data[slice1];
-		if (tag->type == MH_SIG_INDEX) {
-			// nested index, use idx2
-			Index *level = (Index *)tag;
-			if (level->data[slice2]) {
-				clearTag( level->data[slice2] );
-				level->data[slice2] = NULL;
-			}
+uint64_t Hash::evict(uint64_t bytesNeeded, int ownStripe) {
+	// CLOCK eviction: advance the hand through the keys in digest order, until bytesNeeded more fit under maxBytes
+	// referenced keys get a second chance (their bit is cleared), and the rest are evicted (expired keys first in line)
+	// the hand moves one main index slot at a time, so in concurrent mode it only needs that slot's stripe:
+	// ownStripe is already locked by the caller, and other stripes are skipped if they are busy
+	// gives up after two full turns (the first may only clear bits), returns number of bytes freed
+	std::vector<Bucket *> buckets;
+	std::string victim;
+	uint64_t now = nowMS();
+	uint64_t freed = 0;
+	uint64_t work = 0;
+	uint64_t maxWork = (2 * stats->numKeys) + (2 * MH_INDEX_SIZE);
+	
+	if (locks) evictLock.lock();
+	
+	while ((bytesUsed() + bytesNeeded > maxBytes) && (work < maxWork)) {
+		// the hand wraps around from the last key back to the first
+		uint64_t lower = clockHand.started ? (clockHand.lastOrder + 1) : 0;
+		unsigned char slice = (unsigned char)(lower >> 56);
+		uint64_t sliceEnd = lower | (UINT64_MAX >> 8);
+		clockHand.started = 1;
+		work++;
+		
+		int locked = locks && ((int)slice != ownStripe);
+		if (locked && !locks[slice].try_lock()) {
+			clockHand.lastOrder = sliceEnd;
+			continue;
+		}
+		
+		Tag **slot = indexFind(index, slice);
+		buckets.clear();
+		if (!slot || !cursorTag( &clockHand, slot[0], 8, lower, 1, MH_EVICT_BATCH, &buckets )) clockHand.lastOrder = sliceEnd;
+		
+		// the whole batch is always visited (the hand is already past it), so this may free a little extra
+		// removing a key may merge the lists we are holding, but never moves the other buckets
+		for (size_t idx = 0; idx < buckets.size(); idx++) {
+			Bucket *bucket = buckets[idx];
+			work++;
 			
-			// also clear top-level index if it is now empty
-			int empty = 1;
-			for (int idx = 0; idx < MH_INDEX_SIZE; idx++) {
-				if (level->data[idx]) { empty = 0; idx = MH_INDEX_SIZE; }
-			}
-			if (empty) {
-				clearTag( tag );
-				index->data[slice1] = NULL;
+			if ((bucket->type & MH_FLAG_REFERENCED) && !bucketExpired(bucket, now)) {
+				bucket->type &= ~MH_FLAG_REFERENCED;
+				continue;
 			}
+			
+			MH_LEN_T size = bucketGetSize(bucket);
+			victim.assign( (char *)bucketGetKey(bucket), bucketGetKeyLength(bucket) );
+			remove( (unsigned char *)victim.data(), (MH_KLEN_T)victim.size() );
+			
+			stats->numEvictions++;
+			stats->evictedBytes += size;
+			freed += size;
 		}
-		else if (tag->type == MH_SIG_BUCKET) {
-			clearTag( tag );
-			index->data[slice1] = NULL;
-		}
+		
+		if (locked) locks[slice].unlock();
+	}
+	
+	if (locks) evictLock.unlock();
+	return freed;
+}
+
+void Hash::compact(unsigned char slice) {
+	// collapse one "slice" from main index (about 1/256 of total keys), like clear(slice)
+	// merges every subtree holding fewer keys than a list may before it is reindexed
+	Tag **slot = indexFind(index, slice);
+	if (slot && (slot[0]->type == MH_SIG_INDEX)) {
+		compactTag( slot, maxBuckets - 1 );
+		if (!slot[0]) indexRemove( index, slice );
+	}
+}
+
+void Hash::clear() {
+	// clear ALL keys/values
+	// everything lives in the arena, so release whole chunks at once instead of walking the tree
+	arena->reset();
+	
+	stats->numKeys = 0;
+	stats->numIndexes = 0;
+	stats->indexSize = 0;
+	stats->metaSize = 0;
+	stats->dataSize = 0;
+	stats->compressedSize = 0;
+	stats->rawSize = 0;
+	
+	sweepCursor = Cursor();
+	clockHand = Cursor();
+	initIndex();
+}
+
+void Hash::clear(unsigned char slice) {
+	// clear one "slice" from main index (about 1/256 of total keys)
+	// this is so you can split up the job into pieces and not hang the CPU for too long
+	// the main index is always dense, so the slice is simply one of its slots
+	Tag **slot = indexFind(index, slice);
+	
+	if (slot) {
+		clearTag( slot[0] );
+		indexRemove( index, slice );
+	}
+}
+
+void Hash::lockStripe(int stripe, unsigned char exclusive) {
+	// lock one stripe (or all of them if stripe is -1) for reading or writing
+	// all stripes are always locked in the same order, so whole hash operations cannot deadlock
+	int first = (stripe < 0) ? 0 : stripe;
+	int last = (stripe < 0) ? (MH_LOCK_STRIPES - 1) : stripe;
+	
+	for (int idx = first; idx <= last; idx++) {
+		if (exclusive) locks[idx].lock();
+		else locks[idx].lock_shared();
+	}
+}
+
+void Hash::unlockStripe(int stripe, unsigned char exclusive) {
+	// unlock one stripe (or all of them if stripe is -1)
+	int first = (stripe < 0) ? 0 : stripe;
+	int last = (stripe < 0) ? (MH_LOCK_STRIPES - 1) : stripe;
+	
+	for (int idx = last; idx >= first; idx--) {
+		if (exclusive) locks[idx].unlock();
+		else locks[idx].unlock_shared();
 	}
 }
 
@@ -339,21 +1562,18 @@ void Hash::clearTag(Tag *tag) {
 	if (tag->type == MH_SIG_INDEX) {
 		// traverse index
 		Index *level = (Index *)tag;
+		Tag *child;
 		
-		for (int idx = 0; idx < MH_INDEX_SIZE; idx++) {
-			if (level->data[idx]) {
-				clearTag( level->data[idx] );
-				level->data[idx] = NULL;
-			}
+		for (int ch = 0; (child = indexNext(level, &ch)); ch++) {
+			clearTag( child );
 		}
 		
 		// kill index
-		delete level;
-		stats->indexSize -= sizeof(Index);
+		freeIndex( level );
 	}
-	else if (tag->type == MH_SIG_BUCKET) {
-		// delete all buckets in list
-		Bucket *bucket = (Bucket *)tag;
+	else {
+		// delete all buckets in list (or group, whose buckets are linked the same way)
+		Bucket *bucket = leafList(tag);
 		Bucket *lastBucket;
 		
 		while (bucket) {
@@ -361,73 +1581,191 @@ void Hash::clearTag(Tag *tag) {
 			bucket = bucket->next;
 			
 			stats->dataSize -= (bucketGetKeyLength(lastBucket) + bucketGetContentLength(lastBucket));
-			stats->metaSize -= (sizeof(Bucket) + MH_KLEN_SIZE + MH_LEN_SIZE);
+			stats->metaSize -= bucketGetMetaSize(lastBucket);
 			stats->numKeys--;
+			countCompressed( lastBucket->type, bucketGetContent(lastBucket), bucketGetContentLength(lastBucket), 0 );
+			
+			arena->release( (void *)lastBucket, bucketGetSize(lastBucket) );
+		}
+		
+		if (tag->type == MH_SIG_GROUP) {
+			BucketGroup *group = (BucketGroup *)tag;
+			BucketGroup *next;
 			
-			free((void *)lastBucket);
+			for (; group; group = next) {
+				next = group->next;
+				freeGroup(group);
+			}
+		}
+	}
+}
+
+void Hash::scan(ScanStats *scanStats) {
+	// walk entire hash and gather structural stats (chain lengths, index depth)
+	// this is slow (visits every bucket), so only call it on demand
+	scanTag( scanStats, (Tag *)index, 1 );
+}
+
+void Hash::scanTag(ScanStats *scanStats, Tag *tag, uint64_t depth) {
+	// internal method: gather stats for one tag (index or bucket), recurse for nested indexes
+	if (tag->type == MH_SIG_INDEX) {
+		Index *level = (Index *)tag;
+		Tag *child;
+		if (depth > scanStats->maxDepth) scanStats->maxDepth = depth;
+		
+		for (int ch = 0; (child = indexNext(level, &ch)); ch++) {
+			scanTag( scanStats, child, depth + 1 );
 		}
 	}
+	else {
+		// a group counts as one chain
+		uint64_t chainLength = 0;
+		Bucket *bucket = leafList(tag);
+		
+		while (bucket) {
+			chainLength++;
+			bucket = bucket->next;
+		}
+		
+		scanStats->numChains++;
+		if (chainLength > scanStats->maxChainLength) scanStats->maxChainLength = chainLength;
+		scanStats->chainLengths[ MIN(chainLength, (uint64_t)(MH_LENGTH_SLOTS - 1)) ]++;
+		scanStats->keyDepths[ MIN(depth - 1, (uint64_t)MH_MAX_DEPTH) ] += chainLength;
+	}
 }
 
 Response Hash::firstKey() {
 	// return first key found (in undefined order)
 	unsigned char returnNext = 1;
-	unsigned char digest[MH_DIGEST_SIZE];
+	uint64_t digest = 0;
 	Response resp;
 	
-	for (int idx = 0; idx < MH_DIGEST_SIZE; idx++) {
-		digest[idx] = 0;
-	}
-	
-	traverseTag( &resp, (Tag *)index, NULL, 0, digest, 0, &returnNext );
+	traverseTag( &resp, (Tag *)index, NULL, 0, &digest, 0, &returnNext );
 	return resp;
 }
 
 Response Hash::nextKey(unsigned char *key, MH_KLEN_T keyLength) {
 	// return next key given previous key (in undefined order)
 	unsigned char returnNext = 0;
-	unsigned char digest[MH_DIGEST_SIZE];
 	Response resp;
 	
 	// first digest key
-	digestKey(key, keyLength, digest);
+	uint64_t digest = digestKey(key, keyLength);
 	
-	traverseTag( &resp, (Tag *)index, key, keyLength, digest, 0, &returnNext );
+	traverseTag( &resp, (Tag *)index, key, keyLength, &digest, 0, &returnNext );
 	return resp;
 }
 
-void Hash::traverseTag(Response *resp, Tag *tag, unsigned char *key, MH_KLEN_T keyLength, unsigned char *digest, unsigned char digestIndex, unsigned char *returnNext) {
+void Hash::cursorNext(Cursor *cursor, size_t maxKeys, std::vector<Bucket *> *buckets) {
+	// gather next batch of buckets for cursor, seeking from the root once per batch
+	// whole chains are taken at a time, so a batch may run a little over maxKeys
+	// keys present for the whole iteration are visited exactly once, even if the hash changes between batches
+	// keys added or removed in the meantime may or may not be visited
+	if (cursor->done) return;
+	if (cursor->started && (cursor->lastOrder == UINT64_MAX)) {
+		cursor->done = 1;
+		return;
+	}
+	
+	uint64_t lower = cursor->started ? (cursor->lastOrder + 1) : 0;
+	cursor->started = 1;
+	
+	if (!cursorTag( cursor, (Tag *)index, 0, lower, 1, maxKeys, buckets )) cursor->done = 1;
+}
+
+int Hash::cursorTag(Cursor *cursor, Tag *tag, unsigned char digestShift, uint64_t lower, unsigned char bounded, size_t maxKeys, std::vector<Bucket *> *buckets) {
 	// internal method
-	// traverse tag tree looking for key (or return next key found)
+	// gather whole chains starting at lower (only while bounded, i.e. still on the path to lower)
+	// returns 1 if the batch filled up, 0 if this tag was exhausted
 	if (tag->type == MH_SIG_INDEX) {
-		// traverse index
 		Index *level = (Index *)tag;
+		int numSlots = 1 << level->bits;
+		int first = bounded ? (int)((lower >> (64 - digestShift - level->bits)) & (numSlots - 1)) : 0;
+		Tag **slot;
+		Tag *child;
 		
-		for (int idx = digest[digestIndex]; idx < MH_INDEX_SIZE; idx++) {
-			if (level->data[idx]) {
-				traverseTag( resp, level->data[idx], key, keyLength, digest, digestIndex + 1, returnNext );
-				if (resp->result == MH_OK) idx = MH_INDEX_SIZE;
+		if ((level != index) && (level->bits == 8)) {
+			// widened level: slot is two 4-bit slices with the first one in the low nibble, so swap to walk in order
+			for (int ord = first; ord < numSlots; ord++) {
+				slot = indexFind( level, (unsigned char)(((ord & 0xF) << 4) | (ord >> 4)) );
+				if (!slot) continue;
+				if (cursorTag( cursor, slot[0], digestShift + 8, lower, bounded && (ord == first), maxKeys, buckets )) return 1;
 			}
 		}
+		else {
+			for (int ch = first; (child = indexNext(level, &ch)); ch++) {
+				if (cursorTag( cursor, child, digestShift + level->bits, lower, bounded && (ch == first), maxKeys, buckets )) return 1;
+			}
+		}
+		return 0;
+	}
+	else {
+		// every key in chain (or group) shares the first digestShift bits, so it covers one contiguous range of orders
+		Bucket *bucket = leafList(tag);
+		uint64_t below = (digestShift >= 64) ? 0 : (UINT64_MAX >> digestShift);
+		uint64_t chainEnd = (digestOrder(bucket->digest) & ~below) | below;
+		size_t start = buckets->size();
+		
+		while (bucket) {
+			// while bounded, skip keys before lower (the rest of a chain split by the last batch)
+			if (!bounded || (digestOrder(bucket->digest) >= lower)) buckets->push_back( bucket );
+			bucket = bucket->next;
+		}
+		
+		if (buckets->size() <= maxKeys) {
+			// whole chain fits
+			cursor->lastOrder = chainEnd;
+			return (buckets->size() == maxKeys) ? 1 : 0;
+		}
+		
+		// chain overflows batch, so sort it into order and cut it, but never between equal digests
+		std::sort( buckets->begin() + start, buckets->end(), [this](Bucket *a, Bucket *b) {
+			return digestOrder(a->digest) < digestOrder(b->digest);
+		} );
+		
+		size_t cut = maxKeys;
+		while ((cut < buckets->size()) && ((*buckets)[cut]->digest == (*buckets)[cut - 1]->digest)) cut++;
+		buckets->resize( cut );
+		
+		cursor->lastOrder = digestOrder( (*buckets)[cut - 1]->digest );
+		return 1;
 	}
-	else if (tag->type == MH_SIG_BUCKET) {
-		// traverse bucket list
-		Bucket *bucket = (Bucket *)tag;
+}
+
+void Hash::traverseTag(Response *resp, Tag *tag, unsigned char *key, MH_KLEN_T keyLength, uint64_t *digest, unsigned char digestShift, unsigned char *returnNext) {
+	// internal method
+	// traverse tag tree looking for key (or return next key found)
+	if (tag->type == MH_SIG_INDEX) {
+		// traverse index, in key order
+		Index *level = (Index *)tag;
+		Tag *child;
+		
+		for (int ch = digestSlice(digest[0], digestShift, level->bits); (child = indexNext(level, &ch)); ch++) {
+			traverseTag( resp, child, key, keyLength, digest, digestShift + level->bits, returnNext );
+			if (resp->result == MH_OK) break;
+		}
+	}
+	else {
+		// traverse bucket list (or group, whose buckets are linked the same way)
+		Bucket *bucket = leafList(tag);
+		uint64_t now = nowMS();
 		
 		while (bucket) {
 			if (returnNext[0]) {
-				// return whatever key we landed on (repurpose the response content for this)
-				resp->result = MH_OK;
-				resp->content = bucketGetKey(bucket);
-				resp->contentLength = bucketGetKeyLength(bucket);
-				bucket = NULL; // break;
+				// return whatever key we landed on, skipping expired ones (repurpose the response content for this)
+				if (!bucketExpired(bucket, now)) {
+					resp->result = MH_OK;
+					resp->content = bucketGetKey(bucket);
+					resp->contentLength = bucketGetKeyLength(bucket);
+					bucket = NULL; // break;
+				}
 			}
-			else if (bucketKeyEquals(bucket, key, keyLength)) {
+			else if (bucketKeyEquals(bucket, key, keyLength, digest[0])) {
 				// found target key, return next one
 				returnNext[0] = 1;
 				
 				// clear all digest bits so next index ierations begin at zero
-				((uint64_t *)digest)[0] = 0;
+				digest[0] = 0;
 			}
 			if (bucket) bucket = bucket->next;
 		}
@@ -2,9 +2,39 @@
 // Copyright (c) 2019 Joseph Huckaby
 // Based on DeepHash, (c) 2003 Joseph Huckaby
 
+#ifndef MH_MEGAHASH_H
+#define MH_MEGAHASH_H
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <string.h>
+#include <atomic>
+#include <shared_mutex>
+#include <mutex>
+#include <vector>
+#include <chrono>
+#include <string>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#if !defined(MH_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2)))
+#include <emmintrin.h>
+/** Match group control bytes with SSE2 (define MH_NO_SIMD to force the scalar loop). */
+#define MH_GROUP_SSE2 1
+#endif
+#if defined(__GNUC__) || defined(__clang__)
+/** Hint that memory at ptr is about to be read, so it can be brought into cache meanwhile (see fetchBatch). */
+#define MH_PREFETCH(ptr) __builtin_prefetch( (const void *)(ptr) )
+#elif defined(_MSC_VER)
+#define MH_PREFETCH(ptr) _mm_prefetch( (const char *)(ptr), _MM_HINT_T0 )
+#else
+#define MH_PREFETCH(ptr)
+#endif
+
+#include "wyhash.h"
+#include "Arena.h"
+#include "Compress.h"
 
 #define MIN(a,b) (((a)<(b))?(a):(b))
 #define MAX(a,b) (((a)>(b))?(a):(b))
@@ -18,11 +48,16 @@
 #define MH_KLEN_SIZE sizeof(MH_KLEN_T)
 #define MH_LEN_SIZE sizeof(MH_LEN_T)
 
-/** Size of one hashed key, in bytes. */
-#define MH_DIGEST_SIZE 8
+/** Max size of one hashed key, in bits. */
+#define MH_DIGEST_BITS 64
+
+/** Max number of slots in one index level (one per 8-bit slice). */
+#define MH_INDEX_SIZE 256
 
-/** Size of one index level. */
-#define MH_INDEX_SIZE 16
+/** Number of lock stripes in concurrent mode (one per main index slot). */
+#define MH_LOCK_STRIPES MH_INDEX_SIZE
+/** Most index levels a key can pass through (one 8-bit main level, then 4-bit levels). */
+#define MH_MAX_DEPTH (1 + ((MH_DIGEST_BITS - 8) / 4))
 
 /** \name Result codes after pair is stored or fetched:
 	These all go into the result property of the Response object. */
@@ -37,27 +72,284 @@
 #define MH_REPLACE 2
 //@}
 
+/** \name Hash algorithms used to digest keys: */
+//@{
+/** 32-bit DJB2 (default). */
+#define MH_HASH_DJB2 0
+/** 64-bit wyhash. */
+#define MH_HASH_WYHASH 1
+//@}
+
+/** \name Index kinds (adaptive fanout, grows with number of used slots): */
+//@{
+/** Up to 4 slots, sorted keys. */
+#define MH_INDEX_4 0
+/** Up to 16 slots, sorted keys (8-bit levels only). */
+#define MH_INDEX_16 1
+/** Up to 48 slots, with 256 byte slot map. */
+#define MH_INDEX_48 2
+/** All 256 slots, direct lookup. */
+#define MH_INDEX_256 3
+/** All 16 slots, direct lookup (4-bit levels only). */
+#define MH_INDEX_16D 4
+//@}
+
+/** \name Engines, which decide how the keys under one index slot are kept (see setEngine): */
+//@{
+/** Linked list of buckets, reindexed into a new level once it grows past maxBuckets (default). */
+#define MH_ENGINE_CHAIN 0
+/** Swiss table style group of buckets with a control byte each, matched all at once (see BucketGroup). */
+#define MH_ENGINE_SWISS 1
+/** Most buckets per group, which is also the number of control bytes matched at once. */
+#define MH_GROUP_SIZE 16
+/** Buckets room is made for in a new group, until it grows to MH_GROUP_SIZE (so groups left sparse by a split stay small). */
+#define MH_GROUP_MIN 4
+/** Control byte of an unused group position (key control bytes only have 7 bits, so never match it). */
+#define MH_CTRL_EMPTY 0x80
+//@}
+
+/** Lookups fetchBatch keeps in flight at once, so their cache misses overlap instead of being waited on one by one. */
+#define MH_BATCH_WIDTH 16
+
+/** \name Bucket flags (these share the bucket type byte with MH_SIG_BUCKET): */
+//@{
+/** Set when an expiry time (ms since epoch) follows the bucket header. */
+#define MH_FLAG_EXPIRES 0x80
+/** CLOCK reference bit, set when key is accessed in memory-bounded mode (see evict). */
+#define MH_FLAG_REFERENCED 0x40
+/** Set when the value is stored compressed (see setCompression).  This is returned with values, until expanded. */
+#define MH_FLAG_COMPRESSED 0x10
+/** Bits available for value flags (the data type from main.js), which are returned with values. */
+#define MH_FLAGS_VALUE 0x0F
+/** Size of expiry time, when present. */
+#define MH_EXPIRES_SIZE sizeof(uint64_t)
+//@}
+
+/** \name Snapshot file format (see Snapshot.cpp): */
+//@{
+/** Magic bytes at start of snapshot file. */
+#define MH_SNAP_MAGIC "MEGAHASH"
+/** Snapshot format version (2 added expiry times, 3 added compressed values, and older files still load). */
+#define MH_SNAP_VERSION 3
+/** Size of file header, and of each slot group header. */
+#define MH_SNAP_HEADER_SIZE 40
+#define MH_SNAP_GROUP_SIZE 32
+//@}
+
+/** Number of keys the eviction hand looks at per step (see evict). */
+#define MH_EVICT_BATCH 16
+
+/** Fewest records per thread in a bulk store (see storeMany), as smaller batches are faster on one thread. */
+#define MH_BULK_THREAD_MIN 4096
+
+/** \name Instrumentation (see setInstrument and scan): */
+//@{
+/** Operations with latency histograms. */
+#define MH_OP_FETCH 0
+#define MH_OP_STORE 1
+#define MH_OP_REMOVE 2
+#define MH_OP_COUNT 3
+/** Each thread times one in this many operations (power of 2). */
+#define MH_LATENCY_SAMPLE 64
+/** Latency histogram slots, 4 per power of 2 nanoseconds (so within 25%), up to about 2^41 ns. */
+#define MH_LATENCY_SLOTS 160
+/** Length histograms count lengths 0 to N - 2 exactly, and anything longer in the last slot. */
+#define MH_LENGTH_SLOTS 33
+//@}
+
 /** \name Signatures used to identify tags: */
 //@{
 /** Signature used for identifying index tags. */
 #define MH_SIG_INDEX 'I'
-/** Signature used for identifying bucket tags. */
-#define MH_SIG_BUCKET 'B'
+/** Bit used for identifying bucket tags (the rest of the type byte holds the bucket flags, and 'I' never has it). */
+#define MH_SIG_BUCKET 0x20
+/** Signature used for identifying bucket group tags (swiss engine only, and also never has MH_SIG_BUCKET). */
+#define MH_SIG_GROUP 'G'
 //@}
 
 class Stats {
 public:
 	// current stats about the hash table
-	uint64_t numKeys;
-	uint64_t indexSize;
-	uint64_t metaSize;
-	uint64_t dataSize;
+	// these are atomic, as stripes update them concurrently in concurrent mode
+	std::atomic<uint64_t> numKeys;
+	std::atomic<uint64_t> numIndexes;
+	std::atomic<uint64_t> indexSize;
+	std::atomic<uint64_t> metaSize;
+	std::atomic<uint64_t> dataSize;
+	std::atomic<uint64_t> numEvictions; /**< Keys evicted to stay under maxBytes (never reset by clear). */
+	std::atomic<uint64_t> evictedBytes;
+	std::atomic<uint64_t> compressedSize; /**< Stored size of compressed values (included in dataSize). */
+	std::atomic<uint64_t> rawSize; /**< Original size of the same values. */
+	std::atomic<uint64_t> numReindexes; /**< Lists split into new index levels (never reset by clear). */
+	std::atomic<uint64_t> reindexedKeys; /**< Keys moved by those splits. */
+	std::atomic<uint64_t> numWidens; /**< Full 4-bit levels merged into 8-bit levels (see indexWiden). */
 	
 	Stats() {
 		numKeys = 0;
+		numIndexes = 0;
 		indexSize = 0;
 		metaSize = 0;
 		dataSize = 0;
+		numEvictions = 0;
+		evictedBytes = 0;
+		compressedSize = 0;
+		rawSize = 0;
+		numReindexes = 0;
+		reindexedKeys = 0;
+		numWidens = 0;
+	}
+};
+
+class Instrument {
+public:
+	// hot path counters, only kept while turned on (see setInstrument)
+	// relaxed atomics, so threads in concurrent mode never wait on each other here
+	std::atomic<uint64_t> hits; /**< Fetches that found the key. */
+	std::atomic<uint64_t> misses;
+	std::atomic<uint64_t> levels; /**< Index levels passed through by all fetches. */
+	std::atomic<uint64_t> probes; /**< Keys compared by all fetches. */
+	std::atomic<uint64_t> probeLengths[ MH_LENGTH_SLOTS ]; /**< Fetches by number of keys compared. */
+	std::atomic<uint64_t> latency[ MH_OP_COUNT ][ MH_LATENCY_SLOTS ]; /**< Sampled operations by time taken (see latencySlot). */
+	
+	Instrument() {
+		hits = 0;
+		misses = 0;
+		levels = 0;
+		probes = 0;
+		for (int idx = 0; idx < MH_LENGTH_SLOTS; idx++) probeLengths[idx] = 0;
+		for (int op = 0; op < MH_OP_COUNT; op++) {
+			for (int idx = 0; idx < MH_LATENCY_SLOTS; idx++) latency[op][idx] = 0;
+		}
+	}
+	
+	void lookup(int found, uint64_t numLevels, uint64_t numProbes) {
+		// count one fetch
+		(found ? hits : misses).fetch_add( 1, std::memory_order_relaxed );
+		levels.fetch_add( numLevels, std::memory_order_relaxed );
+		probes.fetch_add( numProbes, std::memory_order_relaxed );
+		probeLengths[ MIN(numProbes, (uint64_t)(MH_LENGTH_SLOTS - 1)) ].fetch_add( 1, std::memory_order_relaxed );
+	}
+	
+	static int latencySlot(uint64_t nanos) {
+		// histogram slot for time taken: 4 slots per power of 2, picked by the 2 bits below the top one
+		if (nanos < 8) return (int)nanos / 2;
+		int bits = 3;
+		while (nanos >> (bits + 1)) bits++;
+		int slot = ((bits - 2) * 4) + (int)((nanos >> (bits - 2)) & 3);
+		return MIN( slot, MH_LATENCY_SLOTS - 1 );
+	}
+	
+	static uint64_t latencyUpper(int slot) {
+		// largest time (ns) counted in histogram slot
+		if (slot < 4) return (uint64_t)(slot * 2) + 1;
+		int bits = (slot / 4) + 2;
+		return ((uint64_t)(4 + (slot % 4) + 1) << (bits - 2)) - 1;
+	}
+};
+
+class OpTimer {
+public:
+	// times one operation for the latency histograms, if instrumented and this one is sampled
+	// only the outermost operation on a thread counts (e.g. removes done by evict are part of the store)
+	static thread_local uint32_t tick;
+	static thread_local int depth;
+	Instrument *instrument; /**< Set if this operation is being timed. */
+	unsigned char active;
+	int op;
+	std::chrono::steady_clock::time_point start;
+	
+	OpTimer(Instrument *newInstrument, int newOp) {
+		instrument = NULL;
+		active = newInstrument ? 1 : 0;
+		op = newOp;
+		if (!active) return;
+		
+		if (!depth++ && !(++tick & (MH_LATENCY_SAMPLE - 1))) {
+			instrument = newInstrument;
+			start = std::chrono::steady_clock::now();
+		}
+	}
+	
+	~OpTimer() {
+		if (!active) return;
+		depth--;
+		if (!instrument) return;
+		
+		uint64_t nanos = (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+		instrument->latency[op][ Instrument::latencySlot(nanos) ].fetch_add( 1, std::memory_order_relaxed );
+	}
+};
+
+class ScanStats {
+public:
+	// structural stats gathered by walking the entire hash (slow)
+	uint64_t numChains;
+	uint64_t maxChainLength;
+	uint64_t maxDepth;
+	uint64_t chainLengths[ MH_LENGTH_SLOTS ]; /**< Chains by number of keys. */
+	uint64_t keyDepths[ MH_MAX_DEPTH + 1 ]; /**< Keys by number of index levels above them. */
+	
+	ScanStats() {
+		numChains = 0;
+		maxChainLength = 0;
+		maxDepth = 0;
+		memset( (void *)chainLengths, 0, sizeof(chainLengths) );
+		memset( (void *)keyDepths, 0, sizeof(keyDepths) );
+	}
+};
+
+class Cursor {
+public:
+	// position of an iteration over the whole hash, which stays valid while the hash changes between batches
+	// keys are visited in digest order (see digestOrder), and every key at or below lastOrder has been visited
+	uint64_t lastOrder;
+	unsigned char started;
+	unsigned char done;
+	
+	Cursor() {
+		lastOrder = 0;
+		started = 0;
+		done = 0;
+	}
+};
+
+class SnapshotGroup {
+public:
+	// one group of records in a snapshot file, holding all keys under one main index slot
+	uint32_t slot;
+	uint32_t dictId; /**< Dictionary needed to decompress values in the group (0 if none, see Compressor). */
+	uint64_t numRecords;
+	uint64_t length; /**< Bytes of records following group header. */
+	uint64_t checksum; /**< Chained wyhash over all records (see snapshotChecksum). */
+	uint64_t offset; /**< Position of records in file (only used when loading). */
+	
+	SnapshotGroup() {
+		slot = 0;
+		dictId = 0;
+		numRecords = 0;
+		length = 0;
+		checksum = 0;
+		offset = 0;
+	}
+};
+
+class BulkRecord {
+public:
+	// one key/value pair for storeMany (bytes are not copied until stored)
+	unsigned char *key;
+	MH_KLEN_T keyLength;
+	unsigned char *content;
+	MH_LEN_T contentLength;
+	unsigned char flags;
+	uint64_t expires; /**< Time in ms since epoch, or 0 for never. */
+	
+	BulkRecord() {
+		key = NULL;
+		keyLength = 0;
+		content = NULL;
+		contentLength = 0;
+		flags = 0;
+		expires = 0;
 	}
 };
 
@@ -77,6 +369,28 @@ public:
 	}
 };
 
+class Modifier {
+public:
+	// one read-modify-write step for Hash::modify, subclassed for each kind of update
+	// apply() is called with the current value (current.result is MH_ERR if the key is missing or expired),
+	// and sets value, flags and expires for the new one, returning 1 to store it or 0 to leave the key alone
+	Response current; /**< Always expanded, and valid until the key is next modified. */
+	std::string expanded; /**< Holds current value if it was stored compressed. */
+	std::string value;
+	unsigned char flags;
+	uint64_t expires; /**< Starts as the current expiry time (0 for none), so it is kept unless changed. */
+	unsigned char stored; /**< Set by Hash::modify if apply() returned 1 (MH_ADD and MH_OK are the same code). */
+	
+	Modifier() {
+		flags = 0;
+		expires = 0;
+		stored = 0;
+	}
+	virtual ~Modifier() {}
+	
+	virtual int apply() = 0;
+};
+
 #pragma pack(push)  /* push current alignment to stack */
 #pragma pack(1)     /* set alignment to 1 byte boundary, saves 6 bytes per index/bucket */
 
@@ -88,27 +402,58 @@ public:
 
 class Index : public Tag {
 public:
-	// an index represents 4 bits of the key hash, and has 16 slots
+	// an index represents 4 or 8 bits of the key hash, and has up to 16 or 256 slots
 	// each slot may point to another index, or a bucket linked list
+	// the actual slot storage depends on the kind (see subclasses below),
+	// so sparse levels stay small and dense levels stay fast
+	unsigned char kind;
+	unsigned char bits; /**< Number of digest bits used by this level (4 or 8). */
+	uint16_t count; /**< Number of slots in use. */
+};
+
+class Index4 : public Index {
+public:
+	// sparse index: up to 4 slots, keys kept sorted
+	unsigned char keys[4];
+	Tag *data[4];
+};
+
+class Index16 : public Index {
+public:
+	// sparse index: up to 16 slots, keys kept sorted
+	unsigned char keys[16];
+	Tag *data[16];
+};
+
+class Index48 : public Index {
+public:
+	// medium index: 256 byte map of key to slot position (plus one), 48 slots
+	unsigned char slots[MH_INDEX_SIZE];
+	Tag *data[48];
+};
+
+class Index256 : public Index {
+public:
+	// dense index: direct lookup on all 256 keys
 	Tag *data[MH_INDEX_SIZE];
-	
-	Index() {
-		init();
-	}
-	
-	void init() {
-		type = MH_SIG_INDEX;
-		for (int idx = 0; idx < MH_INDEX_SIZE; idx++) data[idx] = NULL;
-	}
+};
+
+class Index16D : public Index {
+public:
+	// dense 4-bit index: direct lookup on all 16 keys
+	Tag *data[16];
 };
 
 class Bucket : public Tag {
 public:
 	// a bucket represents one key/value pair in the hash table
 	// this is also a linked list, for collisions
-	// currently this is 24 bytes
-	unsigned char flags;
+	// the full key digest is kept so chain walks can skip non-matching keys
+	// without touching the key bytes, and reindexing never has to rehash
+	// the flags live in the type byte alongside MH_SIG_BUCKET, and the key and value
+	// follow the header with varint lengths, so small pairs carry very little overhead
 	Bucket *next;
+	uint64_t digest;
 	
 	Bucket() {
 		init();
@@ -116,25 +461,64 @@ public:
 	
 	void init() {
 		type = MH_SIG_BUCKET;
-		flags = 0;
 		next = NULL;
+		digest = 0;
 	}
 };
 
+class BucketGroup : public Tag {
+public:
+	// a group holds the keys under one index slot in the swiss engine, in place of a bucket list
+	// each position has a control byte with 7 digest bits (the ones the index levels reach last),
+	// so a lookup matches all of them at once and only compares keys where they match (see groupMatch)
+	// buckets stay out of line, and are still linked in position order (on into overflow groups),
+	// so everything that visits whole lists (cursors, scans, snapshots) sees an ordinary bucket list
+	unsigned char count;
+	unsigned char capacity; /**< MH_GROUP_MIN or MH_GROUP_SIZE, and only that many bucket pointers are allocated (see groupSizeOf). */
+	unsigned char ctrl[ MH_GROUP_SIZE ];
+	BucketGroup *next; /**< Overflow group, only used once the digest has no bits left to split on. */
+	Bucket *buckets[ MH_GROUP_SIZE ];
+};
+
 #pragma pack(pop)   /* restore original alignment from stack */
 
+class BatchLookup {
+public:
+	// one lookup in flight in fetchBatch, taken one memory access further each round
+	size_t idx; /**< Position in batch. */
+	uint64_t digest;
+	Tag *tag; /**< Index, group or bucket to visit next, already prefetched. */
+	Bucket *bucket; /**< Bucket found, once done (NULL if not found). */
+	uint32_t matches; /**< Group positions whose buckets were prefetched for comparing next round, or 0 to match tag first. */
+	unsigned char digestShift;
+	uint64_t levels;
+	uint64_t probes;
+};
+
 class Hash {
 public:
 	// main hash table object
 	// starts with one 8-bit index (auto-expands)
 	Index *index;
 	Stats *stats;
+	Arena *arena;
+	std::shared_timed_mutex *locks; /**< One per main index slot, only allocated in concurrent mode. */
+	Cursor sweepCursor; /**< Where the next sweep() picks up. */
+	Cursor clockHand; /**< Where the next eviction picks up. */
+	std::mutex evictLock; /**< Serializes eviction in concurrent mode (guards clockHand). */
+	Compressor *compressor; /**< Value compression, or NULL if off (see setCompression). */
+	Instrument *instrument; /**< Hot path counters and latency histograms, or NULL if off (see setInstrument). */
+	uint64_t maxBytes; /**< Memory limit for index, meta and data sizes combined, or 0 for unbounded. */
 	unsigned char maxBuckets;
 	unsigned char reindexScatter;
+	unsigned char hashType;
+	unsigned char digestBits;
+	unsigned char engine; /**< How keys under one index slot are kept (see setEngine). */
 	
 	Hash() {
 		maxBuckets = 16;
 		reindexScatter = 1;
+		setHashType( MH_HASH_DJB2 );
 		init();
 	}
 	
@@ -142,10 +526,11 @@ public:
 		maxBuckets = newMaxBuckets;
 		if (maxBuckets < 1) maxBuckets = 1;
 		reindexScatter = 1;
+		setHashType( MH_HASH_DJB2 );
 		init();
 	}
 	
-	Hash(unsigned char newMaxBuckets, unsigned char newReindexScatter) {
+	Hash(unsigned char newMaxBuckets, unsigned char newReindexScatter, unsigned char newHashType = MH_HASH_DJB2) {
 		maxBuckets = newMaxBuckets;
 		if (maxBuckets < 1) maxBuckets = 1;
 		
@@ -153,86 +538,399 @@ public:
 		if (reindexScatter < 1) reindexScatter = 1;
 		if ((int)maxBuckets + (int)reindexScatter > 256) reindexScatter = 1;
 		
+		setHashType( newHashType );
 		init();
 	}
 	
 	~Hash() {
-		clear();
+		// all buckets and indexes live in the arena, so this releases everything
+		delete arena;
+		delete stats;
+		if (locks) delete [] locks;
+		if (compressor) delete compressor;
+		if (instrument) delete instrument;
 	}
 	
 	void init() {
-		index = new Index();
+		engine = MH_ENGINE_CHAIN;
+		arena = new Arena();
 		stats = new Stats();
-		stats->indexSize += sizeof(Index);
+		locks = NULL;
+		compressor = NULL;
+		instrument = NULL;
+		maxBytes = 0;
+		initIndex();
+	}
+	
+	void setConcurrent() {
+		// allow hash to be used from multiple threads, via HashGuard
+		// (must be called before the hash is shared)
+		if (locks) return;
+		arena->setConcurrent();
+		locks = new std::shared_timed_mutex[ MH_LOCK_STRIPES ];
+	}
+	
+	void setMaxBytes(uint64_t newMaxBytes) {
+		// bound memory usage, evicting keys on store once the limit is reached (0 = unbounded)
+		// (must be called before the hash is shared)
+		maxBytes = newMaxBytes;
+	}
+	
+	void setCompression(uint32_t minLength, const unsigned char *dict = NULL, size_t dictLength = 0) {
+		// compress values of at least minLength bytes, optionally with a shared dictionary
+		// (must be called before the hash is shared, and values stored with a dictionary need the same one to be read)
+		if (compressor) delete compressor;
+		compressor = new Compressor( minLength, dict, dictLength );
+	}
+	
+	void setInstrument() {
+		// count hits, misses and probes for every fetch, and time a sample of fetches, stores and removes
+		// (must be called before the hash is shared, costs a few percent on small operations)
+		if (!instrument) instrument = new Instrument();
+	}
+	
+	uint64_t bytesUsed() {
+		// memory counted against maxBytes
+		return stats->indexSize + stats->metaSize + stats->dataSize;
+	}
+	
+	void initIndex() {
+		// allocate main index from arena (always dense, 8 bits)
+		index = newIndex( MH_INDEX_SIZE, 8 );
+	}
+	
+	void setHashType(unsigned char newHashType) {
+		// select digest algorithm, which also determines max index depth
+		// (must be called before any keys are stored)
+		hashType = (newHashType == MH_HASH_WYHASH) ? MH_HASH_WYHASH : MH_HASH_DJB2;
+		digestBits = (hashType == MH_HASH_WYHASH) ? MH_DIGEST_BITS : 32;
+	}
+	
+	void setEngine(unsigned char newEngine) {
+		// select how keys under one index slot are kept: bucket lists, or swiss table style groups
+		// groups are a fixed size, so they replace the maxBuckets and reindexScatter settings
+		// (must be called before any keys are stored)
+		engine = (newEngine == MH_ENGINE_SWISS) ? MH_ENGINE_SWISS : MH_ENGINE_CHAIN;
+		if (engine == MH_ENGINE_SWISS) {
+			maxBuckets = MH_GROUP_SIZE;
+			reindexScatter = 1;
+		}
 	}
 	
 	// public methods:
-	Response store(unsigned char *key, MH_KLEN_T keyLength, unsigned char *content, MH_LEN_T contentLength, unsigned char flags = 0);
+	Response store(unsigned char *key, MH_KLEN_T keyLength, unsigned char *content, MH_LEN_T contentLength, unsigned char flags = 0, uint64_t expires = 0);
+	void storeMany(BulkRecord *records, size_t count, unsigned char *results, unsigned int numThreads);
 	Response fetch(unsigned char *key, MH_KLEN_T keyLength);
+	void fetchBatch(BulkRecord *records, size_t count, Response *results);
+	Response modify(unsigned char *key, MH_KLEN_T keyLength, Modifier *modifier);
+	MH_LEN_T valueLength(Response *resp);
+	int valueCopy(Response *resp, unsigned char *dest);
+	int expand(Response *resp, std::string *out);
 	Response remove(unsigned char *key, MH_KLEN_T keyLength);
 	Response firstKey();
 	Response nextKey(unsigned char *key, MH_KLEN_T keyLength);
+	void cursorNext(Cursor *cursor, size_t maxKeys, std::vector<Bucket *> *buckets);
 	
 	void clear();
 	void clear(unsigned char slice);
+	void compact(unsigned char slice);
+	uint64_t sweep(size_t maxWork);
+	uint64_t evict(uint64_t bytesNeeded, int ownStripe);
+	void scan(ScanStats *scanStats);
+	
+	void lockStripe(int stripe, unsigned char exclusive);
+	void unlockStripe(int stripe, unsigned char exclusive);
+	
+	const char *save(const char *path);
+	const char *load(const char *path, unsigned int numThreads);
 	
 	// internal methods:
+	Response storeWithDigest(unsigned char *key, MH_KLEN_T keyLength, unsigned char *content, MH_LEN_T contentLength, unsigned char flags, uint64_t digest, uint64_t expires);
+	Response storeDigest(unsigned char *key, MH_KLEN_T keyLength, unsigned char *content, MH_LEN_T contentLength, unsigned char flags, uint64_t digest, uint64_t expires = 0);
+	int makeRoom(MH_KLEN_T keyLength, MH_LEN_T contentLength, uint64_t expires, uint64_t digest);
+	Bucket *findBucket(unsigned char *key, MH_KLEN_T keyLength, uint64_t digest, uint64_t *numLevels = NULL, uint64_t *numProbes = NULL);
+	int batchStep(BatchLookup *look, BulkRecord *record);
+	Bucket *bucketReplace(Bucket *bucket, unsigned char *key, MH_KLEN_T keyLength, unsigned char *content, MH_LEN_T contentLength, unsigned char flags, uint64_t digest, uint64_t expires);
+	void bucketRewrite(Bucket *bucket, MH_KLEN_T keyLength, unsigned char *content, MH_LEN_T contentLength, unsigned char flags, uint64_t expires);
+	void saveTag(FILE *fh, Tag *tag, SnapshotGroup *group, uint64_t now);
+	const char *loadGroup(unsigned char *data, SnapshotGroup *group);
 	void clearTag(Tag *tag);
-	void reindexBucket(Bucket *bucket, Index *index, unsigned char digestIndex);
-	void traverseTag(Response *resp, Tag *tag, unsigned char *key, MH_KLEN_T keyLength, unsigned char *digest, unsigned char digestIndex, unsigned char *returnNext);
-	
-	int bucketKeyEquals(Bucket *bucket, unsigned char *key, MH_KLEN_T keyLength) {
-		// compare key to bucket key
-		unsigned char *bucketData = ((unsigned char *)bucket) + sizeof(Bucket);
-		if (keyLength != ((MH_KLEN_T *)bucketData)[0]) return 0;
-		unsigned char *bucketKey = bucketData + MH_KLEN_SIZE;
+	void scanTag(ScanStats *scanStats, Tag *tag, uint64_t depth);
+	Bucket *newBucketFor(unsigned char *key, MH_KLEN_T keyLength, unsigned char *content, MH_LEN_T contentLength, unsigned char flags, uint64_t digest, uint64_t expires);
+	void reindexBucket(Bucket *bucket, Tag **levelRef, unsigned char digestShift);
+	Index *newIndex(unsigned int numSlots, unsigned char bits);
+	void freeIndex(Index *level);
+	Tag **indexFind(Index *level, unsigned char ch);
+	Tag **indexInsert(Tag **levelRef, unsigned char ch);
+	Index *indexGrow(Tag **levelRef);
+	Index *indexResize(Tag **levelRef, unsigned int numSlots);
+	int indexCollapse(Tag **levelRef, unsigned int maxMerge);
+	void compactTag(Tag **levelRef, unsigned int maxMerge);
+	void indexRemove(Index *level, unsigned char ch);
+	Tag *indexNext(Index *level, int *ch);
+	void indexWiden(Tag **levelRef);
+	BucketGroup *newGroup(unsigned char capacity);
+	BucketGroup *groupGrow(BucketGroup *group);
+	void freeGroup(BucketGroup *group);
+	int groupFind(BucketGroup **groupRef, unsigned char *key, MH_KLEN_T keyLength, uint64_t digest, uint64_t *numProbes);
+	int groupAppend(Tag **leafRef, Bucket *bucket);
+	void groupReplace(Tag *leaf, BucketGroup *group, int pos, Bucket *bucket);
+	void groupRemove(Tag **leafRef, BucketGroup *group, int pos);
+	Bucket *groupPrev(BucketGroup *first, BucketGroup *group, int pos);
+	int groupSplit(Tag **slot, unsigned char digestShift);
+	unsigned int countSlices(Bucket *bucket, unsigned char digestShift, unsigned char bits);
+	void traverseTag(Response *resp, Tag *tag, unsigned char *key, MH_KLEN_T keyLength, uint64_t *digest, unsigned char digestShift, unsigned char *returnNext);
+	int cursorTag(Cursor *cursor, Tag *tag, unsigned char digestShift, uint64_t lower, unsigned char bounded, size_t maxKeys, std::vector<Bucket *> *buckets);
+	
+	int bucketKeyEquals(Bucket *bucket, unsigned char *key, MH_KLEN_T keyLength, uint64_t digest) {
+		// compare key to bucket key, checking digest first (cheap reject)
+		if (bucket->digest != digest) return 0;
+		uint32_t bucketKeyLength;
+		unsigned char *bucketKey = varintGet( bucketGetData(bucket), &bucketKeyLength );
+		if (keyLength != bucketKeyLength) return 0;
 		return (int)!memcmp( (void *)key, (void *)bucketKey, (size_t)keyLength );
 	}
 	
+	Bucket *leafList(Tag *tag) {
+		// first bucket under an index slot: the list itself, or the first one in its group (which is never empty)
+		return (tag->type == MH_SIG_GROUP) ? ((BucketGroup *)tag)->buckets[0] : (Bucket *)tag;
+	}
+	
+	static size_t groupSizeOf(unsigned char capacity) {
+		// allocated size of group with room for capacity buckets
+		return sizeof(BucketGroup) - ((MH_GROUP_SIZE - capacity) * sizeof(Bucket *));
+	}
+	
+	unsigned char groupControl(uint64_t digest) {
+		// control byte for key in group: the top 7 digest bits, which index levels only reach when the digest runs out
+		return (unsigned char)((digest >> (digestBits - 7)) & 0x7F);
+	}
+	
+	static uint32_t groupMatch(BucketGroup *group, unsigned char control) {
+		// bit mask of group positions whose control byte matches (unused positions never do)
+#ifdef MH_GROUP_SSE2
+		__m128i ctrl = _mm_loadu_si128( (const __m128i *)group->ctrl );
+		return (uint32_t)_mm_movemask_epi8( _mm_cmpeq_epi8(ctrl, _mm_set1_epi8((char)control)) );
+#else
+		uint32_t matches = 0;
+		for (int pos = 0; pos < MH_GROUP_SIZE; pos++) {
+			if (group->ctrl[pos] == control) matches |= (1 << pos);
+		}
+		return matches;
+#endif
+	}
+	
+	static int lowestBit(uint32_t mask) {
+		// position of lowest set bit (mask must not be 0)
+#ifdef _MSC_VER
+		unsigned long bit;
+		_BitScanForward( &bit, mask );
+		return (int)bit;
+#else
+		return __builtin_ctz(mask);
+#endif
+	}
+	
+	unsigned char *bucketGetData(Bucket *bucket) {
+		// get pointer to bucket key length, which follows the header (and expiry time, if any)
+		return ((unsigned char *)bucket) + sizeof(Bucket) + ((bucket->type & MH_FLAG_EXPIRES) ? MH_EXPIRES_SIZE : 0);
+	}
+	
+	uint64_t bucketGetExpires(Bucket *bucket) {
+		// get bucket expiry time in ms since epoch, or 0 if it never expires
+		uint64_t expires = 0;
+		if (bucket->type & MH_FLAG_EXPIRES) memcpy( (void *)&expires, (void *)(((unsigned char *)bucket) + sizeof(Bucket)), MH_EXPIRES_SIZE );
+		return expires;
+	}
+	
+	int bucketExpired(Bucket *bucket, uint64_t now) {
+		// check if bucket has expired (now is ms since epoch, see nowMS)
+		return (bucket->type & MH_FLAG_EXPIRES) && (bucketGetExpires(bucket) <= now);
+	}
+	
+	void bucketTouch(Bucket *bucket) {
+		// set CLOCK reference bit on access (see evict)
+		// readers may share a stripe in concurrent mode, and this is the only bucket write made under a shared lock
+		if (bucket->type & MH_FLAG_REFERENCED) return;
+#ifdef _MSC_VER
+		_InterlockedOr8( (char *)&bucket->type, (char)MH_FLAG_REFERENCED );
+#else
+		__atomic_fetch_or( &bucket->type, (unsigned char)MH_FLAG_REFERENCED, __ATOMIC_RELAXED );
+#endif
+	}
+	
 	MH_KLEN_T bucketGetKeyLength(Bucket *bucket) {
 		// get bucket key length
-		unsigned char *bucketData = ((unsigned char *)bucket) + sizeof(Bucket);
-		MH_KLEN_T *tempKL = (MH_KLEN_T *)bucketData;
-		return tempKL[0];
+		uint32_t keyLength;
+		varintGet( bucketGetData(bucket), &keyLength );
+		return (MH_KLEN_T)keyLength;
 	}
 	
 	unsigned char *bucketGetKey(Bucket *bucket) {
 		// get pointer to bucket key
-		unsigned char *bucketData = ((unsigned char *)bucket) + sizeof(Bucket);
-		return bucketData + MH_KLEN_SIZE;
+		uint32_t keyLength;
+		return varintGet( bucketGetData(bucket), &keyLength );
+	}
+	
+	MH_LEN_T bucketGetSize(Bucket *bucket) {
+		// get total allocated size of bucket (header, expiry, lengths, key and content)
+		MH_KLEN_T keyLength = bucketGetKeyLength(bucket);
+		MH_LEN_T contentLength = bucketGetContentLength(bucket);
+		return bucketMetaSizeFor( keyLength, contentLength, bucket->type & MH_FLAG_EXPIRES ) + keyLength + contentLength;
+	}
+	
+	MH_LEN_T bucketGetMetaSize(Bucket *bucket) {
+		// get size of everything in bucket besides key and content (counted in metaSize)
+		return bucketMetaSizeFor( bucketGetKeyLength(bucket), bucketGetContentLength(bucket), bucket->type & MH_FLAG_EXPIRES );
+	}
+	
+	MH_LEN_T bucketMetaSizeFor(MH_KLEN_T keyLength, MH_LEN_T contentLength, unsigned char hasExpires) {
+		// get size of bucket header, expiry and lengths for a key/value pair, before it is stored
+		return sizeof(Bucket) + (hasExpires ? MH_EXPIRES_SIZE : 0) + varintSize(keyLength) + varintSize(contentLength);
 	}
 	
 	MH_LEN_T bucketGetContentLength(Bucket *bucket) {
 		// get bucket content (value) length
-		unsigned char *bucketData = ((unsigned char *)bucket) + sizeof(Bucket);
-		unsigned char *tempCL = bucketData + MH_KLEN_SIZE + ((MH_KLEN_T *)bucketData)[0];
-		return ((MH_LEN_T *)tempCL)[0];
+		uint32_t keyLength, contentLength;
+		unsigned char *bucketKey = varintGet( bucketGetData(bucket), &keyLength );
+		varintGet( bucketKey + keyLength, &contentLength );
+		return contentLength;
 	}
 	
 	unsigned char *bucketGetContent(Bucket *bucket) {
 		// get pointer to bucket content (value)
-		unsigned char *bucketData = ((unsigned char *)bucket) + sizeof(Bucket);
-		return bucketData + MH_KLEN_SIZE + ((MH_KLEN_T *)bucketData)[0] + MH_LEN_SIZE;
+		uint32_t keyLength, contentLength;
+		unsigned char *bucketKey = varintGet( bucketGetData(bucket), &keyLength );
+		return varintGet( bucketKey + keyLength, &contentLength );
 	}
 	
-	void digestKey(unsigned char *key, MH_KLEN_T keyLength, unsigned char *digest) {
-		// Create 32-bit digest of custom key using DJB2 algorithm.
-		// Return as 8 separate bytes (4 bits each) in unsigned char array
+	void countCompressed(unsigned char flags, unsigned char *content, MH_LEN_T contentLength, int adding) {
+		// track stored and original sizes of compressed values, as they are added or removed
+		if (!(flags & MH_FLAG_COMPRESSED)) return;
+		uint32_t rawLength = 0;
+		Compressor::rawLength( content, contentLength, &rawLength );
+		
+		if (adding) {
+			stats->compressedSize += contentLength;
+			stats->rawSize += rawLength;
+		}
+		else {
+			stats->compressedSize -= contentLength;
+			stats->rawSize -= rawLength;
+		}
+	}
+	
+	static unsigned char varintSize(uint32_t value) {
+		// number of bytes needed to store value as a varint (7 bits per byte, low bits first)
+		unsigned char size = 1;
+		while (value >= 0x80) { value >>= 7; size++; }
+		return size;
+	}
+	
+	static unsigned char *varintPut(unsigned char *ptr, uint32_t value) {
+		// write varint, returns pointer just past it
+		while (value >= 0x80) { *ptr++ = (unsigned char)(value | 0x80); value >>= 7; }
+		*ptr++ = (unsigned char)value;
+		return ptr;
+	}
+	
+	static unsigned char *varintGet(unsigned char *ptr, uint32_t *value) {
+		// read varint, returns pointer just past it
+		// lengths under 128 (nearly all keys, and small values) take the single byte path
+		if (ptr[0] < 0x80) { value[0] = ptr[0]; return ptr + 1; }
+		uint32_t result = 0;
+		unsigned char shift = 0;
+		while (ptr[0] >= 0x80) { result |= (uint32_t)(ptr[0] & 0x7F) << shift; shift += 7; ptr++; }
+		value[0] = result | ((uint32_t)ptr[0] << shift);
+		return ptr + 1;
+	}
+	
+	uint64_t digestKey(unsigned char *key, MH_KLEN_T keyLength) {
+		// Create digest of custom key using selected algorithm.
+		if (hashType == MH_HASH_WYHASH) {
+			// 64-bit wyhash
+			return wyhash( (const void *)key, (size_t)keyLength, 0, _wyp );
+		}
+		
+		// 32-bit DJB2
 		uint32_t hash = 5381;
 		for (unsigned int i = 0; i < keyLength; i++) {
 			hash = ((hash << 5) + hash) + key[i];
 		}
-		((uint32_t *)digest)[0] = hash;
-		
-		digest[4] = digest[0] % 16;
-		digest[5] = digest[1] % 16;
-		digest[6] = digest[2] % 16;
-		digest[7] = digest[3] % 16;
 		
-		digest[0] /= 16;
-		digest[1] /= 16;
-		digest[2] /= 16;
-		digest[3] /= 16;
+		// index levels consume the digest from the low bits up, and DJB2 has always
+		// been sliced high nibble of each byte first, so move those down to the bottom
+		return (uint64_t)(djb2Nibbles(hash >> 4) | (djb2Nibbles(hash) << 16));
+	}
+	
+	uint32_t djb2Nibbles(uint32_t hash) {
+		// gather the low nibble of each byte into one 16-bit value
+		hash &= 0x0F0F0F0F;
+		hash = (hash | (hash >> 4)) & 0x00FF00FF;
+		return (hash | (hash >> 8)) & 0x0000FFFF;
+	}
+	
+	unsigned char digestSlice(uint64_t digest, unsigned char digestShift, unsigned char bits) {
+		// Get one 4-bit or 8-bit slice of digest, used as the slot for one index level.
+		// digestShift is the number of bits already used by the levels above.
+		return (unsigned char)((digest >> digestShift) & ((1 << bits) - 1));
+	}
+	
+	static uint64_t nowMS() {
+		// current time in ms since epoch, same clock as Date.now() in JS
+		return (uint64_t)std::chrono::duration_cast<std::chrono::milliseconds>( std::chrono::system_clock::now().time_since_epoch() ).count();
+	}
+	
+	uint64_t digestOrder(uint64_t digest) {
+		// Rearrange digest so it sorts in cursor order: the main index slice in the top 8 bits,
+		// then each 4-bit slice below it, in the order the levels consume them.
+		// Widened 8-bit levels are walked in this same order, so it never depends on the tree shape.
+		uint64_t order = (digest & 0xFF) << 56;
+		for (int shift = 8; shift < 64; shift += 4) order |= ((digest >> shift) & 0xF) << (60 - shift);
+		return order;
+	}
+	
+	size_t indexSizeOf(unsigned char kind) {
+		// get allocated size of index given its kind
+		switch (kind) {
+			case MH_INDEX_4: return sizeof(Index4);
+			case MH_INDEX_16: return sizeof(Index16);
+			case MH_INDEX_48: return sizeof(Index48);
+			case MH_INDEX_16D: return sizeof(Index16D);
+		}
+		return sizeof(Index256);
 	}
 
 }; // Hash
+
+class HashGuard {
+public:
+	// holds the lock needed for one operation on a hash in concurrent mode (does nothing otherwise)
+	// locks the stripe for one key, or all stripes for whole hash operations, until out of scope
+	// any Response content pointers must be copied before the guard is released
+	Hash *hash;
+	int stripe; /**< Stripe held, or -1 for all of them. */
+	unsigned char exclusive;
+	
+	HashGuard(Hash *newHash, unsigned char *key, MH_KLEN_T keyLength, unsigned char newExclusive) {
+		// lock stripe for one key (the main index slot it lives under)
+		hash = newHash;
+		exclusive = newExclusive;
+		stripe = hash->locks ? hash->digestSlice( hash->digestKey(key, keyLength), 0, 8 ) : -1;
+		if (hash->locks) hash->lockStripe( stripe, exclusive );
+	}
+	
+	HashGuard(Hash *newHash, unsigned char newExclusive) {
+		// lock all stripes, for operations on the whole hash
+		hash = newHash;
+		exclusive = newExclusive;
+		stripe = -1;
+		if (hash->locks) hash->lockStripe( stripe, exclusive );
+	}
+	
+	~HashGuard() {
+		if (hash->locks) hash->unlockStripe( stripe, exclusive );
+	}
+};
+
+#endif
@@ -0,0 +1,362 @@
+// MegaHash v1.0
+// Copyright (c) 2019 Joseph Huckaby
+// Based on DeepHash, (c) 2003 Joseph Huckaby
+
+// Binary snapshot save/load for Hash.
+// All integers are little-endian.  The file layout is:
+//   header (MH_SNAP_HEADER_SIZE bytes):
+//     magic (8 bytes), version (32 bits), hash type (32 bits),
+//     number of keys (64 bits), number of groups (64 bits), header checksum (64 bits)
+//   then one group per non-empty main index slot:
+//     group header (MH_SNAP_GROUP_SIZE bytes):
+//       slot (32 bits), dictionary id (32 bits), number of records (64 bits),
+//       length of records in bytes (64 bits), records checksum (64 bits)
+//     records, each one:
+//       key length (16 bits), key, flags (8 bits), [expiry time (64 bits)], value length (32 bits), value
+// The expiry time (ms since epoch) is only present if flags has MH_FLAG_EXPIRES set (version 2 and up).
+// Without it, records are the same layout as the packed buffers used by setMany().
+// Values with MH_FLAG_COMPRESSED set are saved compressed (version 3 and up), and the dictionary id is
+// non-zero if any of them used a dictionary, which must then be the same one when loading.
+// Every key in a group lives under the same main index slot, so groups can be loaded in parallel.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#include "MegaHash.h"
+
+static void putLE(unsigned char *ptr, uint64_t value, int numBytes) {
+	// write little-endian unsigned integer
+	for (int idx = 0; idx < numBytes; idx++) { ptr[idx] = (unsigned char)(value & 0xFF); value >>= 8; }
+}
+
+static uint64_t getLE(unsigned char *ptr, int numBytes) {
+	// read little-endian unsigned integer
+	uint64_t value = 0;
+	for (int idx = numBytes - 1; idx >= 0; idx--) value = (value << 8) | ptr[idx];
+	return value;
+}
+
+static uint64_t snapshotChecksum(uint64_t seed, unsigned char *key, MH_KLEN_T keyLength, unsigned char flags, uint64_t expires, unsigned char *content, MH_LEN_T contentLength) {
+	// chain one record into running group checksum
+	// (chained so records can be streamed, without buffering whole groups)
+	seed = wyhash( (const void *)key, (size_t)keyLength, seed ^ (((uint64_t)keyLength << 8) | flags) ^ expires, _wyp );
+	return wyhash( (const void *)content, (size_t)contentLength, seed ^ (uint64_t)contentLength, _wyp );
+}
+
+const char *Hash::save(const char *path) {
+	// save all keys/values to binary snapshot file
+	// returns NULL on success, or error message
+	FILE *fh = fopen( path, "wb" );
+	if (!fh) return "Could not open snapshot file for writing";
+	setvbuf( fh, NULL, _IOFBF, 1024 * 1024 );
+
+	unsigned char header[ MH_SNAP_HEADER_SIZE ];
+	unsigned char groupHeader[ MH_SNAP_GROUP_SIZE ];
+	SnapshotGroup groups[ MH_INDEX_SIZE ];
+	uint64_t numGroups = 0;
+	uint64_t numKeys = 0;
+	uint64_t now = nowMS();
+	Tag **slot;
+	int ch;
+
+	// first pass: measure and checksum each group (all in memory, so this is fast)
+	for (ch = 0; ch < MH_INDEX_SIZE; ch++) {
+		slot = indexFind( index, (unsigned char)ch );
+		if (!slot) continue;
+
+		groups[numGroups].slot = ch;
+		saveTag( NULL, slot[0], &groups[numGroups], now );
+		numKeys += groups[numGroups].numRecords;
+		numGroups++;
+	}
+
+	memset( (void *)header, 0, MH_SNAP_HEADER_SIZE );
+	memcpy( (void *)header, MH_SNAP_MAGIC, 8 );
+	putLE( header + 8, MH_SNAP_VERSION, 4 );
+	putLE( header + 12, hashType, 4 );
+	putLE( header + 16, numKeys, 8 );
+	putLE( header + 24, numGroups, 8 );
+	putLE( header + 32, wyhash( (const void *)header, 32, 0, _wyp ), 8 );
+	fwrite( (void *)header, MH_SNAP_HEADER_SIZE, 1, fh );
+
+	// second pass: write each group header and its records
+	for (uint64_t idx = 0; idx < numGroups; idx++) {
+		memset( (void *)groupHeader, 0, MH_SNAP_GROUP_SIZE );
+		putLE( groupHeader, groups[idx].slot, 4 );
+		putLE( groupHeader + 4, groups[idx].dictId, 4 );
+		putLE( groupHeader + 8, groups[idx].numRecords, 8 );
+		putLE( groupHeader + 16, groups[idx].length, 8 );
+		putLE( groupHeader + 24, groups[idx].checksum, 8 );
+		fwrite( (void *)groupHeader, MH_SNAP_GROUP_SIZE, 1, fh );
+
+		saveTag( fh, indexFind(index, (unsigned char)groups[idx].slot)[0], NULL, now );
+	}
+
+	int err = ferror( fh );
+	if (fclose(fh) || err) return "Could not write snapshot file";
+	return NULL;
+}
+
+void Hash::saveTag(FILE *fh, Tag *tag, SnapshotGroup *group, uint64_t now) {
+	// internal method: write all records under tag to file, or if fh is NULL,
+	// just count, measure and checksum them into group
+	// keys expired as of now are left out (both passes must use the same now)
+	if (tag->type == MH_SIG_INDEX) {
+		Index *level = (Index *)tag;
+		Tag *child;
+
+		for (int ch = 0; (child = indexNext(level, &ch)); ch++) {
+			saveTag( fh, child, group, now );
+		}
+	}
+	else {
+		Bucket *bucket = leafList(tag);
+		unsigned char lengths[ MH_EXPIRES_SIZE ];
+
+		for (; bucket; bucket = bucket->next) {
+			if (bucketExpired(bucket, now)) continue;
+			
+			MH_KLEN_T keyLength = bucketGetKeyLength(bucket);
+			MH_LEN_T contentLength = bucketGetContentLength(bucket);
+			uint64_t expires = bucketGetExpires(bucket);
+
+			if (fh) {
+				putLE( lengths, keyLength, MH_KLEN_SIZE );
+				fwrite( (void *)lengths, MH_KLEN_SIZE, 1, fh );
+				fwrite( (void *)bucketGetKey(bucket), keyLength, 1, fh );
+				fputc( bucket->type & (MH_FLAGS_VALUE | MH_FLAG_EXPIRES | MH_FLAG_COMPRESSED), fh );
+				if (expires) {
+					putLE( lengths, expires, MH_EXPIRES_SIZE );
+					fwrite( (void *)lengths, MH_EXPIRES_SIZE, 1, fh );
+				}
+				putLE( lengths, contentLength, MH_LEN_SIZE );
+				fwrite( (void *)lengths, MH_LEN_SIZE, 1, fh );
+				fwrite( (void *)bucketGetContent(bucket), contentLength, 1, fh );
+			}
+			else {
+				group->numRecords++;
+				if ((bucket->type & MH_FLAG_COMPRESSED) && compressor) group->dictId = compressor->dictId;
+				group->length += MH_KLEN_SIZE + keyLength + 1 + (expires ? MH_EXPIRES_SIZE : 0) + MH_LEN_SIZE + contentLength;
+				group->checksum = snapshotChecksum( group->checksum, bucketGetKey(bucket), keyLength, bucket->type & (MH_FLAGS_VALUE | MH_FLAG_EXPIRES | MH_FLAG_COMPRESSED), expires, bucketGetContent(bucket), contentLength );
+			}
+		}
+	}
+}
+
+const char *Hash::load(const char *path, unsigned int numThreads) {
+	// load keys/values from binary snapshot file into empty hash
+	// groups are loaded in parallel using up to numThreads threads
+	// the hash must not be in use by any other thread until this returns
+	// returns NULL on success, or error message (hash may be partially loaded)
+	if (stats->numKeys) return "Hash must be empty to load a snapshot";
+
+	unsigned char *data = NULL;
+	uint64_t size = 0;
+
+#ifndef _WIN32
+	// map whole file, so records can be stored straight from the page cache
+	int fd = open( path, O_RDONLY );
+	if (fd < 0) return "Could not open snapshot file for reading";
+
+	struct stat info;
+	if (fstat(fd, &info) || (info.st_size < MH_SNAP_HEADER_SIZE)) {
+		close(fd);
+		return "Snapshot file is truncated";
+	}
+	size = (uint64_t)info.st_size;
+
+	void *map = mmap( NULL, (size_t)size, PROT_READ, MAP_PRIVATE, fd, 0 );
+	close(fd);
+	if (map == MAP_FAILED) return "Could not map snapshot file";
+	data = (unsigned char *)map;
+	madvise( map, (size_t)size, MADV_SEQUENTIAL );
+#else
+	// no mmap here, so read whole file into memory
+	FILE *fh = fopen( path, "rb" );
+	if (!fh) return "Could not open snapshot file for reading";
+
+	_fseeki64( fh, 0, SEEK_END );
+	size = (uint64_t)_ftelli64( fh );
+	_fseeki64( fh, 0, SEEK_SET );
+
+	if (size < MH_SNAP_HEADER_SIZE) {
+		fclose(fh);
+		return "Snapshot file is truncated";
+	}
+
+	data = (unsigned char *)malloc( (size_t)size );
+	if (!data) {
+		fclose(fh);
+		return "Not enough memory to read snapshot file";
+	}
+	if (fread( (void *)data, (size_t)size, 1, fh ) != 1) {
+		fclose(fh);
+		free( (void *)data );
+		return "Could not read snapshot file";
+	}
+	fclose(fh);
+#endif
+
+	const char *err = NULL;
+	uint64_t numKeys = 0;
+	std::vector<SnapshotGroup> groups;
+
+	// check header
+	if (memcmp( (void *)data, MH_SNAP_MAGIC, 8 )) err = "File is not a MegaHash snapshot";
+	else if (getLE(data + 32, 8) != wyhash( (const void *)data, 32, 0, _wyp )) err = "Snapshot header checksum mismatch";
+	else if ((getLE(data + 8, 4) < 1) || (getLE(data + 8, 4) > MH_SNAP_VERSION)) err = "Unsupported snapshot version";
+	else if (getLE(data + 12, 4) > MH_HASH_WYHASH) err = "Unsupported snapshot hash type";
+
+	if (!err) {
+		// keys must be digested the same way they were when saved, so every group lands in its slot
+		setHashType( (unsigned char)getLE(data + 12, 4) );
+		numKeys = getLE( data + 16, 8 );
+
+		// locate all groups (only headers are read here)
+		uint64_t numGroups = getLE( data + 24, 8 );
+		uint64_t offset = MH_SNAP_HEADER_SIZE;
+		SnapshotGroup group;
+
+		for (uint64_t idx = 0; !err && (idx < numGroups); idx++) {
+			if ((numGroups > MH_INDEX_SIZE) || (offset + MH_SNAP_GROUP_SIZE > size)) {
+				err = "Snapshot file is truncated";
+				break;
+			}
+
+			group.slot = (uint32_t)getLE( data + offset, 4 );
+			group.dictId = (uint32_t)getLE( data + offset + 4, 4 );
+			group.numRecords = getLE( data + offset + 8, 8 );
+			group.length = getLE( data + offset + 16, 8 );
+			group.checksum = getLE( data + offset + 24, 8 );
+			group.offset = offset + MH_SNAP_GROUP_SIZE;
+
+			if (group.slot >= MH_INDEX_SIZE) err = "Snapshot group slot is invalid";
+			else if (group.dictId && (group.dictId != (compressor ? compressor->dictId : 0))) err = "Snapshot was saved with a different compression dictionary";
+			else if (group.length > size - group.offset) err = "Snapshot file is truncated";
+			else {
+				groups.push_back( group );
+				offset = group.offset + group.length;
+			}
+		}
+
+		if (!err && (offset != size)) err = "Snapshot file has trailing data";
+	}
+
+	if (!err) {
+		if ((numThreads <= 1) || (groups.size() < 2)) {
+			// load all groups right here
+			for (size_t idx = 0; !err && (idx < groups.size()); idx++) {
+				err = loadGroup( data, &groups[idx] );
+			}
+		}
+		else {
+			// each thread claims whole groups, which never share index nodes
+			// only the arena is shared, so it must be locked for the duration
+			std::atomic<size_t> nextGroup( 0 );
+			std::atomic<const char *> firstErr( (const char *)NULL );
+			std::vector<std::thread> threads;
+			int wasConcurrent = (locks != NULL);
+
+			arena->setConcurrent( 1 );
+			if (numThreads > groups.size()) numThreads = (unsigned int)groups.size();
+
+			for (unsigned int idx = 0; idx < numThreads; idx++) {
+				threads.push_back( std::thread( [this, data, &groups, &nextGroup, &firstErr]() {
+					size_t groupIdx;
+					while (!firstErr.load() && ((groupIdx = nextGroup++) < groups.size())) {
+						const char *groupErr = loadGroup( data, &groups[groupIdx] );
+						const char *noErr = NULL;
+						if (groupErr) firstErr.compare_exchange_strong( noErr, groupErr );
+					}
+				} ) );
+			}
+			for (size_t idx = 0; idx < threads.size(); idx++) threads[idx].join();
+
+			if (!wasConcurrent) arena->setConcurrent( 0 );
+			err = firstErr.load();
+		}
+	}
+
+	if (!err && (stats->numKeys != numKeys)) err = "Snapshot key count mismatch";
+
+#ifndef _WIN32
+	munmap( (void *)data, (size_t)size );
+#else
+	free( (void *)data );
+#endif
+
+	return err;
+}
+
+const char *Hash::loadGroup(unsigned char *data, SnapshotGroup *group) {
+	// internal method: store all records from one snapshot group, verifying as we go
+	// values saved uncompressed are compressed here if this hash compresses, the same as storeWithDigest does
+	// there is no evicting while other groups load in parallel, so a snapshot that does not fit in maxBytes fails
+	// returns NULL on success, or error message
+	unsigned char *ptr = data + group->offset;
+	unsigned char *end = ptr + group->length;
+	uint64_t numRecords = 0;
+	uint64_t checksum = 0;
+	uint64_t digest;
+	uint64_t expires;
+	unsigned char *key, *content;
+	MH_KLEN_T keyLength;
+	MH_LEN_T contentLength;
+	unsigned char flags;
+	std::string compressed;
+
+	while (ptr < end) {
+		if ((size_t)(end - ptr) < MH_KLEN_SIZE) return "Snapshot record is truncated";
+		keyLength = (MH_KLEN_T)getLE( ptr, MH_KLEN_SIZE ); ptr += MH_KLEN_SIZE;
+
+		if ((size_t)(end - ptr) < (size_t)keyLength + 1 + MH_LEN_SIZE) return "Snapshot record is truncated";
+		key = ptr; ptr += keyLength;
+		flags = ptr[0]; ptr++;
+		expires = 0;
+		
+		if (flags & MH_FLAG_EXPIRES) {
+			if ((size_t)(end - ptr) < MH_EXPIRES_SIZE + MH_LEN_SIZE) return "Snapshot record is truncated";
+			expires = getLE( ptr, MH_EXPIRES_SIZE ); ptr += MH_EXPIRES_SIZE;
+			if (!expires) return "Snapshot record has invalid expiry time";
+		}
+		contentLength = (MH_LEN_T)getLE( ptr, MH_LEN_SIZE ); ptr += MH_LEN_SIZE;
+
+		if ((size_t)(end - ptr) < (size_t)contentLength) return "Snapshot record is truncated";
+		content = ptr; ptr += contentLength;
+
+		// every key must belong to this group's slot, so parallel loads never touch the same nodes
+		digest = digestKey( key, keyLength );
+		if (digestSlice(digest, 0, 8) != group->slot) return "Snapshot record is in the wrong group";
+
+		checksum = snapshotChecksum( checksum, key, keyLength, flags, expires, content, contentLength );
+		numRecords++;
+
+		if (compressor && !(flags & MH_FLAG_COMPRESSED) && compressor->compress(content, contentLength, compressed)) {
+			content = (unsigned char *)compressed.data();
+			contentLength = (MH_LEN_T)compressed.size();
+			flags |= MH_FLAG_COMPRESSED;
+		}
+
+		if (maxBytes && (bytesUsed() + bucketMetaSizeFor(keyLength, contentLength, expires ? 1 : 0) + keyLength + contentLength > maxBytes)) {
+			return "Snapshot exceeds maxBytes";
+		}
+
+		if (storeDigest( key, keyLength, content, contentLength, flags, digest, expires ).result == MH_ERR) return "Out of memory loading snapshot";
+	}
+
+	if (numRecords != group->numRecords) return "Snapshot group record count mismatch";
+	if (checksum != group->checksum) return "Snapshot group checksum mismatch";
+	return NULL;
+}
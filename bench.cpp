@@ -0,0 +1,561 @@
+// MegaHash v1.0
+// Copyright (c) 2019 Joseph Huckaby
+// Based on DeepHash, (c) 2003 Joseph Huckaby
+
+// Native micro-benchmark for the core Hash class, with no Node.js in the way.
+// Runs insert, hit, batched hit, miss, replace, iterate, remove and clear phases against each engine
+// (megahash with bucket lists, megahash with swiss table style groups, and std::unordered_map),
+// and prints throughput, latency percentiles and memory for each one.
+// With --threads, also times a bulk insert of all keys via Hash::storeMany, on one thread and on N.
+// Build: MEGAHASH_BENCH=1 node-gyp rebuild (see binding.gyp), then run build/Release/megahash_bench
+// Usage: megahash_bench --keys 1000000 --key-size 8-16 --value-size 96-128 --engine all
+// Sizes are either a fixed length, or MIN-MAX picked uniformly (or log-uniformly with --value-dist log,
+// which gives mostly small values with a long tail of big ones, like a typical cache).
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <unordered_map>
+#include <chrono>
+
+#ifndef _WIN32
+#include <unistd.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#endif
+
+#include "MegaHash.h"
+
+class BenchConfig {
+public:
+	// command line options
+	uint64_t numKeys;
+	uint64_t numOps; /**< Lookups and replaces per phase (defaults to numKeys). */
+	uint32_t keyMin, keyMax, valueMin, valueMax;
+	int keyLog, valueLog; /**< Log-uniform instead of uniform size distribution. */
+	unsigned char hashType;
+	uint32_t compress;
+	uint64_t maxBytes;
+	uint32_t sampleEvery; /**< Time every Nth operation for latency percentiles. */
+	uint32_t threads; /**< Threads for the bulk insert phase (0 to skip it). */
+	uint32_t batch; /**< Keys per batch for the batched hit phase (like getMany). */
+	uint64_t seed;
+	std::string engine;
+	
+	BenchConfig() {
+		numKeys = 1000000;
+		numOps = 0;
+		keyMin = 8; keyMax = 16;
+		valueMin = 96; valueMax = 128;
+		keyLog = 0; valueLog = 0;
+		hashType = MH_HASH_DJB2;
+		compress = 0;
+		maxBytes = 0;
+		sampleEvery = 8;
+		threads = 0;
+		batch = 64;
+		seed = 1;
+		engine = "all";
+	}
+};
+
+class BenchData {
+public:
+	// all keys and values are generated up front, so generating them is not measured
+	// keys are numKeys present ones followed by numKeys missing ones, all distinct
+	std::string keyPool;
+	std::vector<uint64_t> keyOffsets; /**< numKeys * 2 + 1 offsets, so key length is the difference. */
+	std::string valuePool;
+	std::vector<uint32_t> valueLengths; /**< numKeys * 2 lengths, the second half for replaces. */
+	std::vector<uint32_t> lookups; /**< Random key indexes for hit, miss and replace phases. */
+	std::vector<uint32_t> order; /**< Random order of all keys, for removes. */
+	
+	unsigned char *key(uint64_t idx) { return (unsigned char *)&keyPool[ keyOffsets[idx] ]; }
+	MH_KLEN_T keyLength(uint64_t idx) { return (MH_KLEN_T)(keyOffsets[idx + 1] - keyOffsets[idx]); }
+	unsigned char *value(uint64_t idx) { return (unsigned char *)&valuePool[ (idx * 7919) % (valuePool.size() - valueLengths[idx]) ]; }
+	MH_LEN_T valueLength(uint64_t idx) { return valueLengths[idx]; }
+};
+
+class Latency {
+public:
+	// sampled operation times, in nanoseconds
+	std::vector<uint32_t> samples;
+	
+	void add(std::chrono::steady_clock::time_point start) {
+		samples.push_back( (uint32_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count() );
+	}
+	
+	uint32_t percentile(double pct) {
+		// samples must be sorted first
+		if (samples.empty()) return 0;
+		size_t idx = (size_t)((pct / 100.0) * (samples.size() - 1));
+		return samples[idx];
+	}
+};
+
+static uint64_t rngState = 1;
+
+static uint64_t nextRandom() {
+	// xorshift64*, good enough for picking keys and sizes
+	rngState ^= rngState >> 12;
+	rngState ^= rngState << 25;
+	rngState ^= rngState >> 27;
+	return rngState * 2685821657736338717ULL;
+}
+
+static uint32_t randomSize(uint32_t min, uint32_t max, int logScale) {
+	// pick size between min and max inclusive, uniformly or log-uniformly
+	if (min >= max) return min;
+	if (!logScale || !min) return min + (uint32_t)(nextRandom() % (max - min + 1));
+	double frac = (double)(nextRandom() >> 11) / (double)(1ULL << 53);
+	return (uint32_t)exp( log((double)min) + frac * (log((double)max + 1) - log((double)min)) );
+}
+
+static double nowSec() {
+	// monotonic time in seconds
+	return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static uint64_t rssBytes() {
+	// current resident set size, or 0 if unknown
+	#ifdef __linux__
+	FILE *fh = fopen( "/proc/self/statm", "r" );
+	if (!fh) return 0;
+	unsigned long pages = 0, resident = 0;
+	int count = fscanf( fh, "%lu %lu", &pages, &resident );
+	fclose( fh );
+	return (count == 2) ? (uint64_t)resident * (uint64_t)sysconf(_SC_PAGESIZE) : 0;
+	#elif !defined(_WIN32)
+	// peak is the best we can do here, which is fine as each engine runs in its own process
+	struct rusage usage;
+	getrusage( RUSAGE_SELF, &usage );
+	#ifdef __APPLE__
+	return (uint64_t)usage.ru_maxrss;
+	#else
+	return (uint64_t)usage.ru_maxrss * 1024;
+	#endif
+	#else
+	return 0;
+	#endif
+}
+
+static void generate(BenchConfig *config, BenchData *data) {
+	// build key and value pools, and random lookup orders
+	rngState = config->seed ? config->seed : 1;
+	uint64_t numKeys = config->numKeys * 2;
+	static const char chars[] = "0123456789abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ";
+	
+	// keys start with their index in fixed width base 62, so they are all distinct
+	int width = 1;
+	for (uint64_t max = 62; max < numKeys; max *= 62) width++;
+	
+	data->keyOffsets.reserve( numKeys + 1 );
+	for (uint64_t idx = 0; idx < numKeys; idx++) {
+		data->keyOffsets.push_back( data->keyPool.size() );
+		uint32_t length = MAX( (uint32_t)width, randomSize(config->keyMin, config->keyMax, config->keyLog) );
+		length = MIN( length, (uint32_t)0xFFFF );
+		
+		uint64_t value = idx;
+		for (int pos = 0; pos < width; pos++) { data->keyPool += chars[ value % 62 ]; value /= 62; }
+		for (uint32_t pos = width; pos < length; pos++) data->keyPool += chars[ nextRandom() % 62 ];
+	}
+	data->keyOffsets.push_back( data->keyPool.size() );
+	
+	// values are slices of one pool of words, which compresses about as well as typical text
+	static const char *words[] = { "alpha", "bravo", "charlie", "delta", "echo", "foxtrot", "golf", "hotel", "india", "juliet", "kilo", "lima" };
+	data->valueLengths.reserve( numKeys );
+	for (uint64_t idx = 0; idx < numKeys; idx++) {
+		data->valueLengths.push_back( randomSize(config->valueMin, config->valueMax, config->valueLog) );
+	}
+	size_t poolSize = (size_t)config->valueMax + (1024 * 1024);
+	while (data->valuePool.size() < poolSize) {
+		data->valuePool += words[ nextRandom() % 12 ];
+		data->valuePool += (nextRandom() % 4) ? " " : ", ";
+	}
+	
+	data->lookups.reserve( config->numOps );
+	for (uint64_t idx = 0; idx < config->numOps; idx++) data->lookups.push_back( (uint32_t)(nextRandom() % config->numKeys) );
+	
+	data->order.reserve( config->numKeys );
+	for (uint64_t idx = 0; idx < config->numKeys; idx++) data->order.push_back( (uint32_t)idx );
+	for (uint64_t idx = config->numKeys - 1; idx > 0; idx--) std::swap( data->order[idx], data->order[ nextRandom() % (idx + 1) ] );
+}
+
+class MegaHashEngine {
+public:
+	// the core Hash class, as used by the Node.js binding
+	Hash *hash;
+	std::vector<Response> resps; /**< Reused by findBatch. */
+	
+	MegaHashEngine(BenchConfig *config) {
+		hash = new Hash( 8, 16, config->hashType );
+		if (config->compress) hash->setCompression( config->compress );
+		if (config->maxBytes) hash->setMaxBytes( config->maxBytes );
+	}
+	~MegaHashEngine() { delete hash; }
+	
+	const char *name() { return "megahash"; }
+	
+	int insert(unsigned char *key, MH_KLEN_T keyLength, unsigned char *value, MH_LEN_T valueLength) {
+		return hash->store( key, keyLength, value, valueLength ).result != MH_ERR;
+	}
+	
+	size_t find(unsigned char *key, MH_KLEN_T keyLength) {
+		// returns value length plus one, or 0 if not found
+		Response resp = hash->fetch( key, keyLength );
+		return (resp.result == MH_OK) ? (size_t)hash->valueLength(&resp) + 1 : 0;
+	}
+	
+	size_t findBatch(BulkRecord *records, size_t count) {
+		// fetch keys all at once (see Hash::fetchBatch), returns how many were found
+		size_t found = 0;
+		resps.resize( count );
+		hash->fetchBatch( records, count, resps.data() );
+		for (size_t idx = 0; idx < count; idx++) found += (resps[idx].result == MH_OK);
+		return found;
+	}
+	
+	int remove(unsigned char *key, MH_KLEN_T keyLength) {
+		return hash->remove( key, keyLength ).result == MH_OK;
+	}
+	
+	uint64_t iterate(uint64_t *totalLength) {
+		// walk all keys with a cursor, in batches like the Node.js iterators
+		Cursor cursor;
+		std::vector<Bucket *> buckets;
+		uint64_t count = 0;
+		
+		while (!cursor.done) {
+			buckets.clear();
+			hash->cursorNext( &cursor, 1000, &buckets );
+			for (size_t idx = 0; idx < buckets.size(); idx++) totalLength[0] += hash->bucketGetContentLength( buckets[idx] );
+			count += buckets.size();
+		}
+		return count;
+	}
+	
+	void clear() { hash->clear(); }
+	
+	uint64_t bytesUsed() { return hash->bytesUsed(); }
+};
+
+class SwissEngine : public MegaHashEngine {
+public:
+	// the core Hash class with swiss table style groups in place of bucket lists (see Hash::setEngine)
+	SwissEngine(BenchConfig *config) : MegaHashEngine(config) {
+		hash->setEngine( MH_ENGINE_SWISS );
+	}
+	
+	const char *name() { return "swiss"; }
+};
+
+class MapEngine {
+public:
+	// std::unordered_map baseline (keys and values are copied into std::strings, like the hash copies them)
+	std::unordered_map<std::string, std::string> map;
+	
+	MapEngine(BenchConfig *config) {}
+	
+	const char *name() { return "unordered_map"; }
+	
+	int insert(unsigned char *key, MH_KLEN_T keyLength, unsigned char *value, MH_LEN_T valueLength) {
+		map[ std::string((const char *)key, keyLength) ].assign( (const char *)value, valueLength );
+		return 1;
+	}
+	
+	size_t find(unsigned char *key, MH_KLEN_T keyLength) {
+		std::unordered_map<std::string, std::string>::iterator iter = map.find( std::string((const char *)key, keyLength) );
+		return (iter != map.end()) ? iter->second.size() + 1 : 0;
+	}
+	
+	size_t findBatch(BulkRecord *records, size_t count) {
+		// no batch lookup here, so just one at a time
+		size_t found = 0;
+		for (size_t idx = 0; idx < count; idx++) found += !!find( records[idx].key, records[idx].keyLength );
+		return found;
+	}
+	
+	int remove(unsigned char *key, MH_KLEN_T keyLength) {
+		return map.erase( std::string((const char *)key, keyLength) ) ? 1 : 0;
+	}
+	
+	uint64_t iterate(uint64_t *totalLength) {
+		for (std::unordered_map<std::string, std::string>::iterator iter = map.begin(); iter != map.end(); ++iter) {
+			totalLength[0] += iter->second.size();
+		}
+		return map.size();
+	}
+	
+	void clear() { map.clear(); }
+	
+	uint64_t bytesUsed() { return 0; }
+};
+
+static void printPhase(const char *phase, uint64_t ops, double elapsed, Latency *latency) {
+	// print one result line, with percentiles if operations were timed
+	printf( "  %-10s %12.0f ops/sec", phase, elapsed > 0 ? (double)ops / elapsed : 0.0 );
+	if (latency && !latency->samples.empty()) {
+		std::sort( latency->samples.begin(), latency->samples.end() );
+		printf( "   p50 %6u ns   p99 %6u ns   p99.9 %7u ns   max %8u ns",
+			latency->percentile(50), latency->percentile(99), latency->percentile(99.9), latency->samples.back() );
+	}
+	printf( "\n" );
+}
+
+template <class Engine>
+static void runEngine(BenchConfig *config, BenchData *data) {
+	// run all phases against one engine
+	uint64_t rssStart = rssBytes();
+	Engine *engine = new Engine( config );
+	uint64_t numKeys = config->numKeys;
+	uint64_t numOps = config->numOps;
+	uint32_t sampleEvery = config->sampleEvery ? config->sampleEvery : 1;
+	volatile size_t sink = 0;
+	double start;
+	uint64_t idx, key, failed;
+	
+	printf( "\n%s:\n", engine->name() );
+	
+	// insert
+	Latency latency;
+	failed = 0;
+	start = nowSec();
+	for (idx = 0; idx < numKeys; idx++) {
+		if (idx % sampleEvery) failed += !engine->insert( data->key(idx), data->keyLength(idx), data->value(idx), data->valueLength(idx) );
+		else {
+			std::chrono::steady_clock::time_point opStart = std::chrono::steady_clock::now();
+			failed += !engine->insert( data->key(idx), data->keyLength(idx), data->value(idx), data->valueLength(idx) );
+			latency.add( opStart );
+		}
+	}
+	printPhase( "insert", numKeys, nowSec() - start, &latency );
+	uint64_t rssLoaded = rssBytes();
+	uint64_t bytesLoaded = engine->bytesUsed();
+	if (failed) printf( "  (%llu inserts failed)\n", (unsigned long long)failed );
+	
+	// hit
+	latency.samples.clear();
+	failed = 0;
+	start = nowSec();
+	for (idx = 0; idx < numOps; idx++) {
+		key = data->lookups[idx];
+		if (idx % sampleEvery) sink = engine->find( data->key(key), data->keyLength(key) );
+		else {
+			std::chrono::steady_clock::time_point opStart = std::chrono::steady_clock::now();
+			sink = engine->find( data->key(key), data->keyLength(key) );
+			latency.add( opStart );
+		}
+		failed += !sink;
+	}
+	printPhase( "hit", numOps, nowSec() - start, &latency );
+	if (failed && !config->maxBytes) printf( "  (%llu hits missed)\n", (unsigned long long)failed );
+	
+	// hit again, in batches of the same keys (not timed one by one, so no percentiles)
+	uint32_t batchSize = config->batch ? config->batch : 1;
+	std::vector<BulkRecord> batch( batchSize );
+	size_t batchCount, found = 0;
+	start = nowSec();
+	for (idx = 0; idx < numOps; idx += batchCount) {
+		batchCount = (size_t)MIN( (uint64_t)batchSize, numOps - idx );
+		for (size_t pos = 0; pos < batchCount; pos++) {
+			key = data->lookups[idx + pos];
+			batch[pos].key = data->key(key);
+			batch[pos].keyLength = data->keyLength(key);
+		}
+		found += engine->findBatch( batch.data(), batchCount );
+	}
+	printPhase( "hit batch", numOps, nowSec() - start, NULL );
+	if ((found < numOps) && !config->maxBytes) printf( "  (%llu hits missed)\n", (unsigned long long)(numOps - found) );
+	
+	// miss (keys from the second half of the pool were never inserted)
+	latency.samples.clear();
+	start = nowSec();
+	for (idx = 0; idx < numOps; idx++) {
+		key = numKeys + data->lookups[idx];
+		if (idx % sampleEvery) sink = engine->find( data->key(key), data->keyLength(key) );
+		else {
+			std::chrono::steady_clock::time_point opStart = std::chrono::steady_clock::now();
+			sink = engine->find( data->key(key), data->keyLength(key) );
+			latency.add( opStart );
+		}
+	}
+	printPhase( "miss", numOps, nowSec() - start, &latency );
+	
+	// replace (with values of different lengths)
+	latency.samples.clear();
+	start = nowSec();
+	for (idx = 0; idx < numOps; idx++) {
+		key = data->lookups[idx];
+		if (idx % sampleEvery) engine->insert( data->key(key), data->keyLength(key), data->value(numKeys + key), data->valueLength(numKeys + key) );
+		else {
+			std::chrono::steady_clock::time_point opStart = std::chrono::steady_clock::now();
+			engine->insert( data->key(key), data->keyLength(key), data->value(numKeys + key), data->valueLength(numKeys + key) );
+			latency.add( opStart );
+		}
+	}
+	printPhase( "replace", numOps, nowSec() - start, &latency );
+	
+	// iterate
+	uint64_t totalLength = 0;
+	start = nowSec();
+	uint64_t count = engine->iterate( &totalLength );
+	printPhase( "iterate", count, nowSec() - start, NULL );
+	sink = (size_t)totalLength;
+	
+	// remove half the keys in random order, then clear the rest
+	latency.samples.clear();
+	uint64_t numRemoves = numKeys / 2;
+	start = nowSec();
+	for (idx = 0; idx < numRemoves; idx++) {
+		key = data->order[idx];
+		if (idx % sampleEvery) engine->remove( data->key(key), data->keyLength(key) );
+		else {
+			std::chrono::steady_clock::time_point opStart = std::chrono::steady_clock::now();
+			engine->remove( data->key(key), data->keyLength(key) );
+			latency.add( opStart );
+		}
+	}
+	printPhase( "remove", numRemoves, nowSec() - start, &latency );
+	
+	start = nowSec();
+	engine->clear();
+	printPhase( "clear", numKeys - numRemoves, nowSec() - start, NULL );
+	
+	printf( "  RSS after insert: %.1f MB", (double)(rssLoaded - MIN(rssLoaded, rssStart)) / (1024.0 * 1024.0) );
+	if (bytesLoaded) printf( " (%.1f MB counted by the hash)", (double)bytesLoaded / (1024.0 * 1024.0) );
+	printf( "\n" );
+	
+	delete engine;
+	(void)sink;
+}
+
+static void runBulk(BenchConfig *config, BenchData *data) {
+	// bulk insert all keys into a fresh hash with storeMany, first on one thread and then on config->threads
+	uint64_t numKeys = config->numKeys;
+	std::vector<BulkRecord> records( numKeys );
+	std::vector<unsigned char> results( numKeys );
+	unsigned int passThreads[] = { 1, config->threads };
+	char phase[32];
+	
+	for (uint64_t idx = 0; idx < numKeys; idx++) {
+		records[idx].key = data->key(idx);
+		records[idx].keyLength = data->keyLength(idx);
+		records[idx].content = data->value(idx);
+		records[idx].contentLength = data->valueLength(idx);
+	}
+	
+	printf( "\nmegahash bulk insert:\n" );
+	for (int pass = 0; pass < 2; pass++) {
+		MegaHashEngine engine( config );
+		double start = nowSec();
+		engine.hash->storeMany( &records[0], (size_t)numKeys, &results[0], passThreads[pass] );
+		snprintf( phase, sizeof(phase), "%u thread%s", passThreads[pass], (passThreads[pass] == 1) ? "" : "s" );
+		printPhase( phase, numKeys, nowSec() - start, NULL );
+	}
+}
+
+static void runIsolated(void (*run)(BenchConfig *, BenchData *), BenchConfig *config, BenchData *data) {
+	// run benchmark in a child process where possible, so memory use is measured from a clean slate
+	#ifndef _WIN32
+	fflush( stdout );
+	pid_t pid = fork();
+	if (pid == 0) {
+		run( config, data );
+		fflush( stdout );
+		_exit( 0 );
+	}
+	if (pid > 0) {
+		int status = 0;
+		waitpid( pid, &status, 0 );
+		return;
+	}
+	#endif
+	run( config, data );
+}
+
+static int parseSize(const char *spec, uint32_t *min, uint32_t *max) {
+	// parse size spec, either N or MIN-MAX
+	char *end = NULL;
+	unsigned long first = strtoul( spec, &end, 10 );
+	unsigned long second = first;
+	if (end == spec) return 0;
+	if (*end == '-') {
+		const char *rest = end + 1;
+		second = strtoul( rest, &end, 10 );
+		if (end == rest) return 0;
+	}
+	if (*end || (first > second) || (second > 0xFFFFFFFFUL)) return 0;
+	min[0] = (uint32_t)first;
+	max[0] = (uint32_t)second;
+	return 1;
+}
+
+static void usage() {
+	fprintf( stderr,
+		"Usage: megahash_bench [options]\n"
+		"  --keys N           Number of keys (default 1000000)\n"
+		"  --ops N            Lookups and replaces per phase (default: same as keys)\n"
+		"  --key-size SIZE    Key length, N or MIN-MAX (default 8-16)\n"
+		"  --value-size SIZE  Value length, N or MIN-MAX (default 96-128)\n"
+		"  --key-dist DIST    Key length distribution, uniform or log (default uniform)\n"
+		"  --value-dist DIST  Value length distribution, uniform or log (default uniform)\n"
+		"  --engine NAME      megahash, swiss, unordered_map or all (default all)\n"
+		"  --hash NAME        djb2 or wyhash (default djb2)\n"
+		"  --compress N       Compress values of at least N bytes (default off)\n"
+		"  --max-bytes N      Memory limit for megahash (default none)\n"
+		"  --sample N         Time every Nth operation for percentiles (default 8)\n"
+		"  --threads N        Also time a bulk insert on N threads (megahash only, default off)\n"
+		"  --batch N          Keys per batch for the batched hit phase (default 64)\n"
+		"  --seed N           Random seed (default 1)\n"
+	);
+}
+
+int main(int argc, char **argv) {
+	BenchConfig config;
+	
+	for (int idx = 1; idx < argc; idx++) {
+		std::string arg = argv[idx];
+		const char *value = (idx + 1 < argc) ? argv[idx + 1] : NULL;
+		if (!value) { usage(); return 1; }
+		idx++;
+		
+		if (arg == "--keys") config.numKeys = strtoull( value, NULL, 10 );
+		else if (arg == "--ops") config.numOps = strtoull( value, NULL, 10 );
+		else if (arg == "--key-size") { if (!parseSize(value, &config.keyMin, &config.keyMax)) { usage(); return 1; } }
+		else if (arg == "--value-size") { if (!parseSize(value, &config.valueMin, &config.valueMax)) { usage(); return 1; } }
+		else if (arg == "--key-dist") config.keyLog = !strcmp(value, "log");
+		else if (arg == "--value-dist") config.valueLog = !strcmp(value, "log");
+		else if (arg == "--engine") config.engine = value;
+		else if (arg == "--hash") config.hashType = !strcmp(value, "wyhash") ? MH_HASH_WYHASH : MH_HASH_DJB2;
+		else if (arg == "--compress") config.compress = (uint32_t)strtoul( value, NULL, 10 );
+		else if (arg == "--max-bytes") config.maxBytes = strtoull( value, NULL, 10 );
+		else if (arg == "--sample") config.sampleEvery = (uint32_t)strtoul( value, NULL, 10 );
+		else if (arg == "--threads") config.threads = (uint32_t)strtoul( value, NULL, 10 );
+		else if (arg == "--batch") config.batch = (uint32_t)strtoul( value, NULL, 10 );
+		else if (arg == "--seed") config.seed = strtoull( value, NULL, 10 );
+		else { usage(); return 1; }
+	}
+	if (!config.numKeys || (config.numKeys > 0x7FFFFFFF) || (config.keyMax > 0xFFFF)) { usage(); return 1; }
+	if (!config.numOps) config.numOps = config.numKeys;
+	
+	printf( "Keys: %llu, ops: %llu, key size: %u-%u%s, value size: %u-%u%s\n",
+		(unsigned long long)config.numKeys, (unsigned long long)config.numOps,
+		config.keyMin, config.keyMax, config.keyLog ? " (log)" : "",
+		config.valueMin, config.valueMax, config.valueLog ? " (log)" : "" );
+	
+	BenchData data;
+	generate( &config, &data );
+	
+	if ((config.engine == "all") || (config.engine == "megahash")) runIsolated( runEngine<MegaHashEngine>, &config, &data );
+	if ((config.engine == "all") || (config.engine == "swiss")) runIsolated( runEngine<SwissEngine>, &config, &data );
+	if ((config.engine == "all") || (config.engine == "unordered_map")) runIsolated( runEngine<MapEngine>, &config, &data );
+	if (config.threads && ((config.engine == "all") || (config.engine == "megahash"))) runIsolated( runBulk, &config, &data );
+	
+	printf( "\n" );
+	return 0;
+}
@@ -1,14 +1,44 @@
 {
+  "variables": {
+    # set MEGAHASH_BENCH=1 when building to also build the native benchmark (bench.cpp)
+    "megahash_bench%": "<!(node -p \"process.env.MEGAHASH_BENCH ? 1 : 0\")"
+  },
   "targets": [
+    {
+      # the core hash table with no Node.js dependencies, usable from any C++ program
+      "target_name": "megahash_core",
+      "type": "static_library",
+      "cflags": [ "-O3", "-fno-exceptions", "-fPIC" ],
+      "cflags_cc": [ "-O3", "-fno-exceptions", "-fPIC" ],
+      "sources": [ "MegaHash.cpp", "Arena.cpp", "Snapshot.cpp", "IntHash.cpp", "Compress.cpp" ],
+      "direct_dependent_settings": {
+        "include_dirs": [ "." ]
+      }
+    },
     {
       "target_name": "megahash",
+      "dependencies": [ "megahash_core" ],
       "cflags": [ "-O3", "-fno-exceptions" ],
       "cflags_cc": [ "-O3", "-fno-exceptions" ],
-      "sources": [ "main.cc", "hash.cc", "MegaHash.cpp" ],
+      "sources": [ "main.cc", "hash.cc", "intmap.cc", "pack.cc" ],
       "include_dirs": [
         "<!@(node -p \"require('node-addon-api').include\")"
       ],
       'defines': [ 'NAPI_DISABLE_CPP_EXCEPTIONS' ],
     }
+  ],
+  "conditions": [
+    [ "megahash_bench==1", {
+      "targets": [
+        {
+          "target_name": "megahash_bench",
+          "type": "executable",
+          "dependencies": [ "megahash_core" ],
+          "cflags": [ "-O3", "-fno-exceptions" ],
+          "cflags_cc": [ "-O3", "-fno-exceptions" ],
+          "sources": [ "bench.cpp" ]
+        }
+      ]
+    } ]
   ]
 }
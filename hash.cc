@@ -4,9 +4,540 @@
 
 #include <stdio.h>
 #include <stdint.h>
+#include <math.h>
+#include <string>
+#include <map>
+#include <mutex>
 #include "hash.h"
+#include "pack.h"
 
-Napi::FunctionReference MegaHash::constructor;
+// Registry of hashes shared between threads (see share() and attach() in main.js).
+// Each entry counts the wrappers using the hash, across all threads, and the last
+// one to be destroyed deletes the hash.  Handles are plain numbers, so they can be
+// sent to worker_threads via postMessage() or workerData.
+static std::mutex shareLock;
+static std::map<uint32_t, SharedHash> shareRegistry;
+static uint32_t nextShareId = 1;
+
+// Batch calls take many records packed into one buffer (see packKeys() and setMany() in main.js).
+// All lengths are little-endian, and each record is:
+//   keyLength (16 bits), key, [flags (8 bits), valueLength (32 bits), value]
+// where the bracketed part is only present for setMany().
+
+static uint32_t readLE(unsigned char *ptr, int numBytes) {
+	// read little-endian unsigned integer from packed buffer
+	uint32_t value = 0;
+	for (int idx = numBytes - 1; idx >= 0; idx--) value = (value << 8) | ptr[idx];
+	return value;
+}
+
+static void writeLE(unsigned char *ptr, uint32_t value, int numBytes) {
+	// write little-endian unsigned integer into packed buffer
+	for (int idx = 0; idx < numBytes; idx++) { ptr[idx] = (unsigned char)(value & 0xFF); value >>= 8; }
+}
+
+int ArgBytes::read(Napi::Env env, Napi::Value value) {
+	// point at Buffer bytes, or encode string as UTF-8
+	// returns 0 for any other type (caller throws)
+	napi_valuetype type = napi_undefined;
+	napi_typeof( env, value, &type );
+	
+	if (type == napi_string) {
+		// a char is at most 4 bytes, and napi never writes part of one, so a short enough result cannot be truncated
+		napi_get_value_string_utf8( env, value, (char *)scratch, MH_SCRATCH_SIZE, &length );
+		if (length + 4 < MH_SCRATCH_SIZE) {
+			data = scratch;
+			return 1;
+		}
+		
+		napi_get_value_string_utf8( env, value, NULL, 0, &length );
+		heap.resize( length );
+		napi_get_value_string_utf8( env, value, &heap[0], length + 1, &length );
+		data = (unsigned char *)&heap[0];
+		return 1;
+	}
+	
+	if (!value.IsBuffer()) return 0;
+	Napi::Buffer<unsigned char> buf = value.As<Napi::Buffer<unsigned char>>();
+	data = buf.Data();
+	length = buf.Length();
+	return 1;
+}
+
+static int readKeyArg(Napi::Env env, Napi::Value value, ArgBytes *key) {
+	// read key from JS string or Buffer, throws TypeError and returns 0 if it is neither
+	if (key->read(env, value)) return 1;
+	Napi::TypeError::New(env, "Key must be a string or Buffer").ThrowAsJavaScriptException();
+	return 0;
+}
+
+static int readValueArg(Napi::Env env, Napi::Value value, ArgBytes *valueArg, unsigned char *flags, std::string &packed) {
+	// read value from JS string or Buffer, throws TypeError and returns 0 if it is neither
+	// objects arrive as JSON strings, which are packed right here (or kept as JSON if that fails)
+	if (!valueArg->read(env, value)) {
+		Napi::TypeError::New(env, "Value must be a string or Buffer").ThrowAsJavaScriptException();
+		return 0;
+	}
+	if ((flags[0] == MH_TYPE_PACKED) && value.IsString()) {
+		if (packJSON((const char *)valueArg->data, valueArg->length, packed)) {
+			valueArg->data = (unsigned char *)packed.data();
+			valueArg->length = packed.size();
+		}
+		else flags[0] = MH_TYPE_OBJECT;
+	}
+	return 1;
+}
+
+static uint64_t readBE64(const unsigned char *ptr) {
+	// read big-endian 64-bit value, as main.js writes Numbers and BigInts
+	uint64_t value = 0;
+	for (int idx = 0; idx < 8; idx++) value = (value << 8) | ptr[idx];
+	return value;
+}
+
+static void writeBE64(unsigned char *ptr, uint64_t value) {
+	// write big-endian 64-bit value
+	for (int idx = 7; idx >= 0; idx--) { ptr[idx] = (unsigned char)(value & 0xFF); value >>= 8; }
+}
+
+class IncrModifier : public Modifier {
+public:
+	// add delta to a Number or BigInt value (see incr), missing keys start at 0 in the type of delta
+	// BigInts wrap around at 64 bits, like BigInt.asIntN(64)
+	unsigned char deltaType; /**< MH_TYPE_NUMBER or MH_TYPE_BIGINT. */
+	double delta;
+	int64_t bigDelta;
+	const char *err; /**< Why the value could not be incremented, if it could not. */
+	
+	IncrModifier() {
+		deltaType = MH_TYPE_NUMBER;
+		delta = 0;
+		bigDelta = 0;
+		err = NULL;
+	}
+	
+	int apply() {
+		unsigned char type = deltaType;
+		uint64_t bits = 0;
+		
+		if (current.result == MH_OK) {
+			type = current.flags;
+			if (((type != MH_TYPE_NUMBER) && (type != MH_TYPE_BIGINT)) || (current.contentLength != 8)) {
+				err = "Value is not a Number or BigInt";
+				return 0;
+			}
+			bits = readBE64( current.content );
+		}
+		
+		if (type == MH_TYPE_NUMBER) {
+			double num = 0;
+			if (current.result == MH_OK) memcpy( (void *)&num, (void *)&bits, sizeof(double) );
+			num += (deltaType == MH_TYPE_NUMBER) ? delta : (double)bigDelta;
+			memcpy( (void *)&bits, (void *)&num, sizeof(double) );
+		}
+		else if (deltaType == MH_TYPE_BIGINT) bits += (uint64_t)bigDelta;
+		else if ((delta == floor(delta)) && (fabs(delta) < 9007199254740992.0)) bits += (uint64_t)(int64_t)delta;
+		else {
+			err = "Delta must be a safe integer to add to a BigInt";
+			return 0;
+		}
+		
+		value.resize( 8 );
+		writeBE64( (unsigned char *)&value[0], bits );
+		flags = type;
+		return 1;
+	}
+};
+
+class AppendModifier : public Modifier {
+public:
+	// append bytes to a string or Buffer value (see append), missing keys start empty in the type of data
+	unsigned char *data;
+	size_t length;
+	unsigned char dataType; /**< MH_TYPE_STRING or MH_TYPE_BUFFER. */
+	const char *err;
+	
+	AppendModifier() {
+		data = NULL;
+		length = 0;
+		dataType = MH_TYPE_BUFFER;
+		err = NULL;
+	}
+	
+	int apply() {
+		flags = dataType;
+		value.clear();
+		
+		if (current.result == MH_OK) {
+			if ((current.flags != MH_TYPE_STRING) && (current.flags != MH_TYPE_BUFFER)) {
+				err = "Value is not a string or Buffer";
+				return 0;
+			}
+			if ((uint64_t)current.contentLength + length > (uint64_t)MH_MAX_VALUE_LENGTH) {
+				err = "Value would be too long";
+				return 0;
+			}
+			flags = current.flags;
+			value.reserve( current.contentLength + length );
+			value.append( (char *)current.content, current.contentLength );
+		}
+		
+		value.append( (char *)data, length );
+		return 1;
+	}
+};
+
+class SwapModifier : public Modifier {
+public:
+	// store new value only if the key is missing (setIfAbsent), or if the current value has the
+	// same type and bytes as expected (compareAndSet)
+	int ifAbsent;
+	unsigned char *expected;
+	size_t expectedLength;
+	unsigned char expectedFlags;
+	unsigned char *newValue;
+	size_t newLength;
+	unsigned char newFlags;
+	uint64_t newExpires;
+	
+	SwapModifier() {
+		ifAbsent = 0;
+		expected = NULL;
+		expectedLength = 0;
+		expectedFlags = 0;
+		newValue = NULL;
+		newLength = 0;
+		newFlags = 0;
+		newExpires = 0;
+	}
+	
+	int apply() {
+		if (ifAbsent) {
+			if (current.result == MH_OK) return 0;
+		}
+		else if ((current.result != MH_OK) || (current.flags != expectedFlags) || (current.contentLength != expectedLength)) return 0;
+		else if (expectedLength && memcmp( (void *)current.content, (void *)expected, expectedLength )) return 0;
+		
+		value.assign( (char *)newValue, newLength );
+		flags = newFlags;
+		expires = newExpires;
+		return 1;
+	}
+};
+
+static Napi::Value newValue(Napi::Env env, unsigned char *content, MH_LEN_T contentLength, unsigned char flags) {
+	// string and packed object values are converted right here,
+	// everything else goes back as a Buffer copy with flags, for main.js to decode
+	if (flags == MH_TYPE_STRING) return Napi::String::New( env, (const char *)content, contentLength );
+	if (flags == MH_TYPE_PACKED) return unpackValue( env, content, contentLength );
+	
+	Napi::Buffer<unsigned char> valueBuf = Napi::Buffer<unsigned char>::Copy( env, content, contentLength );
+	if (!valueBuf) return env.Undefined();
+	
+	if (flags) valueBuf.Set( "flags", (double)flags );
+	return valueBuf;
+}
+
+static Napi::Value corruptValue(Napi::Env env) {
+	// throw for a compressed value that could not be decoded, returns undefined
+	Napi::Error::New(env, "Compressed value is corrupt").ThrowAsJavaScriptException();
+	return env.Undefined();
+}
+
+static Napi::Value storeFailed(Napi::Env env, Modifier *modifier) {
+	// throw for a read-modify-write that could not store its new value, returns undefined
+	if (modifier->current.flags & MH_FLAG_COMPRESSED) return corruptValue( env );
+	Napi::Error::New(env, "Not enough memory to store value").ThrowAsJavaScriptException();
+	return env.Undefined();
+}
+
+static Napi::Array histogramArray(Napi::Env env, uint64_t *counts, int numSlots) {
+	// convert histogram to array, dropping empty slots off the end
+	int length = numSlots;
+	while (length && !counts[length - 1]) length--;
+	
+	Napi::Array array = Napi::Array::New(env, length);
+	for (int idx = 0; idx < length; idx++) array.Set( idx, (double)counts[idx] );
+	return array;
+}
+
+static Napi::Object latencyObject(Napi::Env env, std::atomic<uint64_t> *slots) {
+	// summarize one latency histogram: sample count, percentiles and [upper bound ns, count] pairs
+	// (percentiles are the upper bound of the slot they fall in, so they read high by up to 25%)
+	uint64_t counts[ MH_LATENCY_SLOTS ];
+	uint64_t total = 0;
+	for (int idx = 0; idx < MH_LATENCY_SLOTS; idx++) total += (counts[idx] = slots[idx].load(std::memory_order_relaxed));
+	
+	Napi::Object obj = Napi::Object::New(env);
+	Napi::Array pairs = Napi::Array::New(env);
+	obj.Set( "samples", (double)total );
+	
+	static const char *names[] = { "p50", "p90", "p99", "p999", "max" };
+	static const double fractions[] = { 0.5, 0.9, 0.99, 0.999, 1.0 };
+	int next = 0;
+	uint64_t seen = 0;
+	
+	for (int idx = 0; idx < MH_LATENCY_SLOTS; idx++) {
+		if (!counts[idx]) continue;
+		seen += counts[idx];
+		
+		Napi::Array pair = Napi::Array::New(env, 2);
+		pair.Set( (uint32_t)0, (double)Instrument::latencyUpper(idx) );
+		pair.Set( (uint32_t)1, (double)counts[idx] );
+		pairs.Set( pairs.Length(), pair );
+		
+		while ((next < 5) && ((double)seen >= fractions[next] * (double)total)) {
+			obj.Set( names[next++], (double)Instrument::latencyUpper(idx) );
+		}
+	}
+	for (; next < 5; next++) obj.Set( names[next], 0.0 );
+	
+	obj.Set( "histogram", pairs );
+	return obj;
+}
+
+static int unpackKey(unsigned char *data, size_t length, size_t *offset, unsigned char **key, MH_KLEN_T *keyLength) {
+	// read one length-prefixed key from packed buffer, advancing offset
+	// returns 0 if the buffer is truncated
+	if (offset[0] + MH_KLEN_SIZE > length) return 0;
+	keyLength[0] = (MH_KLEN_T)readLE( data + offset[0], MH_KLEN_SIZE );
+	offset[0] += MH_KLEN_SIZE;
+	
+	if (offset[0] + keyLength[0] > length) return 0;
+	key[0] = data + offset[0];
+	offset[0] += keyLength[0];
+	return 1;
+}
+
+static int storePacked(Hash *hash, unsigned char *data, size_t length, uint32_t count, unsigned char *results, unsigned int numThreads) {
+	// store all packed key/value records using up to numThreads threads, with result code for each one
+	// returns 0 if the buffer is truncated (nothing is stored, as the whole buffer is checked first)
+	std::vector<BulkRecord> records( count );
+	size_t offset = 0;
+	
+	for (uint32_t idx = 0; idx < count; idx++) {
+		BulkRecord *record = &records[idx];
+		if (!unpackKey(data, length, &offset, &record->key, &record->keyLength) || (offset + 1 + MH_LEN_SIZE > length)) return 0;
+		
+		record->flags = data[offset]; offset++;
+		record->contentLength = (MH_LEN_T)readLE( data + offset, MH_LEN_SIZE ); offset += MH_LEN_SIZE;
+		
+		if (offset + record->contentLength > length) return 0;
+		record->content = data + offset; offset += record->contentLength;
+	}
+	
+	// storeMany locks each stripe itself in concurrent mode
+	if (count) hash->storeMany( &records[0], count, results, numThreads );
+	return 1;
+}
+
+static void packRecord(std::string &out, unsigned char *key, MH_KLEN_T keyLength, unsigned char flags, unsigned char *value, MH_LEN_T valueLength) {
+	// append one key/value record to packed output, same layout as setMany() input
+	unsigned char header[ MH_LEN_SIZE ];
+	
+	writeLE( header, keyLength, MH_KLEN_SIZE );
+	out.append( (char *)header, MH_KLEN_SIZE );
+	out.append( (char *)key, keyLength );
+	out.push_back( (char)flags );
+	writeLE( header, valueLength, MH_LEN_SIZE );
+	out.append( (char *)header, MH_LEN_SIZE );
+	out.append( (char *)value, valueLength );
+}
+
+static void readCursor(unsigned char *state, Cursor *cursor) {
+	// load cursor from JS-owned state buffer (MH_CURSOR_STATE_SIZE bytes)
+	cursor->lastOrder = ((uint64_t)readLE(state + 4, 4) << 32) | (uint64_t)readLE(state, 4);
+	cursor->started = state[8];
+	cursor->done = state[9];
+}
+
+static void writeCursor(unsigned char *state, Cursor *cursor) {
+	// save cursor back into JS-owned state buffer
+	writeLE( state, (uint32_t)(cursor->lastOrder & 0xFFFFFFFF), 4 );
+	writeLE( state + 4, (uint32_t)(cursor->lastOrder >> 32), 4 );
+	state[8] = cursor->started;
+	state[9] = cursor->done;
+}
+
+static uint32_t packCursorBatch(Hash *hash, Cursor *cursor, uint32_t batchSize, int withValues, std::string &out) {
+	// gather next batch for cursor and pack it, returns number of records
+	// with values, records are the same layout as setMany() input, otherwise just length-prefixed keys
+	std::vector<Bucket *> buckets;
+	unsigned char header[ MH_KLEN_SIZE ];
+	std::string expanded;
+	
+	// buckets point into the hash, so hold the whole hash read locked until they are copied out
+	HashGuard guard( hash, 0 );
+	hash->cursorNext( cursor, batchSize ? batchSize : 1, &buckets );
+	uint64_t now = Hash::nowMS();
+	uint32_t count = 0;
+	
+	for (size_t idx = 0; idx < buckets.size(); idx++) {
+		Bucket *bucket = buckets[idx];
+		if (hash->bucketExpired(bucket, now)) continue;
+		
+		if (withValues) {
+			// compressed values are expanded, so records always hold the original value
+			// (one that cannot be decoded is left out, as there is no way to report it from here)
+			Response resp;
+			resp.content = hash->bucketGetContent(bucket);
+			resp.contentLength = hash->bucketGetContentLength(bucket);
+			resp.flags = bucket->type & (MH_FLAGS_VALUE | MH_FLAG_COMPRESSED);
+			if (!hash->expand( &resp, &expanded )) continue;
+			
+			count++;
+			packRecord( out, hash->bucketGetKey(bucket), hash->bucketGetKeyLength(bucket), resp.flags, resp.content, resp.contentLength );
+		}
+		else {
+			count++;
+			writeLE( header, hash->bucketGetKeyLength(bucket), MH_KLEN_SIZE );
+			out.append( (char *)header, MH_KLEN_SIZE );
+			out.append( (char *)hash->bucketGetKey(bucket), hash->bucketGetKeyLength(bucket) );
+		}
+	}
+	
+	return count;
+}
+
+class MegaHashWorker : public Napi::AsyncWorker {
+public:
+	// base class for async operations, which run against the hash on the libuv threadpool
+	// the wrapper is marked busy (sync calls throw) and kept alive until the operation completes
+	// resolves or rejects a promise when done
+	MegaHash *owner;
+	Hash *hash;
+	Napi::ObjectReference ownerRef;
+	Napi::Promise::Deferred deferred;
+	
+	MegaHashWorker(MegaHash *newOwner, const Napi::CallbackInfo& info) : Napi::AsyncWorker(info.Env()), deferred(Napi::Promise::Deferred::New(info.Env())) {
+		owner = newOwner;
+		hash = owner->hash;
+		ownerRef = Napi::Persistent( info.This().As<Napi::Object>() );
+		owner->asyncBusy = 1;
+	}
+	
+	virtual Napi::Value Result() {
+		// value to resolve promise with (runs on main thread)
+		return Env().Undefined();
+	}
+	
+	void OnOK() {
+		owner->asyncBusy = 0;
+		deferred.Resolve( Result() );
+	}
+	
+	void OnError(const Napi::Error& err) {
+		owner->asyncBusy = 0;
+		deferred.Reject( err.Value() );
+	}
+};
+
+class ClearWorker : public MegaHashWorker {
+public:
+	// clear all keys off the main thread
+	ClearWorker(MegaHash *newOwner, const Napi::CallbackInfo& info) : MegaHashWorker(newOwner, info) {}
+	
+	void Execute() {
+		HashGuard guard( hash, 1 );
+		hash->clear();
+	}
+};
+
+class SetManyWorker : public MegaHashWorker {
+public:
+	// store packed key/value records off the main thread (see setMany)
+	Napi::ObjectReference packedRef;
+	unsigned char *data;
+	size_t length;
+	uint32_t count;
+	uint32_t numThreads;
+	std::string results;
+	
+	SetManyWorker(MegaHash *newOwner, const Napi::CallbackInfo& info) : MegaHashWorker(newOwner, info) {
+		// keep packed buffer alive while we read it from the threadpool
+		Napi::Buffer<unsigned char> packedBuf = info[0].As<Napi::Buffer<unsigned char>>();
+		packedRef = Napi::Persistent( packedBuf.As<Napi::Object>() );
+		data = packedBuf.Data();
+		length = packedBuf.Length();
+		count = info[1].As<Napi::Number>().Uint32Value();
+		numThreads = info[2].As<Napi::Number>().Uint32Value();
+	}
+	
+	void Execute() {
+		results.resize( count );
+		if (count && !storePacked(hash, data, length, count, (unsigned char *)&results[0], numThreads)) {
+			SetError( "Packed buffer is truncated" );
+		}
+	}
+	
+	Napi::Value Result() {
+		return Napi::Buffer<unsigned char>::Copy( Env(), (unsigned char *)results.data(), results.size() );
+	}
+};
+
+class ScanWorker : public MegaHashWorker {
+public:
+	// gather one batch of key/value records off the main thread, resuming from a cursor state buffer
+	// records are packed the same as setMany() input, and an empty buffer means the end
+	Napi::ObjectReference stateRef;
+	Cursor cursor;
+	uint32_t batchSize;
+	uint32_t count;
+	std::string out;
+	
+	ScanWorker(MegaHash *newOwner, const Napi::CallbackInfo& info) : MegaHashWorker(newOwner, info) {
+		// cursor is copied in here and written back in Result(), so the state buffer is only touched on the main thread
+		Napi::Buffer<unsigned char> stateBuf = info[0].As<Napi::Buffer<unsigned char>>();
+		stateRef = Napi::Persistent( stateBuf.As<Napi::Object>() );
+		readCursor( stateBuf.Data(), &cursor );
+		batchSize = info[1].As<Napi::Number>().Uint32Value();
+		count = 0;
+	}
+	
+	void Execute() {
+		count = packCursorBatch( hash, &cursor, batchSize, 1, out );
+	}
+	
+	Napi::Value Result() {
+		writeCursor( stateRef.Value().As<Napi::Buffer<unsigned char>>().Data(), &cursor );
+		Napi::Buffer<unsigned char> outBuf = Napi::Buffer<unsigned char>::Copy( Env(), (unsigned char *)out.data(), out.size() );
+		outBuf.Set( "count", (double)count );
+		return outBuf;
+	}
+};
+
+class SaveWorker : public MegaHashWorker {
+public:
+	// write snapshot file off the main thread (see Hash::save)
+	std::string path;
+	
+	SaveWorker(MegaHash *newOwner, const Napi::CallbackInfo& info) : MegaHashWorker(newOwner, info) {
+		path = info[0].As<Napi::String>().Utf8Value();
+	}
+	
+	void Execute() {
+		HashGuard guard( hash, 0 );
+		const char *err = hash->save( path.c_str() );
+		if (err) SetError( err );
+	}
+};
+
+class LoadWorker : public MegaHashWorker {
+public:
+	// read snapshot file into empty hash off the main thread (see Hash::load)
+	std::string path;
+	uint32_t numThreads;
+	
+	LoadWorker(MegaHash *newOwner, const Napi::CallbackInfo& info) : MegaHashWorker(newOwner, info) {
+		path = info[0].As<Napi::String>().Utf8Value();
+		numThreads = info[1].As<Napi::Number>().Uint32Value();
+	}
+	
+	void Execute() {
+		const char *err = hash->load( path.c_str(), numThreads );
+		if (err) SetError( err );
+	}
+};
 
 Napi::Object MegaHash::Init(Napi::Env env, Napi::Object exports) {
 	// initialize class
@@ -15,69 +546,292 @@ Napi::Object MegaHash::Init(Napi::Env env, Napi::Object exports) {
 	Napi::Function func = DefineClass(env, "MegaHash", {
 		InstanceMethod("_set", &MegaHash::Set),
 		InstanceMethod("_get", &MegaHash::Get),
+		InstanceMethod("_getInto", &MegaHash::GetInto),
+		InstanceMethod("_getView", &MegaHash::GetView),
+		InstanceMethod("_getField", &MegaHash::GetField),
 		InstanceMethod("_has", &MegaHash::Has),
 		InstanceMethod("_remove", &MegaHash::Remove),
+		InstanceMethod("_incr", &MegaHash::Incr),
+		InstanceMethod("_append", &MegaHash::Append),
+		InstanceMethod("_compareAndSet", &MegaHash::CompareAndSet),
+		InstanceMethod("_setIfAbsent", &MegaHash::SetIfAbsent),
 		InstanceMethod("clear", &MegaHash::Clear),
+		InstanceMethod("compact", &MegaHash::Compact),
+		InstanceMethod("sweep", &MegaHash::Sweep),
 		InstanceMethod("stats", &MegaHash::Stats),
 		InstanceMethod("_firstKey", &MegaHash::FirstKey),
-		InstanceMethod("_nextKey", &MegaHash::NextKey)
+		InstanceMethod("_nextKey", &MegaHash::NextKey),
+		InstanceMethod("_cursorNext", &MegaHash::CursorNext),
+		InstanceMethod("_setMany", &MegaHash::SetMany),
+		InstanceMethod("_getMany", &MegaHash::GetMany),
+		InstanceMethod("_hasMany", &MegaHash::HasMany),
+		InstanceMethod("_removeMany", &MegaHash::RemoveMany),
+		InstanceMethod("_share", &MegaHash::Share),
+		InstanceMethod("clearAsync", &MegaHash::ClearAsync),
+		InstanceMethod("_setManyAsync", &MegaHash::SetManyAsync),
+		InstanceMethod("_scanAsync", &MegaHash::ScanAsync),
+		InstanceMethod("_save", &MegaHash::Save),
+		InstanceMethod("_load", &MegaHash::Load),
+		InstanceMethod("_saveAsync", &MegaHash::SaveAsync),
+		InstanceMethod("_loadAsync", &MegaHash::LoadAsync),
+		StaticMethod("_pack", &MegaHash::Pack),
+		StaticMethod("_unpack", &MegaHash::Unpack)
 	});
 	
-	constructor = Napi::Persistent(func);
- 	constructor.SuppressDestruct();
- 	
 	exports.Set("MegaHash", func);
 	return exports;
 }
 
 MegaHash::MegaHash(const Napi::CallbackInfo& info) : Napi::ObjectWrap<MegaHash>(info) {
-	// construct new hash table
+	// construct new hash table, or attach to one shared by another thread
 	Napi::Env env = info.Env();
 	Napi::HandleScope scope(env);
 	
+	// optional options object, e.g. { hash: "wyhash" }
+	unsigned char hashType = MH_HASH_DJB2;
+	int badHashType = 0;
+	unsigned char engine = MH_ENGINE_CHAIN;
+	int badEngine = 0;
+	int concurrent = 0;
+	uint32_t attachId = 0;
+	uint64_t maxBytes = 0;
+	uint32_t compressMin = 0;
+	int instrument = 0;
+	Napi::Buffer<unsigned char> dictBuf;
+	
+	this->hash = NULL;
+	this->shareId = 0;
+	this->asyncBusy = 0;
+	
+	// the default engine can come from the environment, so a whole test suite can run against either one
+	const char *engineEnv = getenv("MEGAHASH_ENGINE");
+	std::string engineName = engineEnv ? engineEnv : "";
+	
+	if ((info.Length() > 0) && info[0].IsObject()) {
+		Napi::Object opts = info[0].As<Napi::Object>();
+		
+		if (opts.Has("hash") && !opts.Get("hash").IsUndefined()) {
+			std::string hashName = opts.Get("hash").ToString().Utf8Value();
+			if (hashName == "wyhash") hashType = MH_HASH_WYHASH;
+			else if (hashName != "djb2") badHashType = 1;
+		}
+		if (opts.Has("engine") && !opts.Get("engine").IsUndefined()) {
+			engineName = opts.Get("engine").ToString().Utf8Value();
+		}
+		if (opts.Has("concurrent")) {
+			concurrent = opts.Get("concurrent").ToBoolean() ? 1 : 0;
+		}
+		if (opts.Has("maxBytes") && opts.Get("maxBytes").IsNumber()) {
+			int64_t value = opts.Get("maxBytes").As<Napi::Number>().Int64Value();
+			if (value > 0) maxBytes = (uint64_t)value;
+		}
+		if (opts.Has("compress")) {
+			// true for the default threshold, or the smallest value length to compress
+			Napi::Value value = opts.Get("compress");
+			if (value.IsNumber()) compressMin = MAX( 1, value.As<Napi::Number>().Uint32Value() );
+			else if (value.ToBoolean()) compressMin = MH_COMPRESS_MIN_LENGTH;
+		}
+		if (opts.Has("dictionary") && opts.Get("dictionary").IsBuffer()) {
+			// a dictionary turns compression on by itself
+			dictBuf = opts.Get("dictionary").As<Napi::Buffer<unsigned char>>();
+			if (!compressMin && !opts.Has("compress")) compressMin = MH_COMPRESS_MIN_LENGTH;
+		}
+		if (opts.Has("instrument")) {
+			instrument = opts.Get("instrument").ToBoolean() ? 1 : 0;
+		}
+		if (opts.Has("attach") && opts.Get("attach").IsNumber()) {
+			attachId = opts.Get("attach").As<Napi::Number>().Uint32Value();
+		}
+	}
+	
+	if (engineName == "swiss") engine = MH_ENGINE_SWISS;
+	else if (!engineName.empty() && (engineName != "chain")) badEngine = 1;
+	
+	if (attachId) {
+		// attach to existing shared hash
+		shareLock.lock();
+		std::map<uint32_t, SharedHash>::iterator iter = shareRegistry.find( attachId );
+		if (iter != shareRegistry.end()) {
+			iter->second.refs++;
+			this->hash = iter->second.hash;
+			this->shareId = attachId;
+		}
+		shareLock.unlock();
+		
+		if (!this->hash) {
+			// still need a hash so the wrapper is safe to use and destroy
+			this->hash = new Hash( 8, 16, hashType );
+			Napi::Error::New(env, "Unknown or expired shared hash handle").ThrowAsJavaScriptException();
+		}
+		return;
+	}
+	
 	// 8 buckets per list with 16 scatter is about the perfect balance of speed and memory
 	// FUTURE: Make this configurable from Node.js side?
-	this->hash = new Hash( 8, 16 );
+	this->hash = new Hash( 8, 16, hashType );
+	if (engine != MH_ENGINE_CHAIN) this->hash->setEngine( engine );
+	if (maxBytes) this->hash->setMaxBytes( maxBytes );
+	if (instrument) this->hash->setInstrument();
+	if (compressMin) this->hash->setCompression( compressMin, dictBuf.IsEmpty() ? NULL : dictBuf.Data(), dictBuf.IsEmpty() ? 0 : dictBuf.Length() );
+	if (concurrent) this->hash->setConcurrent();
+	
+	if (badHashType) {
+		Napi::Error::New(env, "Unknown hash algorithm (expected djb2 or wyhash)").ThrowAsJavaScriptException();
+	}
+	else if (badEngine) {
+		Napi::Error::New(env, "Unknown engine (expected chain or swiss)").ThrowAsJavaScriptException();
+	}
 }
 
 MegaHash::~MegaHash() {
 	// cleanup and free memory
-	delete this->hash;
+	// shared hashes are only deleted when the last thread lets go of them
+	if (this->shareId) {
+		int lastRef = 0;
+		
+		shareLock.lock();
+		std::map<uint32_t, SharedHash>::iterator iter = shareRegistry.find( this->shareId );
+		if ((iter != shareRegistry.end()) && !(--iter->second.refs)) {
+			shareRegistry.erase( iter );
+			lastRef = 1;
+		}
+		shareLock.unlock();
+		
+		if (lastRef) delete this->hash;
+	}
+	else delete this->hash;
+}
+
+Napi::Value MegaHash::Share(const Napi::CallbackInfo& info) {
+	// switch hash to concurrent mode and register it for other threads, return numeric handle
+	// the hash stays alive as long as any thread has a wrapper attached to it
+	Napi::Env env = info.Env();
+	if (isBusy(env)) return env.Undefined();
+	
+	if (!this->shareId) {
+		this->hash->setConcurrent();
+		
+		shareLock.lock();
+		this->shareId = nextShareId++;
+		if (!nextShareId) nextShareId = 1;
+		shareRegistry[ this->shareId ] = SharedHash( this->hash );
+		shareLock.unlock();
+	}
+	
+	return Napi::Number::New(env, (double)this->shareId);
 }
 
 Napi::Value MegaHash::Set(const Napi::CallbackInfo& info) {
 	// store key/value pair, no return value
 	Napi::Env env = info.Env();
+	if (isBusy(env)) return env.Undefined();
 	
-	Napi::Buffer<unsigned char> keyBuf = info[0].As<Napi::Buffer<unsigned char>>();
-	unsigned char *key = keyBuf.Data();
-	MH_KLEN_T keyLength = (MH_KLEN_T)keyBuf.Length();
-	
-	Napi::Buffer<unsigned char> valueBuf = info[1].As<Napi::Buffer<unsigned char>>();
-	unsigned char *value = valueBuf.Data();
-	MH_LEN_T valueLength = (MH_LEN_T)valueBuf.Length();
+	ArgBytes keyArg;
+	if (!readKeyArg(env, info[0], &keyArg)) return env.Undefined();
+	unsigned char *key = keyArg.data;
+	MH_KLEN_T keyLength = (MH_KLEN_T)keyArg.length;
 	
 	unsigned char flags = 0;
 	if (info.Length() > 2) {
 		flags = (unsigned char)info[2].As<Napi::Number>().Uint32Value();
 	}
 	
-	Response resp = this->hash->store( key, keyLength, value, valueLength, flags );
+	ArgBytes valueArg;
+	std::string packed;
+	if (!readValueArg(env, info[1], &valueArg, &flags, packed)) return env.Undefined();
+	unsigned char *value = valueArg.data;
+	MH_LEN_T valueLength = (MH_LEN_T)valueArg.length;
+	
+	// optional expiry time in ms since epoch
+	uint64_t expires = 0;
+	if ((info.Length() > 3) && info[3].IsNumber()) {
+		expires = (uint64_t)info[3].As<Napi::Number>().Int64Value();
+	}
+	
+	HashGuard guard( this->hash, key, keyLength, 1 );
+	Response resp = this->hash->store( key, keyLength, value, valueLength, flags, expires );
 	return Napi::Number::New(env, (double)resp.result);
 }
 
 Napi::Value MegaHash::Get(const Napi::CallbackInfo& info) {
 	// fetch value given key
 	Napi::Env env = info.Env();
+	if (isBusy(env)) return env.Undefined();
+	
+	ArgBytes keyArg;
+	if (!readKeyArg(env, info[0], &keyArg)) return env.Undefined();
+	unsigned char *key = keyArg.data;
+	MH_KLEN_T keyLength = (MH_KLEN_T)keyArg.length;
+	
+	HashGuard guard( this->hash, key, keyLength, 0 );
+	Response resp = this->hash->fetch( key, keyLength );
+	if (resp.result != MH_OK) return env.Undefined();
+	
+	std::string expanded;
+	if (!this->hash->expand( &resp, &expanded )) return corruptValue( env );
+	return newValue( env, resp.content, resp.contentLength, resp.flags );
+}
+
+Napi::Value MegaHash::GetInto(const Napi::CallbackInfo& info) {
+	// fetch value given key, copy into caller's buffer at offset (no allocation)
+	// returns value length, or -1 if not found
+	// if the value does not fit, nothing is copied (caller can check length and retry)
+	Napi::Env env = info.Env();
+	if (isBusy(env)) return env.Undefined();
+	
+	ArgBytes keyArg;
+	if (!readKeyArg(env, info[0], &keyArg)) return env.Undefined();
+	unsigned char *key = keyArg.data;
+	MH_KLEN_T keyLength = (MH_KLEN_T)keyArg.length;
 	
-	Napi::Buffer<unsigned char> keyBuf = info[0].As<Napi::Buffer<unsigned char>>();
-	unsigned char *key = keyBuf.Data();
-	MH_KLEN_T keyLength = (MH_KLEN_T)keyBuf.Length();
+	Napi::Buffer<unsigned char> targetBuf = info[1].As<Napi::Buffer<unsigned char>>();
+	size_t offset = 0;
+	if (info.Length() > 2) {
+		offset = (size_t)info[2].As<Napi::Number>().Uint32Value();
+	}
+	if (offset > targetBuf.Length()) {
+		Napi::RangeError::New(env, "Offset is outside target buffer").ThrowAsJavaScriptException();
+		return env.Undefined();
+	}
 	
+	HashGuard guard( this->hash, key, keyLength, 0 );
+	Response resp = this->hash->fetch( key, keyLength );
+	if (resp.result != MH_OK) return Napi::Number::New(env, -1);
+	
+	// compressed values are decompressed straight into the target
+	MH_LEN_T valueLength = this->hash->valueLength( &resp );
+	if (valueLength <= targetBuf.Length() - offset) {
+		if (!this->hash->valueCopy( &resp, targetBuf.Data() + offset )) return corruptValue( env );
+	}
+	
+	return Napi::Number::New(env, (double)valueLength);
+}
+
+Napi::Value MegaHash::GetView(const Napi::CallbackInfo& info) {
+	// fetch value given key, return external buffer pointing straight at hash memory (no copy)
+	// this is only valid until the key is next set, removed or cleared, so the caller
+	// must not mutate the hash while holding it, and must never write to it
+	Napi::Env env = info.Env();
+	if (isBusy(env)) return env.Undefined();
+	
+	ArgBytes keyArg;
+	if (!readKeyArg(env, info[0], &keyArg)) return env.Undefined();
+	unsigned char *key = keyArg.data;
+	MH_KLEN_T keyLength = (MH_KLEN_T)keyArg.length;
+	
+	HashGuard guard( this->hash, key, keyLength, 0 );
 	Response resp = this->hash->fetch( key, keyLength );
 	
 	if (resp.result == MH_OK) {
-		Napi::Buffer<unsigned char> valueBuf = Napi::Buffer<unsigned char>::Copy( env, resp.content, resp.contentLength );
+		// memory is owned by the hash, so no finalizer is needed
+		// (compressed values have to be expanded, so they are returned as a copy instead)
+		Napi::Buffer<unsigned char> valueBuf;
+		if (resp.flags & MH_FLAG_COMPRESSED) {
+			valueBuf = Napi::Buffer<unsigned char>::New( env, this->hash->valueLength(&resp) );
+			if (!this->hash->valueCopy( &resp, valueBuf.Data() )) return corruptValue( env );
+			resp.flags &= ~MH_FLAG_COMPRESSED;
+		}
+		else valueBuf = Napi::Buffer<unsigned char>::New( env, resp.content, resp.contentLength );
 		if (!valueBuf) return env.Undefined();
 		
 		if (resp.flags) valueBuf.Set( "flags", (double)resp.flags );
@@ -86,14 +840,64 @@ Napi::Value MegaHash::Get(const Napi::CallbackInfo& info) {
 	else return env.Undefined();
 }
 
+Napi::Value MegaHash::GetField(const Napi::CallbackInfo& info) {
+	// fetch one field of an object value, given path as array of map keys and array indexes (as strings)
+	// packed values are walked in place, and only the field is converted
+	// JSON values (stored before packing, or which could not be packed) are returned whole, for main.js to walk
+	Napi::Env env = info.Env();
+	if (isBusy(env)) return env.Undefined();
+	
+	ArgBytes keyArg;
+	if (!readKeyArg(env, info[0], &keyArg)) return env.Undefined();
+	unsigned char *key = keyArg.data;
+	MH_KLEN_T keyLength = (MH_KLEN_T)keyArg.length;
+	
+	Napi::Array pathArray = info[1].As<Napi::Array>();
+	std::vector<std::string> path;
+	for (uint32_t idx = 0; idx < pathArray.Length(); idx++) {
+		path.push_back( pathArray.Get(idx).ToString().Utf8Value() );
+	}
+	
+	HashGuard guard( this->hash, key, keyLength, 0 );
+	Response resp = this->hash->fetch( key, keyLength );
+	if (resp.result != MH_OK) return env.Undefined();
+	
+	std::string expanded;
+	if (!this->hash->expand( &resp, &expanded )) return corruptValue( env );
+	
+	if (resp.flags == MH_TYPE_PACKED) return unpackField( env, resp.content, resp.contentLength, path );
+	if (resp.flags == MH_TYPE_OBJECT) return newValue( env, resp.content, resp.contentLength, resp.flags );
+	return env.Undefined();
+}
+
+Napi::Value MegaHash::Pack(const Napi::CallbackInfo& info) {
+	// pack JSON string into a new Buffer, for batch calls (see encodeValue in main.js)
+	// returns undefined if it has to be stored as JSON
+	Napi::Env env = info.Env();
+	ArgBytes json;
+	std::string packed;
+	if (!json.read(env, info[0]) || !packJSON((const char *)json.data, json.length, packed)) return env.Undefined();
+	return Napi::Buffer<unsigned char>::Copy( env, (unsigned char *)packed.data(), packed.size() );
+}
+
+Napi::Value MegaHash::Unpack(const Napi::CallbackInfo& info) {
+	// convert packed Buffer back into object, for batch calls (see decodeValue in main.js)
+	Napi::Env env = info.Env();
+	Napi::Buffer<unsigned char> packedBuf = info[0].As<Napi::Buffer<unsigned char>>();
+	return unpackValue( env, packedBuf.Data(), packedBuf.Length() );
+}
+
 Napi::Value MegaHash::Has(const Napi::CallbackInfo& info) {
 	// see if a key exists, return boolean true/value
 	Napi::Env env = info.Env();
+	if (isBusy(env)) return env.Undefined();
 	
-	Napi::Buffer<unsigned char> keyBuf = info[0].As<Napi::Buffer<unsigned char>>();
-	unsigned char *key = keyBuf.Data();
-	MH_KLEN_T keyLength = (MH_KLEN_T)keyBuf.Length();
+	ArgBytes keyArg;
+	if (!readKeyArg(env, info[0], &keyArg)) return env.Undefined();
+	unsigned char *key = keyArg.data;
+	MH_KLEN_T keyLength = (MH_KLEN_T)keyArg.length;
 	
+	HashGuard guard( this->hash, key, keyLength, 0 );
 	Response resp = this->hash->fetch( key, keyLength );
 	return Napi::Boolean::New(env, (resp.result == MH_OK));
 }
@@ -101,18 +905,164 @@ Napi::Value MegaHash::Has(const Napi::CallbackInfo& info) {
 Napi::Value MegaHash::Remove(const Napi::CallbackInfo& info) {
 	// remove key/value pair, free up memory
 	Napi::Env env = info.Env();
+	if (isBusy(env)) return env.Undefined();
 	
-	Napi::Buffer<unsigned char> keyBuf = info[0].As<Napi::Buffer<unsigned char>>();
-	unsigned char *key = keyBuf.Data();
-	MH_KLEN_T keyLength = (MH_KLEN_T)keyBuf.Length();
+	ArgBytes keyArg;
+	if (!readKeyArg(env, info[0], &keyArg)) return env.Undefined();
+	unsigned char *key = keyArg.data;
+	MH_KLEN_T keyLength = (MH_KLEN_T)keyArg.length;
 	
+	HashGuard guard( this->hash, key, keyLength, 1 );
 	Response resp = this->hash->remove( key, keyLength );
 	return Napi::Boolean::New(env, (resp.result == MH_OK));
 }
 
+Napi::Value MegaHash::Incr(const Napi::CallbackInfo& info) {
+	// add delta (Number or BigInt) to value in one lookup, returns the new value
+	Napi::Env env = info.Env();
+	if (isBusy(env)) return env.Undefined();
+	
+	ArgBytes keyArg;
+	if (!readKeyArg(env, info[0], &keyArg)) return env.Undefined();
+	
+	IncrModifier modifier;
+	napi_valuetype type = napi_undefined;
+	napi_typeof( env, info[1], &type );
+	
+	if (type == napi_bigint) {
+		bool lossless = false;
+		modifier.deltaType = MH_TYPE_BIGINT;
+		napi_get_value_bigint_int64( env, info[1], &modifier.bigDelta, &lossless );
+		if (!lossless) {
+			Napi::RangeError::New(env, "BigInt delta is out of range (must fit in a signed 64-bit integer)").ThrowAsJavaScriptException();
+			return env.Undefined();
+		}
+	}
+	else modifier.delta = info[1].As<Napi::Number>().DoubleValue();
+	
+	HashGuard guard( this->hash, keyArg.data, (MH_KLEN_T)keyArg.length, 1 );
+	Response resp = this->hash->modify( keyArg.data, (MH_KLEN_T)keyArg.length, &modifier );
+	
+	if (modifier.err) {
+		Napi::TypeError::New(env, modifier.err).ThrowAsJavaScriptException();
+		return env.Undefined();
+	}
+	if (resp.result == MH_ERR) return storeFailed( env, &modifier );
+	
+	uint64_t bits = readBE64( (unsigned char *)modifier.value.data() );
+	if (modifier.flags == MH_TYPE_BIGINT) {
+		napi_value result;
+		napi_create_bigint_int64( env, (int64_t)bits, &result );
+		return Napi::Value(env, result);
+	}
+	
+	double num;
+	memcpy( (void *)&num, (void *)&bits, sizeof(double) );
+	return Napi::Number::New( env, num );
+}
+
+Napi::Value MegaHash::Append(const Napi::CallbackInfo& info) {
+	// append string or Buffer to value in one lookup, returns the new value length in bytes
+	Napi::Env env = info.Env();
+	if (isBusy(env)) return env.Undefined();
+	
+	ArgBytes keyArg;
+	if (!readKeyArg(env, info[0], &keyArg)) return env.Undefined();
+	
+	ArgBytes dataArg;
+	if (!dataArg.read(env, info[1])) {
+		Napi::TypeError::New(env, "Data must be a string or Buffer").ThrowAsJavaScriptException();
+		return env.Undefined();
+	}
+	
+	AppendModifier modifier;
+	modifier.data = dataArg.data;
+	modifier.length = dataArg.length;
+	modifier.dataType = info[1].IsString() ? MH_TYPE_STRING : MH_TYPE_BUFFER;
+	
+	HashGuard guard( this->hash, keyArg.data, (MH_KLEN_T)keyArg.length, 1 );
+	Response resp = this->hash->modify( keyArg.data, (MH_KLEN_T)keyArg.length, &modifier );
+	
+	if (modifier.err) {
+		Napi::TypeError::New(env, modifier.err).ThrowAsJavaScriptException();
+		return env.Undefined();
+	}
+	if (resp.result == MH_ERR) return storeFailed( env, &modifier );
+	return Napi::Number::New( env, (double)modifier.value.size() );
+}
+
+Napi::Value MegaHash::CompareAndSet(const Napi::CallbackInfo& info) {
+	// replace value only if it currently equals expected (same type and bytes), in one lookup
+	// args: key, expected, expected flags, value, flags, expires (expected undefined means the key must be missing)
+	// returns true if the value was stored
+	Napi::Env env = info.Env();
+	if (isBusy(env)) return env.Undefined();
+	
+	ArgBytes keyArg;
+	if (!readKeyArg(env, info[0], &keyArg)) return env.Undefined();
+	
+	SwapModifier modifier;
+	ArgBytes expectedArg, valueArg;
+	std::string expectedPacked, valuePacked;
+	
+	if (info[1].IsUndefined()) modifier.ifAbsent = 1;
+	else {
+		modifier.expectedFlags = (unsigned char)info[2].As<Napi::Number>().Uint32Value();
+		if (!readValueArg(env, info[1], &expectedArg, &modifier.expectedFlags, expectedPacked)) return env.Undefined();
+		modifier.expected = expectedArg.data;
+		modifier.expectedLength = expectedArg.length;
+	}
+	
+	modifier.newFlags = (unsigned char)info[4].As<Napi::Number>().Uint32Value();
+	if (!readValueArg(env, info[3], &valueArg, &modifier.newFlags, valuePacked)) return env.Undefined();
+	modifier.newValue = valueArg.data;
+	modifier.newLength = valueArg.length;
+	if (info[5].IsNumber()) modifier.newExpires = (uint64_t)info[5].As<Napi::Number>().Int64Value();
+	
+	HashGuard guard( this->hash, keyArg.data, (MH_KLEN_T)keyArg.length, 1 );
+	Response resp = this->hash->modify( keyArg.data, (MH_KLEN_T)keyArg.length, &modifier );
+	
+	if (resp.result == MH_ERR) return storeFailed( env, &modifier );
+	return Napi::Boolean::New( env, modifier.stored );
+}
+
+Napi::Value MegaHash::SetIfAbsent(const Napi::CallbackInfo& info) {
+	// store value only if key is missing (or expired), in one lookup
+	// args: key, value, flags, expires, wantValue
+	// returns true if stored, otherwise the current value if wantValue is set (for getOrSet), or false
+	Napi::Env env = info.Env();
+	if (isBusy(env)) return env.Undefined();
+	
+	ArgBytes keyArg;
+	if (!readKeyArg(env, info[0], &keyArg)) return env.Undefined();
+	
+	SwapModifier modifier;
+	ArgBytes valueArg;
+	std::string packed;
+	
+	modifier.ifAbsent = 1;
+	modifier.newFlags = (unsigned char)info[2].As<Napi::Number>().Uint32Value();
+	if (!readValueArg(env, info[1], &valueArg, &modifier.newFlags, packed)) return env.Undefined();
+	modifier.newValue = valueArg.data;
+	modifier.newLength = valueArg.length;
+	if (info[3].IsNumber()) modifier.newExpires = (uint64_t)info[3].As<Napi::Number>().Int64Value();
+	
+	HashGuard guard( this->hash, keyArg.data, (MH_KLEN_T)keyArg.length, 1 );
+	Response resp = this->hash->modify( keyArg.data, (MH_KLEN_T)keyArg.length, &modifier );
+	
+	if (resp.result == MH_ERR) return storeFailed( env, &modifier );
+	if (modifier.stored) return Napi::Boolean::New( env, true );
+	if (!info[4].ToBoolean().Value()) return Napi::Boolean::New( env, false );
+	
+	// current value is still held by the guard
+	return newValue( env, modifier.current.content, modifier.current.contentLength, modifier.current.flags );
+}
+
 Napi::Value MegaHash::Clear(const Napi::CallbackInfo& info) {
 	// delete some or all keys/values from hash, free all memory
+	if (isBusy(info.Env())) return info.Env().Undefined();
 	unsigned char slice = 0;
+	HashGuard guard( this->hash, 1 );
 	
 	if (info.Length() > 0) {
 		slice = (unsigned char)info[0].As<Napi::Number>().Uint32Value();
@@ -125,6 +1075,35 @@ Napi::Value MegaHash::Clear(const Napi::CallbackInfo& info) {
 	return info.Env().Undefined();
 }
 
+Napi::Value MegaHash::Compact(const Napi::CallbackInfo& info) {
+	// collapse sparse index levels in some or all of the hash, returns bytes of index memory freed
+	Napi::Env env = info.Env();
+	if (isBusy(env)) return env.Undefined();
+	HashGuard guard( this->hash, 1 );
+	uint64_t oldSize = this->hash->stats->indexSize;
+	
+	if (info.Length() > 0) {
+		this->hash->compact( (unsigned char)info[0].As<Napi::Number>().Uint32Value() );
+	}
+	else {
+		for (int slice = 0; slice < MH_INDEX_SIZE; slice++) this->hash->compact( (unsigned char)slice );
+	}
+	
+	return Napi::Number::New( env, (double)(oldSize - this->hash->stats->indexSize) );
+}
+
+Napi::Value MegaHash::Sweep(const Napi::CallbackInfo& info) {
+	// reclaim expired keys, looking at about maxWork keys (default 1000), returns number reclaimed
+	Napi::Env env = info.Env();
+	if (isBusy(env)) return env.Undefined();
+	
+	size_t maxWork = 1000;
+	if ((info.Length() > 0) && info[0].IsNumber()) maxWork = info[0].As<Napi::Number>().Uint32Value();
+	
+	HashGuard guard( this->hash, 1 );
+	return Napi::Number::New( env, (double)this->hash->sweep(maxWork) );
+}
+
 Napi::Value MegaHash::Stats(const Napi::CallbackInfo& info) {
 	// return stats as node object
 	Napi::Env env = info.Env();
@@ -134,7 +1113,50 @@ Napi::Value MegaHash::Stats(const Napi::CallbackInfo& info) {
 	obj.Set(Napi::String::New(env, "metaSize"), (double)this->hash->stats->metaSize);
 	obj.Set(Napi::String::New(env, "dataSize"), (double)this->hash->stats->dataSize);
 	obj.Set(Napi::String::New(env, "numKeys"), (double)this->hash->stats->numKeys);
-	obj.Set(Napi::String::New(env, "numIndexes"), (double)(this->hash->stats->indexSize / (int)sizeof(Index)));
+	obj.Set(Napi::String::New(env, "numIndexes"), (double)this->hash->stats->numIndexes);
+	obj.Set(Napi::String::New(env, "numEvictions"), (double)this->hash->stats->numEvictions);
+	obj.Set(Napi::String::New(env, "evictedBytes"), (double)this->hash->stats->evictedBytes);
+	obj.Set(Napi::String::New(env, "compressedSize"), (double)this->hash->stats->compressedSize);
+	obj.Set(Napi::String::New(env, "rawSize"), (double)this->hash->stats->rawSize);
+	
+	if ((info.Length() > 0) && info[0].IsObject() && info[0].As<Napi::Object>().Get("detailed").ToBoolean()) {
+		// walk entire hash for structural stats (slow)
+		if (isBusy(env)) return env.Undefined();
+		ScanStats scanStats;
+		HashGuard guard( this->hash, 0 );
+		this->hash->scan( &scanStats );
+		
+		obj.Set(Napi::String::New(env, "numChains"), (double)scanStats.numChains);
+		obj.Set(Napi::String::New(env, "maxChainLength"), (double)scanStats.maxChainLength);
+		obj.Set(Napi::String::New(env, "avgChainLength"), scanStats.numChains ? ((double)this->hash->stats->numKeys / (double)scanStats.numChains) : 0.0);
+		obj.Set(Napi::String::New(env, "maxDepth"), (double)scanStats.maxDepth);
+		obj.Set(Napi::String::New(env, "chainLengths"), histogramArray(env, scanStats.chainLengths, MH_LENGTH_SLOTS));
+		obj.Set(Napi::String::New(env, "keyDepths"), histogramArray(env, scanStats.keyDepths, MH_MAX_DEPTH + 1));
+		obj.Set(Napi::String::New(env, "numReindexes"), (double)this->hash->stats->numReindexes);
+		obj.Set(Napi::String::New(env, "reindexedKeys"), (double)this->hash->stats->reindexedKeys);
+		obj.Set(Napi::String::New(env, "numWidens"), (double)this->hash->stats->numWidens);
+		
+		Instrument *instrument = this->hash->instrument;
+		if (instrument) {
+			// hot path counters (see setInstrument)
+			uint64_t hits = instrument->hits;
+			uint64_t lookups = hits + instrument->misses;
+			uint64_t probeLengths[ MH_LENGTH_SLOTS ];
+			for (int idx = 0; idx < MH_LENGTH_SLOTS; idx++) probeLengths[idx] = instrument->probeLengths[idx];
+			
+			obj.Set(Napi::String::New(env, "hits"), (double)hits);
+			obj.Set(Napi::String::New(env, "misses"), (double)(lookups - hits));
+			obj.Set(Napi::String::New(env, "avgLevels"), lookups ? ((double)instrument->levels / (double)lookups) : 0.0);
+			obj.Set(Napi::String::New(env, "avgProbes"), lookups ? ((double)instrument->probes / (double)lookups) : 0.0);
+			obj.Set(Napi::String::New(env, "probeLengths"), histogramArray(env, probeLengths, MH_LENGTH_SLOTS));
+			
+			Napi::Object latency = Napi::Object::New(env);
+			latency.Set(Napi::String::New(env, "get"), latencyObject(env, instrument->latency[MH_OP_FETCH]));
+			latency.Set(Napi::String::New(env, "set"), latencyObject(env, instrument->latency[MH_OP_STORE]));
+			latency.Set(Napi::String::New(env, "delete"), latencyObject(env, instrument->latency[MH_OP_REMOVE]));
+			obj.Set(Napi::String::New(env, "latency"), latency);
+		}
+	}
 	
 	return obj;
 }
@@ -142,7 +1164,9 @@ Napi::Value MegaHash::Stats(const Napi::CallbackInfo& info) {
 Napi::Value MegaHash::FirstKey(const Napi::CallbackInfo& info) {
 	// return first key in hash (in undefined order)
 	Napi::Env env = info.Env();
+	if (isBusy(env)) return env.Undefined();
 	
+	HashGuard guard( this->hash, 0 );
 	Response resp = this->hash->firstKey();
 	if (resp.result == MH_OK) {
 		return Napi::Buffer<unsigned char>::Copy( env, resp.content, resp.contentLength );
@@ -153,14 +1177,272 @@ Napi::Value MegaHash::FirstKey(const Napi::CallbackInfo& info) {
 Napi::Value MegaHash::NextKey(const Napi::CallbackInfo& info) {
 	// return next key in hash given previous one (in undefined order)
 	Napi::Env env = info.Env();
+	if (isBusy(env)) return env.Undefined();
 	
-	Napi::Buffer<unsigned char> keyBuf = info[0].As<Napi::Buffer<unsigned char>>();
-	unsigned char *key = keyBuf.Data();
-	MH_KLEN_T keyLength = (MH_KLEN_T)keyBuf.Length();
+	ArgBytes keyArg;
+	if (!readKeyArg(env, info[0], &keyArg)) return env.Undefined();
+	unsigned char *key = keyArg.data;
+	MH_KLEN_T keyLength = (MH_KLEN_T)keyArg.length;
 	
+	HashGuard guard( this->hash, 0 );
 	Response resp = this->hash->nextKey( key, keyLength );
 	if (resp.result == MH_OK) {
 		return Napi::Buffer<unsigned char>::Copy( env, resp.content, resp.contentLength );
 	}
 	else return env.Undefined();
 }
+
+Napi::Value MegaHash::CursorNext(const Napi::CallbackInfo& info) {
+	// return next batch of packed keys (or key/value records) for cursor, given its state buffer
+	// the state buffer is updated in place, and an empty buffer means the end
+	Napi::Env env = info.Env();
+	if (isBusy(env)) return env.Undefined();
+	
+	Napi::Buffer<unsigned char> stateBuf = info[0].As<Napi::Buffer<unsigned char>>();
+	if (stateBuf.Length() < MH_CURSOR_STATE_SIZE) {
+		Napi::Error::New(env, "Cursor state buffer is too small").ThrowAsJavaScriptException();
+		return env.Undefined();
+	}
+	uint32_t batchSize = info[1].As<Napi::Number>().Uint32Value();
+	int withValues = info[2].ToBoolean() ? 1 : 0;
+	
+	Cursor cursor;
+	std::string out;
+	readCursor( stateBuf.Data(), &cursor );
+	uint32_t count = packCursorBatch( this->hash, &cursor, batchSize, withValues, out );
+	writeCursor( stateBuf.Data(), &cursor );
+	
+	Napi::Buffer<unsigned char> outBuf = Napi::Buffer<unsigned char>::Copy( env, (unsigned char *)out.data(), out.size() );
+	outBuf.Set( "count", (double)count );
+	return outBuf;
+}
+
+Napi::Value MegaHash::SetMany(const Napi::CallbackInfo& info) {
+	// store many key/value pairs packed into one buffer, using multiple threads for big batches
+	// returns buffer of result codes, one per pair (same as set)
+	Napi::Env env = info.Env();
+	if (isBusy(env)) return env.Undefined();
+	
+	Napi::Buffer<unsigned char> packedBuf = info[0].As<Napi::Buffer<unsigned char>>();
+	uint32_t count = info[1].As<Napi::Number>().Uint32Value();
+	uint32_t numThreads = info[2].As<Napi::Number>().Uint32Value();
+	
+	Napi::Buffer<unsigned char> resultBuf = Napi::Buffer<unsigned char>::New( env, count );
+	
+	if (!storePacked(this->hash, packedBuf.Data(), packedBuf.Length(), count, resultBuf.Data(), numThreads)) {
+		Napi::Error::New(env, "Packed buffer is truncated").ThrowAsJavaScriptException();
+		return env.Undefined();
+	}
+	
+	return resultBuf;
+}
+
+Napi::Value MegaHash::GetMany(const Napi::CallbackInfo& info) {
+	// fetch many values given packed keys
+	// all values are returned in one buffer, with offsets (count + 1, 32-bit LE) and flags properties
+	// keys not found have zero length and MH_FLAGS_MISSING flags
+	Napi::Env env = info.Env();
+	if (isBusy(env)) return env.Undefined();
+	
+	Napi::Buffer<unsigned char> packedBuf = info[0].As<Napi::Buffer<unsigned char>>();
+	unsigned char *data = packedBuf.Data();
+	size_t length = packedBuf.Length();
+	uint32_t count = info[1].As<Napi::Number>().Uint32Value();
+	
+	Napi::Buffer<unsigned char> offsetsBuf = Napi::Buffer<unsigned char>::New( env, (count + 1) * 4 );
+	Napi::Buffer<unsigned char> flagsBuf = Napi::Buffer<unsigned char>::New( env, count );
+	unsigned char *offsets = offsetsBuf.Data();
+	unsigned char *flags = flagsBuf.Data();
+	
+	std::vector<BulkRecord> records( count );
+	size_t offset = 0;
+	
+	for (uint32_t idx = 0; idx < count; idx++) {
+		if (!unpackKey(data, length, &offset, &records[idx].key, &records[idx].keyLength)) {
+			Napi::Error::New(env, "Packed buffer is truncated").ThrowAsJavaScriptException();
+			return env.Undefined();
+		}
+	}
+	
+	// first pass: fetch everything in one batch (see Hash::fetchBatch) and size the output
+	// (responses point into the hash, so in concurrent mode the whole hash is read locked until we return)
+	HashGuard guard( this->hash, 0 );
+	std::vector<Response> resps( count );
+	size_t total = 0;
+	
+	this->hash->fetchBatch( records.data(), count, resps.data() );
+	for (uint32_t idx = 0; idx < count; idx++) {
+		if (resps[idx].result == MH_OK) total += this->hash->valueLength( &resps[idx] );
+	}
+	
+	if (total > 0xFFFFFFFF) {
+		Napi::Error::New(env, "Batch result is too large").ThrowAsJavaScriptException();
+		return env.Undefined();
+	}
+	
+	// second pass: copy all values into one buffer
+	Napi::Buffer<unsigned char> valuesBuf = Napi::Buffer<unsigned char>::New( env, total );
+	unsigned char *values = valuesBuf.Data();
+	uint32_t pos = 0;
+	
+	for (uint32_t idx = 0; idx < count; idx++) {
+		writeLE( offsets + (idx * 4), pos, 4 );
+		
+		if (resps[idx].result == MH_OK) {
+			if (!this->hash->valueCopy( &resps[idx], values + pos )) return corruptValue( env );
+			pos += this->hash->valueLength( &resps[idx] );
+			flags[idx] = resps[idx].flags & MH_FLAGS_VALUE;
+		}
+		else flags[idx] = MH_FLAGS_MISSING;
+	}
+	writeLE( offsets + (count * 4), pos, 4 );
+	
+	valuesBuf.Set( "offsets", offsetsBuf );
+	valuesBuf.Set( "flags", flagsBuf );
+	return valuesBuf;
+}
+
+Napi::Value MegaHash::HasMany(const Napi::CallbackInfo& info) {
+	// check existence of many packed keys, returns buffer of 0/1 bytes
+	Napi::Env env = info.Env();
+	if (isBusy(env)) return env.Undefined();
+	
+	Napi::Buffer<unsigned char> packedBuf = info[0].As<Napi::Buffer<unsigned char>>();
+	unsigned char *data = packedBuf.Data();
+	size_t length = packedBuf.Length();
+	uint32_t count = info[1].As<Napi::Number>().Uint32Value();
+	
+	Napi::Buffer<unsigned char> resultBuf = Napi::Buffer<unsigned char>::New( env, count );
+	unsigned char *results = resultBuf.Data();
+	
+	std::vector<BulkRecord> records( count );
+	size_t offset = 0;
+	
+	for (uint32_t idx = 0; idx < count; idx++) {
+		if (!unpackKey(data, length, &offset, &records[idx].key, &records[idx].keyLength)) {
+			Napi::Error::New(env, "Packed buffer is truncated").ThrowAsJavaScriptException();
+			return env.Undefined();
+		}
+	}
+	
+	// fetch everything in one batch, with the whole hash read locked in concurrent mode
+	HashGuard guard( this->hash, 0 );
+	std::vector<Response> resps( count );
+	this->hash->fetchBatch( records.data(), count, resps.data() );
+	
+	for (uint32_t idx = 0; idx < count; idx++) {
+		results[idx] = (resps[idx].result == MH_OK) ? 1 : 0;
+	}
+	
+	return resultBuf;
+}
+
+Napi::Value MegaHash::RemoveMany(const Napi::CallbackInfo& info) {
+	// remove many packed keys, returns buffer of 0/1 bytes
+	Napi::Env env = info.Env();
+	if (isBusy(env)) return env.Undefined();
+	
+	Napi::Buffer<unsigned char> packedBuf = info[0].As<Napi::Buffer<unsigned char>>();
+	unsigned char *data = packedBuf.Data();
+	size_t length = packedBuf.Length();
+	uint32_t count = info[1].As<Napi::Number>().Uint32Value();
+	
+	Napi::Buffer<unsigned char> resultBuf = Napi::Buffer<unsigned char>::New( env, count );
+	unsigned char *results = resultBuf.Data();
+	
+	size_t offset = 0;
+	unsigned char *key;
+	MH_KLEN_T keyLength;
+	
+	for (uint32_t idx = 0; idx < count; idx++) {
+		if (!unpackKey(data, length, &offset, &key, &keyLength)) {
+			Napi::Error::New(env, "Packed buffer is truncated").ThrowAsJavaScriptException();
+			return env.Undefined();
+		}
+		
+		HashGuard guard( this->hash, key, keyLength, 1 );
+		Response resp = this->hash->remove( key, keyLength );
+		results[idx] = (resp.result == MH_OK) ? 1 : 0;
+	}
+	
+	return resultBuf;
+}
+
+Napi::Value MegaHash::Save(const Napi::CallbackInfo& info) {
+	// save all keys/values to binary snapshot file
+	Napi::Env env = info.Env();
+	if (isBusy(env)) return env.Undefined();
+	
+	std::string path = info[0].As<Napi::String>().Utf8Value();
+	HashGuard guard( this->hash, 0 );
+	const char *err = this->hash->save( path.c_str() );
+	
+	if (err) {
+		Napi::Error::New(env, err).ThrowAsJavaScriptException();
+		return env.Undefined();
+	}
+	return Napi::Boolean::New(env, true);
+}
+
+Napi::Value MegaHash::Load(const Napi::CallbackInfo& info) {
+	// load binary snapshot file into empty hash, using multiple threads
+	Napi::Env env = info.Env();
+	if (isBusy(env)) return env.Undefined();
+	
+	std::string path = info[0].As<Napi::String>().Utf8Value();
+	uint32_t numThreads = info[1].As<Napi::Number>().Uint32Value();
+	const char *err = this->hash->load( path.c_str(), numThreads );
+	
+	if (err) {
+		Napi::Error::New(env, err).ThrowAsJavaScriptException();
+		return env.Undefined();
+	}
+	return Napi::Boolean::New(env, true);
+}
+
+int MegaHash::isBusy(Napi::Env env) {
+	// check if an async operation is running on this hash, throw if so
+	if (!this->asyncBusy) return 0;
+	Napi::Error::New(env, "Hash is busy with an async operation").ThrowAsJavaScriptException();
+	return 1;
+}
+
+Napi::Value MegaHash::QueueAsync(const Napi::CallbackInfo& info, MegaHashWorker *worker) {
+	// queue async worker, or reject right away if another one is still running
+	// (worker constructor marks us busy, so check first)
+	Napi::Env env = info.Env();
+	Napi::Promise::Deferred deferred = Napi::Promise::Deferred::New(env);
+	
+	if (!worker) {
+		deferred.Reject( Napi::Error::New(env, "Hash is busy with an async operation").Value() );
+		return deferred.Promise();
+	}
+	
+	worker->Queue();
+	return worker->deferred.Promise();
+}
+
+Napi::Value MegaHash::ClearAsync(const Napi::CallbackInfo& info) {
+	// delete all keys/values on the threadpool, returns promise
+	return QueueAsync( info, this->asyncBusy ? NULL : new ClearWorker(this, info) );
+}
+
+Napi::Value MegaHash::SetManyAsync(const Napi::CallbackInfo& info) {
+	// store many packed key/value pairs on the threadpool, returns promise of result codes buffer
+	return QueueAsync( info, this->asyncBusy ? NULL : new SetManyWorker(this, info) );
+}
+
+Napi::Value MegaHash::ScanAsync(const Napi::CallbackInfo& info) {
+	// gather next batch of packed key/value records on the threadpool, returns promise of buffer
+	return QueueAsync( info, this->asyncBusy ? NULL : new ScanWorker(this, info) );
+}
+
+Napi::Value MegaHash::SaveAsync(const Napi::CallbackInfo& info) {
+	// save binary snapshot file on the threadpool, returns promise
+	return QueueAsync( info, this->asyncBusy ? NULL : new SaveWorker(this, info) );
+}
+
+Napi::Value MegaHash::LoadAsync(const Napi::CallbackInfo& info) {
+	// load binary snapshot file into empty hash on the threadpool, returns promise
+	return QueueAsync( info, this->asyncBusy ? NULL : new LoadWorker(this, info) );
+}
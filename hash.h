@@ -5,28 +5,120 @@
 #ifndef MEGAHASH_H
 #define MEGAHASH_H
 
+#include <string>
 #include <napi.h>
 #include "MegaHash.h"
 
+/** \name Value types, stored in the value flags (same as main.js): */
+//@{
+#define MH_TYPE_BUFFER 0
+#define MH_TYPE_STRING 1
+#define MH_TYPE_NUMBER 2
+#define MH_TYPE_BOOLEAN 3
+#define MH_TYPE_OBJECT 4
+#define MH_TYPE_BIGINT 5
+#define MH_TYPE_NULL 6
+/** Object packed natively (see pack.cc). */
+#define MH_TYPE_PACKED 7
+//@}
+
+/** Flags value returned by getMany() for keys that were not found. */
+#define MH_FLAGS_MISSING 0xFF
+
+/** Longest value append() builds (Node.js buffers are limited to 2 GB here). */
+#define MH_MAX_VALUE_LENGTH 0x7FFFFFFF
+
+/** Size of cursor state buffers passed in from main.js (see readCursor). */
+#define MH_CURSOR_STATE_SIZE 16
+
+/** Strings up to about this many bytes (UTF-8) are encoded on the stack, see ArgBytes. */
+#define MH_SCRATCH_SIZE 256
+
+class ArgBytes {
+public:
+	// bytes of a key or value passed in from JS, either a Buffer or a string
+	// strings are UTF-8 encoded right here, into stack scratch space if they fit, so most keys
+	// never need a JS Buffer or any heap allocation
+	unsigned char *data;
+	size_t length;
+	unsigned char scratch[ MH_SCRATCH_SIZE ];
+	std::string heap; /**< Only used for strings too long for scratch. */
+	
+	ArgBytes() {
+		data = NULL;
+		length = 0;
+	}
+	
+	int read(Napi::Env env, Napi::Value value);
+};
+
+class SharedHash {
+public:
+	// registry entry for a hash shared between threads
+	Hash *hash;
+	uint32_t refs; /**< Number of wrappers attached, across all threads. */
+	
+	SharedHash() {
+		hash = NULL;
+		refs = 0;
+	}
+	
+	SharedHash(Hash *newHash) {
+		hash = newHash;
+		refs = 1;
+	}
+};
+
+class MegaHashWorker;
+
 class MegaHash : public Napi::ObjectWrap<MegaHash> {
+	friend class MegaHashWorker;
+	
 public:
 	static Napi::Object Init(Napi::Env env, Napi::Object exports);
 	MegaHash(const Napi::CallbackInfo& info);
 	~MegaHash();
 
 private:
-	static Napi::FunctionReference constructor;
-
 	Napi::Value Set(const Napi::CallbackInfo& info);
 	Napi::Value Get(const Napi::CallbackInfo& info);
+	Napi::Value GetInto(const Napi::CallbackInfo& info);
+	Napi::Value GetView(const Napi::CallbackInfo& info);
+	Napi::Value GetField(const Napi::CallbackInfo& info);
 	Napi::Value Has(const Napi::CallbackInfo& info);
 	Napi::Value Remove(const Napi::CallbackInfo& info);
+	Napi::Value Incr(const Napi::CallbackInfo& info);
+	Napi::Value Append(const Napi::CallbackInfo& info);
+	Napi::Value CompareAndSet(const Napi::CallbackInfo& info);
+	Napi::Value SetIfAbsent(const Napi::CallbackInfo& info);
 	Napi::Value Clear(const Napi::CallbackInfo& info);
+	Napi::Value Compact(const Napi::CallbackInfo& info);
+	Napi::Value Sweep(const Napi::CallbackInfo& info);
 	Napi::Value Stats(const Napi::CallbackInfo& info);
 	Napi::Value FirstKey(const Napi::CallbackInfo& info);
 	Napi::Value NextKey(const Napi::CallbackInfo& info);
+	Napi::Value CursorNext(const Napi::CallbackInfo& info);
+	Napi::Value SetMany(const Napi::CallbackInfo& info);
+	Napi::Value GetMany(const Napi::CallbackInfo& info);
+	Napi::Value HasMany(const Napi::CallbackInfo& info);
+	Napi::Value RemoveMany(const Napi::CallbackInfo& info);
+	Napi::Value Share(const Napi::CallbackInfo& info);
+	Napi::Value ClearAsync(const Napi::CallbackInfo& info);
+	Napi::Value SetManyAsync(const Napi::CallbackInfo& info);
+	Napi::Value ScanAsync(const Napi::CallbackInfo& info);
+	Napi::Value Save(const Napi::CallbackInfo& info);
+	Napi::Value Load(const Napi::CallbackInfo& info);
+	Napi::Value SaveAsync(const Napi::CallbackInfo& info);
+	Napi::Value LoadAsync(const Napi::CallbackInfo& info);
+	static Napi::Value Pack(const Napi::CallbackInfo& info);
+	static Napi::Value Unpack(const Napi::CallbackInfo& info);
+	
+	int isBusy(Napi::Env env);
+	Napi::Value QueueAsync(const Napi::CallbackInfo& info, MegaHashWorker *worker);
 
 	Hash *hash;
+	uint32_t shareId; /**< Handle in share registry, or 0 if not shared. */
+	unsigned char asyncBusy; /**< Set while an async operation is running on the threadpool. */
 };
 
 #endif
@@ -0,0 +1,282 @@
+// MegaHash v1.0
+// Copyright (c) 2019 Joseph Huckaby
+// Based on DeepHash, (c) 2003 Joseph Huckaby
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include "intmap.h"
+#include "pack.h"
+
+// IntMap keys are non-negative integers, passed in as Numbers (up to 2^53 - 1) or BigInts (up to 2^64 - 1),
+// and come back out as Numbers if they fit, BigInts otherwise.
+// Numbers, BigInts, booleans, null and strings are converted to and from values right here,
+// so they never need a Buffer.  Objects arrive from main.js as JSON strings with type flags,
+// and are packed here the same way as MegaHash does (see pack.cc).
+
+/** Largest integer a JS Number can hold exactly (2^53 - 1). */
+#define MH_INTMAP_MAX_SAFE 9007199254740991ULL
+
+static int readKey(Napi::Env env, Napi::Value value, uint64_t *key) {
+	// convert JS key to uint64, throws TypeError and returns 0 if it is not a valid key
+	napi_valuetype type = napi_undefined;
+	napi_typeof( env, value, &type );
+	
+	if (type == napi_number) {
+		double num = value.As<Napi::Number>().DoubleValue();
+		if ((num >= 0) && (num <= (double)MH_INTMAP_MAX_SAFE) && ((double)(uint64_t)num == num)) {
+			key[0] = (uint64_t)num;
+			return 1;
+		}
+	}
+	else if (type == napi_bigint) {
+		bool lossless = false;
+		napi_get_value_bigint_uint64( env, value, key, &lossless );
+		if (lossless) return 1;
+	}
+	
+	Napi::TypeError::New(env, "IntMap keys must be non-negative integers (Number or BigInt, up to 64 bits)").ThrowAsJavaScriptException();
+	return 0;
+}
+
+static Napi::Value newKey(Napi::Env env, uint64_t key) {
+	// convert key back to JS, as a Number if it fits exactly
+	if (key <= MH_INTMAP_MAX_SAFE) return Napi::Number::New(env, (double)key);
+	
+	napi_value result;
+	napi_create_bigint_uint64( env, key, &result );
+	return Napi::Value(env, result);
+}
+
+static Napi::Value newValue(Napi::Env env, unsigned char *content, MH_LEN_T contentLength, unsigned char flags) {
+	// convert stored value back to JS given type flags
+	// other types are returned as a Buffer with flags, for main.js to decode
+	switch (flags) {
+		case MH_TYPE_NUMBER: {
+			double num;
+			memcpy( (void *)&num, (void *)content, sizeof(double) );
+			return Napi::Number::New(env, num);
+		}
+		
+		case MH_TYPE_BIGINT: {
+			int64_t num;
+			napi_value result;
+			memcpy( (void *)&num, (void *)content, sizeof(int64_t) );
+			napi_create_bigint_int64( env, num, &result );
+			return Napi::Value(env, result);
+		}
+		
+		case MH_TYPE_BOOLEAN:
+			return Napi::Boolean::New(env, content[0] == 1);
+		
+		case MH_TYPE_NULL:
+			return env.Null();
+		
+		case MH_TYPE_STRING:
+			return Napi::String::New(env, (const char *)content, contentLength);
+		
+		case MH_TYPE_PACKED:
+			return unpackValue(env, content, contentLength);
+	}
+	
+	Napi::Buffer<unsigned char> valueBuf = Napi::Buffer<unsigned char>::Copy( env, content, contentLength );
+	if (!valueBuf) return env.Undefined();
+	
+	if (flags) valueBuf.Set( "flags", (double)flags );
+	return valueBuf;
+}
+
+Napi::Object IntMap::Init(Napi::Env env, Napi::Object exports) {
+	// initialize class
+	Napi::HandleScope scope(env);
+	
+	Napi::Function func = DefineClass(env, "IntMap", {
+		InstanceMethod("_set", &IntMap::Set),
+		InstanceMethod("_get", &IntMap::Get),
+		InstanceMethod("_has", &IntMap::Has),
+		InstanceMethod("_remove", &IntMap::Remove),
+		InstanceMethod("clear", &IntMap::Clear),
+		InstanceMethod("stats", &IntMap::Stats),
+		InstanceMethod("_cursorNext", &IntMap::CursorNext)
+	});
+	
+	exports.Set("IntMap", func);
+	return exports;
+}
+
+IntMap::IntMap(const Napi::CallbackInfo& info) : Napi::ObjectWrap<IntMap>(info) {
+	// construct new integer key table
+	this->hash = new IntHash();
+}
+
+IntMap::~IntMap() {
+	// cleanup and free memory
+	delete this->hash;
+}
+
+Napi::Value IntMap::Set(const Napi::CallbackInfo& info) {
+	// store key/value pair, returns result code (same as MegaHash)
+	// value is a Number, BigInt, boolean, null, or a string or Buffer with optional type flags
+	Napi::Env env = info.Env();
+	uint64_t key;
+	if (!readKey(env, info[0], &key)) return env.Undefined();
+	
+	unsigned char *value = NULL;
+	MH_LEN_T valueLength = 0;
+	unsigned char flags = MH_TYPE_BUFFER;
+	unsigned char scratch[8];
+	ArgBytes str;
+	std::string packed;
+	
+	napi_valuetype type = napi_undefined;
+	napi_typeof( env, info[1], &type );
+	
+	switch (type) {
+		case napi_number: {
+			double num = info[1].As<Napi::Number>().DoubleValue();
+			memcpy( (void *)scratch, (void *)&num, sizeof(double) );
+			value = scratch;
+			valueLength = sizeof(double);
+			flags = MH_TYPE_NUMBER;
+		} break;
+		
+		case napi_bigint: {
+			int64_t num;
+			bool lossless = false;
+			napi_get_value_bigint_int64( env, info[1], &num, &lossless );
+			if (!lossless) {
+				Napi::RangeError::New(env, "BigInt value is out of range (must fit in a signed 64-bit integer)").ThrowAsJavaScriptException();
+				return env.Undefined();
+			}
+			memcpy( (void *)scratch, (void *)&num, sizeof(int64_t) );
+			value = scratch;
+			valueLength = sizeof(int64_t);
+			flags = MH_TYPE_BIGINT;
+		} break;
+		
+		case napi_boolean:
+			scratch[0] = info[1].As<Napi::Boolean>().Value() ? 1 : 0;
+			value = scratch;
+			valueLength = 1;
+			flags = MH_TYPE_BOOLEAN;
+		break;
+		
+		case napi_null:
+			value = scratch;
+			flags = MH_TYPE_NULL;
+		break;
+		
+		case napi_string:
+			// objects arrive here too, as JSON with flags
+			str.read( env, info[1] );
+			value = str.data;
+			valueLength = (MH_LEN_T)str.length;
+			flags = ((info.Length() > 2) && info[2].IsNumber()) ? (unsigned char)info[2].As<Napi::Number>().Uint32Value() : MH_TYPE_STRING;
+			if (flags == MH_TYPE_PACKED) {
+				if (packJSON((const char *)str.data, str.length, packed)) {
+					value = (unsigned char *)packed.data();
+					valueLength = (MH_LEN_T)packed.size();
+				}
+				else flags = MH_TYPE_OBJECT;
+			}
+		break;
+		
+		default:
+			if (!info[1].IsBuffer()) {
+				Napi::TypeError::New(env, "Unsupported value type").ThrowAsJavaScriptException();
+				return env.Undefined();
+			}
+			Napi::Buffer<unsigned char> valueBuf = info[1].As<Napi::Buffer<unsigned char>>();
+			value = valueBuf.Data();
+			valueLength = (MH_LEN_T)valueBuf.Length();
+			if ((info.Length() > 2) && info[2].IsNumber()) {
+				flags = (unsigned char)info[2].As<Napi::Number>().Uint32Value();
+			}
+		break;
+	}
+	
+	Response resp = this->hash->store( key, value, valueLength, flags );
+	return Napi::Number::New(env, (double)resp.result);
+}
+
+Napi::Value IntMap::Get(const Napi::CallbackInfo& info) {
+	// fetch value given key, converted back to its original type where possible
+	Napi::Env env = info.Env();
+	uint64_t key;
+	if (!readKey(env, info[0], &key)) return env.Undefined();
+	
+	Response resp = this->hash->fetch( key );
+	if (resp.result == MH_OK) return newValue( env, resp.content, resp.contentLength, resp.flags );
+	else return env.Undefined();
+}
+
+Napi::Value IntMap::Has(const Napi::CallbackInfo& info) {
+	// see if a key exists, return boolean true/value
+	Napi::Env env = info.Env();
+	uint64_t key;
+	if (!readKey(env, info[0], &key)) return env.Undefined();
+	
+	Response resp = this->hash->fetch( key );
+	return Napi::Boolean::New(env, (resp.result == MH_OK));
+}
+
+Napi::Value IntMap::Remove(const Napi::CallbackInfo& info) {
+	// remove key/value pair, free up memory
+	Napi::Env env = info.Env();
+	uint64_t key;
+	if (!readKey(env, info[0], &key)) return env.Undefined();
+	
+	Response resp = this->hash->remove( key );
+	return Napi::Boolean::New(env, (resp.result == MH_OK));
+}
+
+Napi::Value IntMap::Clear(const Napi::CallbackInfo& info) {
+	// delete all keys/values, free all memory
+	this->hash->clear();
+	return info.Env().Undefined();
+}
+
+Napi::Value IntMap::Stats(const Napi::CallbackInfo& info) {
+	// return stats as node object (same properties as MegaHash, where they apply)
+	Napi::Env env = info.Env();
+	
+	Napi::Object obj = Napi::Object::New(env);
+	obj.Set(Napi::String::New(env, "indexSize"), (double)this->hash->stats->indexSize);
+	obj.Set(Napi::String::New(env, "metaSize"), (double)this->hash->stats->metaSize);
+	obj.Set(Napi::String::New(env, "dataSize"), (double)this->hash->stats->dataSize);
+	obj.Set(Napi::String::New(env, "numKeys"), (double)this->hash->stats->numKeys);
+	obj.Set(Napi::String::New(env, "numIndexes"), (double)this->hash->stats->numIndexes);
+	return obj;
+}
+
+Napi::Value IntMap::CursorNext(const Napi::CallbackInfo& info) {
+	// return next batch for cursor as a flat array: keys, values, or key, value, key, value...
+	// mode is 0 for keys, 1 for values, 2 for entries
+	// the state buffer holds the table position, and is updated in place (an empty array means the end)
+	Napi::Env env = info.Env();
+	
+	Napi::Buffer<unsigned char> stateBuf = info[0].As<Napi::Buffer<unsigned char>>();
+	if (stateBuf.Length() < MH_INTMAP_STATE_SIZE) {
+		Napi::Error::New(env, "Cursor state buffer is too small").ThrowAsJavaScriptException();
+		return env.Undefined();
+	}
+	uint32_t batchSize = info[1].As<Napi::Number>().Uint32Value();
+	uint32_t mode = info[2].As<Napi::Number>().Uint32Value();
+	
+	uint64_t position;
+	std::vector<IntSlot *> slots;
+	memcpy( (void *)&position, (void *)stateBuf.Data(), sizeof(uint64_t) );
+	this->hash->cursorNext( &position, batchSize ? batchSize : 1, &slots );
+	memcpy( (void *)stateBuf.Data(), (void *)&position, sizeof(uint64_t) );
+	
+	Napi::Array batch = Napi::Array::New( env, (mode == 2) ? slots.size() * 2 : slots.size() );
+	uint32_t idx = 0;
+	
+	for (size_t pos = 0; pos < slots.size(); pos++) {
+		IntSlot *slot = slots[pos];
+		if (mode != 1) batch.Set( idx++, newKey(env, slot->key) );
+		if (mode != 0) batch.Set( idx++, newValue(env, this->hash->slotGetContent(slot), slot->length, slot->flags) );
+	}
+	
+	return batch;
+}
@@ -0,0 +1,33 @@
+// MegaHash v1.0
+// Copyright (c) 2019 Joseph Huckaby
+// Based on DeepHash, (c) 2003 Joseph Huckaby
+
+#ifndef INTMAP_H
+#define INTMAP_H
+
+#include <napi.h>
+#include "IntHash.h"
+#include "hash.h"
+
+/** Size of IntMap cursor state buffers passed in from main.js. */
+#define MH_INTMAP_STATE_SIZE 8
+
+class IntMap : public Napi::ObjectWrap<IntMap> {
+public:
+	static Napi::Object Init(Napi::Env env, Napi::Object exports);
+	IntMap(const Napi::CallbackInfo& info);
+	~IntMap();
+
+private:
+	Napi::Value Set(const Napi::CallbackInfo& info);
+	Napi::Value Get(const Napi::CallbackInfo& info);
+	Napi::Value Has(const Napi::CallbackInfo& info);
+	Napi::Value Remove(const Napi::CallbackInfo& info);
+	Napi::Value Clear(const Napi::CallbackInfo& info);
+	Napi::Value Stats(const Napi::CallbackInfo& info);
+	Napi::Value CursorNext(const Napi::CallbackInfo& info);
+
+	IntHash *hash;
+};
+
+#endif
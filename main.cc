@@ -4,9 +4,11 @@
 
 #include <napi.h>
 #include "hash.h"
+#include "intmap.h"
 
 Napi::Object InitAll(Napi::Env env, Napi::Object exports) {
-  return MegaHash::Init(env, exports);
+  MegaHash::Init(env, exports);
+  return IntMap::Init(env, exports);
 }
 
 NODE_API_MODULE(NODE_GYP_MODULE_NAME, InitAll)
@@ -2,7 +2,10 @@
 // Copyright (c) 2019 Joseph Huckaby
 // Based on DeepHash, (c) 2003 Joseph Huckaby
 
-var MegaHash = require('bindings')('megahash').MegaHash;
+var os = require('os');
+var native = require('bindings')('megahash');
+var MegaHash = native.MegaHash;
+var IntMap = native.IntMap;
 
 const MH_TYPE_BUFFER = 0;
 const MH_TYPE_STRING = 1;
@@ -11,56 +14,185 @@ const MH_TYPE_BOOLEAN = 3;
 const MH_TYPE_OBJECT = 4;
 const MH_TYPE_BIGINT = 5;
 const MH_TYPE_NULL = 6;
+const MH_TYPE_PACKED = 7;
 
-MegaHash.prototype.set = function(key, value) {
-	// store key/value in hash, auto-convert format to buffer
-	var flags = MH_TYPE_BUFFER;
-	var keyBuf = Buffer.isBuffer(key) ? key : Buffer.from(''+key, 'utf8');
-	if (!keyBuf.length) throw new Error("Key must have length");
-	var valueBuf = value;
-	
-	if (!Buffer.isBuffer(valueBuf)) {
-		if (valueBuf === null) {
-			valueBuf = Buffer.alloc(0);
-			flags = MH_TYPE_NULL;
-		}
-		else if (typeof(valueBuf) == 'object') {
-			valueBuf = Buffer.from( JSON.stringify(value) );
-			flags = MH_TYPE_OBJECT;
-		}
-		else if (typeof(valueBuf) == 'number') {
-			valueBuf = Buffer.alloc(8);
-			valueBuf.writeDoubleBE( value );
-			flags = MH_TYPE_NUMBER;
-		}
-		else if (typeof(valueBuf) == 'bigint') {
-			valueBuf = Buffer.alloc(8);
-			valueBuf.writeBigInt64BE( value );
-			flags = MH_TYPE_BIGINT;
-		}
-		else if (typeof(valueBuf) == 'boolean') {
-			valueBuf = Buffer.alloc(1);
-			valueBuf.writeUInt8( value ? 1 : 0 );
-			flags = MH_TYPE_BOOLEAN;
-		}
-		else {
-			valueBuf = Buffer.from(''+value, 'utf8');
-			flags = MH_TYPE_STRING;
-		}
-	}
+const MH_FLAGS_MISSING = 0xFF;
+const MH_MAX_KEY_LENGTH = 65535;
+const MH_CURSOR_STATE_SIZE = 16;
+const MH_INTMAP_STATE_SIZE = 8;
+const MH_CURSOR_BATCH_SIZE = 1000;
+
+MegaHash.prototype.set = function(key, value, opts) {
+	// store key/value in hash, auto-convert format to buffer (strings and objects are encoded natively)
+	// opts.ttl sets the key to expire after that many ms
+	var keyArg = toKeyArg(key);
+	var arg = toValueArg(value);
 	
-	return this._set(keyBuf, valueBuf, flags);
+	if (opts && opts.ttl) return this._set(keyArg, arg[1], arg[0], toExpires(opts));
+	return this._set(keyArg, arg[1], arg[0]);
 };
 
 MegaHash.prototype.get = function(key) {
 	// fetch value given key, auto-convert back to original format
-	var keyBuf = Buffer.isBuffer(key) ? key : Buffer.from(''+key, 'utf8');
-	if (!keyBuf.length) throw new Error("Key must have length");
+	var keyArg = toKeyArg(key);
+	
+	var value = this._get( keyArg );
+	if (!value || !value.flags) return value;
+	
+	return decodeValue( value, value.flags );
+};
+
+MegaHash.prototype.getInto = function(key, buf, offset) {
+	// fetch raw value bytes straight into caller's buffer, at optional offset (no allocation)
+	// returns value length, or -1 if not found (nothing is copied if value doesn't fit)
+	var keyArg = toKeyArg(key);
+	if (!Buffer.isBuffer(buf)) throw new Error("Target must be a Buffer");
 	
-	var value = this._get( keyBuf );
+	return this._getInto( keyArg, buf, offset || 0 );
+};
+
+MegaHash.prototype.getView = function(key) {
+	// fetch value without copying, auto-convert back to original format
+	// buffer values point straight into hash memory: read-only, and only valid until the hash is next modified
+	var keyArg = toKeyArg(key);
+	
+	var value = this._getView( keyArg );
 	if (!value || !value.flags) return value;
 	
-	switch (value.flags) {
+	return decodeValue( value, value.flags );
+};
+
+MegaHash.prototype.getField = function(key, path) {
+	// fetch one field of an object value, given path as "a.b.0" or [ "a", "b", 0 ]
+	// packed objects are walked natively, so only the field itself is decoded
+	var keyArg = toKeyArg(key);
+	var parts = Array.isArray(path) ? path.map( String ) : ('' + path).split('.');
+	var value = this._getField( keyArg, parts );
+	
+	if (Buffer.isBuffer(value) && (value.flags === MH_TYPE_OBJECT)) {
+		// stored as JSON, so walk it here (only own enumerable properties, same as the native walk)
+		value = JSON.parse( value.toString() );
+		for (var idx = 0; idx < parts.length; idx++) {
+			if ((value === null) || (typeof(value) != 'object') || !Object.prototype.propertyIsEnumerable.call(value, parts[idx])) return undefined;
+			value = value[ parts[idx] ];
+		}
+	}
+	
+	return value;
+};
+
+MegaHash.prototype.has = function(key) {
+	// check existence of key
+	var keyArg = toKeyArg(key);
+	
+	return this._has( keyArg );
+};
+
+MegaHash.prototype.remove = MegaHash.prototype.delete = function(key) {
+	// remove key/value pair given key
+	var keyArg = toKeyArg(key);
+	
+	return this._remove( keyArg );
+};
+
+MegaHash.prototype.incr = function(key, delta) {
+	// add delta (default 1) to a Number or BigInt value natively, in one lookup, returns the new value
+	// missing keys start at 0, in the type of delta
+	if (typeof(delta) == 'undefined') delta = 1;
+	if ((typeof(delta) != 'number') && (typeof(delta) != 'bigint')) throw new TypeError("Delta must be a Number or BigInt");
+	return this._incr( toKeyArg(key), delta );
+};
+
+MegaHash.prototype.append = function(key, data) {
+	// append string or Buffer to a string or Buffer value natively, in one lookup, returns new length in bytes
+	// missing keys start empty, as a string or Buffer like data
+	if ((typeof(data) != 'string') && !Buffer.isBuffer(data)) data = '' + data;
+	return this._append( toKeyArg(key), data );
+};
+
+MegaHash.prototype.compareAndSet = function(key, expected, value, opts) {
+	// replace value only if it currently equals expected (same type, and same bytes once encoded), in one lookup
+	// pass undefined as expected to only store if the key is missing, returns true if the value was stored
+	var keyArg = toKeyArg(key);
+	var expectedArg = (typeof(expected) == 'undefined') ? [ 0, undefined ] : toValueArg(expected);
+	var arg = toValueArg(value);
+	return this._compareAndSet( keyArg, expectedArg[1], expectedArg[0], arg[1], arg[0], toExpires(opts) );
+};
+
+MegaHash.prototype.setIfAbsent = function(key, value, opts) {
+	// store value only if key is missing (or expired), in one lookup, returns true if stored
+	var arg = toValueArg(value);
+	return this._setIfAbsent( toKeyArg(key), arg[1], arg[0], toExpires(opts), false );
+};
+
+MegaHash.prototype.getOrSet = function(key, value, opts) {
+	// fetch current value, or store value if key is missing (or expired) and return it, in one lookup
+	var arg = toValueArg(value);
+	var current = this._setIfAbsent( toKeyArg(key), arg[1], arg[0], toExpires(opts), true );
+	
+	// existing values never come back as a boolean (those are buffers with flags until decoded)
+	if ((current === true) || (current === false)) return value;
+	if (!current || !current.flags) return current;
+	return decodeValue( current, current.flags );
+};
+
+MegaHash.prototype.nextKey = function(key) {
+	// get next key given previous (or omit for first key)
+	// convert all keys to strings
+	if (typeof(key) == 'undefined') {
+		var keyBuf = this._firstKey();
+		return keyBuf ? keyBuf.toString() : undefined;
+	}
+	else {
+		var keyBuf = this._nextKey( toKeyArg(key) );
+		return keyBuf ? keyBuf.toString() : undefined;
+	}
+};
+
+function toKeyArg(key) {
+	// strings and buffers are passed to native methods as-is (no Buffer.from per call)
+	if ((typeof(key) != 'string') && !Buffer.isBuffer(key)) key = '' + key;
+	if (!key.length) throw new Error("Key must have length");
+	return key;
+}
+
+function toValueArg(value) {
+	// convert value to [flags, data] for native calls which store a single value (see set)
+	// data is a buffer or a string, and objects are sent as JSON, which is packed natively
+	if (Buffer.isBuffer(value)) return [ MH_TYPE_BUFFER, value ];
+	if (value === null) return [ MH_TYPE_NULL, '' ];
+	
+	var buf;
+	switch (typeof(value)) {
+		case 'object':
+			// JSON is packed natively into a smaller binary form, see getField()
+			return [ MH_TYPE_PACKED, JSON.stringify(value) ];
+		
+		case 'number':
+			buf = Buffer.alloc(8);
+			buf.writeDoubleBE( value );
+			return [ MH_TYPE_NUMBER, buf ];
+		
+		case 'bigint':
+			buf = Buffer.alloc(8);
+			buf.writeBigInt64BE( value );
+			return [ MH_TYPE_BIGINT, buf ];
+		
+		case 'boolean':
+			return [ MH_TYPE_BOOLEAN, Buffer.from([ value ? 1 : 0 ]) ];
+	}
+	
+	return [ MH_TYPE_STRING, ''+value ];
+}
+
+function toExpires(opts) {
+	// convert opts.ttl (ms) to expiry time in ms since epoch, or undefined for never
+	return (opts && opts.ttl) ? Date.now() + Math.max(1, opts.ttl) : undefined;
+}
+
+function decodeValue(value, flags) {
+	// convert raw buffer back to original format given type flags
+	switch (flags) {
 		case MH_TYPE_NULL:
 			value = null;
 		break;
@@ -69,6 +201,10 @@ MegaHash.prototype.get = function(key) {
 			value = JSON.parse( value.toString() ); 
 		break;
 		
+		case MH_TYPE_PACKED:
+			value = MegaHash._unpack( value );
+		break;
+		
 		case MH_TYPE_NUMBER:
 			value = value.readDoubleBE();
 		break;
@@ -87,35 +223,327 @@ MegaHash.prototype.get = function(key) {
 	}
 	
 	return value;
-};
+}
 
-MegaHash.prototype.has = function(key) {
-	// check existence of key
-	var keyBuf = Buffer.isBuffer(key) ? key : Buffer.from(''+key, 'utf8');
-	if (!keyBuf.length) throw new Error("Key must have length");
+function encodeValue(value) {
+	// convert value to [flags, data] for batch packing
+	// data is a buffer, or a string which is written straight into the packed buffer
+	if (Buffer.isBuffer(value)) return [ MH_TYPE_BUFFER, value ];
+	if (value === null) return [ MH_TYPE_NULL, '' ];
 	
-	return this._has( keyBuf );
+	var buf;
+	switch (typeof(value)) {
+		case 'object':
+			value = JSON.stringify(value);
+			buf = MegaHash._pack( value );
+			if (buf) return [ MH_TYPE_PACKED, buf ];
+			return [ MH_TYPE_OBJECT, value ];
+		
+		case 'number':
+			buf = Buffer.alloc(8);
+			buf.writeDoubleBE( value );
+			return [ MH_TYPE_NUMBER, buf ];
+		
+		case 'bigint':
+			buf = Buffer.alloc(8);
+			buf.writeBigInt64BE( value );
+			return [ MH_TYPE_BIGINT, buf ];
+		
+		case 'boolean':
+			return [ MH_TYPE_BOOLEAN, Buffer.from([ value ? 1 : 0 ]) ];
+	}
+	
+	return [ MH_TYPE_STRING, ''+value ];
+}
+
+function packKeys(keys) {
+	// pack array of keys into one buffer for batch calls: 16-bit LE length, then key bytes
+	var count = keys.length;
+	var size = 0;
+	var idx, key, len;
+	
+	for (idx = 0; idx < count; idx++) {
+		key = keys[idx];
+		len = Buffer.isBuffer(key) ? key.length : Buffer.byteLength(''+key, 'utf8');
+		if (!len) throw new Error("Key must have length");
+		if (len > MH_MAX_KEY_LENGTH) throw new Error("Key is too long");
+		size += 2 + len;
+	}
+	
+	var packed = Buffer.allocUnsafe(size);
+	var offset = 0;
+	
+	for (idx = 0; idx < count; idx++) {
+		key = keys[idx];
+		if (Buffer.isBuffer(key)) len = key.copy( packed, offset + 2 );
+		else len = packed.write( ''+key, offset + 2, 'utf8' );
+		packed.writeUInt16LE( len, offset );
+		offset += 2 + len;
+	}
+	
+	return packed;
+}
+
+function packPairs(pairs) {
+	// pack key/value pairs into one buffer for batch calls
+	// pairs may be an array of [key, value] arrays, a Map, or a plain object
+	// each record is: 16-bit LE key length, key, flags byte, 32-bit LE value length, value
+	if (!Array.isArray(pairs)) pairs = (pairs instanceof Map) ? Array.from(pairs) : Object.entries(pairs);
+	var count = pairs.length;
+	var encoded = new Array(count);
+	var size = 0;
+	var idx, key, value, keyLen, valueLen;
+	
+	for (idx = 0; idx < count; idx++) {
+		key = pairs[idx][0];
+		keyLen = Buffer.isBuffer(key) ? key.length : Buffer.byteLength(''+key, 'utf8');
+		if (!keyLen) throw new Error("Key must have length");
+		if (keyLen > MH_MAX_KEY_LENGTH) throw new Error("Key is too long");
+		
+		value = encoded[idx] = encodeValue( pairs[idx][1] );
+		valueLen = Buffer.isBuffer(value[1]) ? value[1].length : Buffer.byteLength(value[1], 'utf8');
+		size += 2 + keyLen + 1 + 4 + valueLen;
+	}
+	
+	var packed = Buffer.allocUnsafe(size);
+	var offset = 0;
+	
+	for (idx = 0; idx < count; idx++) {
+		key = pairs[idx][0];
+		if (Buffer.isBuffer(key)) keyLen = key.copy( packed, offset + 2 );
+		else keyLen = packed.write( ''+key, offset + 2, 'utf8' );
+		packed.writeUInt16LE( keyLen, offset );
+		offset += 2 + keyLen;
+		
+		value = encoded[idx];
+		packed.writeUInt8( value[0], offset );
+		if (Buffer.isBuffer(value[1])) valueLen = value[1].copy( packed, offset + 5 );
+		else valueLen = packed.write( value[1], offset + 5, 'utf8' );
+		packed.writeUInt32LE( valueLen, offset + 1 );
+		offset += 5 + valueLen;
+	}
+	
+	packed.count = count;
+	return packed;
+}
+
+function unpackPairs(packed) {
+	// unpack key/value records (same layout as packPairs) into array of [key, value] arrays
+	// keys are converted to strings, values back to their original types
+	var pairs = [];
+	var offset = 0;
+	var keyLen, key, flags, valueLen, value;
+	
+	while (offset < packed.length) {
+		keyLen = packed.readUInt16LE( offset );
+		key = packed.toString( 'utf8', offset + 2, offset + 2 + keyLen );
+		offset += 2 + keyLen;
+		
+		flags = packed.readUInt8( offset );
+		valueLen = packed.readUInt32LE( offset + 1 );
+		offset += 5;
+		
+		value = packed.subarray( offset, offset + valueLen );
+		offset += valueLen;
+		
+		pairs.push([ key, flags ? decodeValue(value, flags) : value ]);
+	}
+	
+	return pairs;
+}
+
+MegaHash.prototype.setMany = function(pairs, opts) {
+	// store many key/value pairs in one native call, big batches are stored by multiple threads (opts.threads)
+	// returns array of result codes (same as set), one per pair
+	var packed = packPairs(pairs);
+	return Array.from( this._setMany(packed, packed.count, numThreads(opts)) );
 };
 
-MegaHash.prototype.remove = MegaHash.prototype.delete = function(key) {
-	// remove key/value pair given key
-	var keyBuf = Buffer.isBuffer(key) ? key : Buffer.from(''+key, 'utf8');
-	if (!keyBuf.length) throw new Error("Key must have length");
+MegaHash.prototype.setManyAsync = function(pairs, opts) {
+	// store many key/value pairs on the threadpool, returns promise of result codes array
+	// the pairs are packed on the main thread first, so this cannot be used to defer JSON serialization
+	var packed = packPairs(pairs);
+	return this._setManyAsync(packed, packed.count, numThreads(opts)).then( function(results) {
+		return Array.from(results);
+	} );
+};
+
+MegaHash.prototype.forEachBatchAsync = function(batchSize, callback) {
+	// scan all key/value pairs, gathering each batch on the threadpool
+	// callback is fired with an array of [key, value] arrays for each batch, and may return a promise
+	// return false from callback (or resolve false) to stop early
+	// resolves with total number of pairs visited
+	var self = this;
+	var total = 0;
+	var state = Buffer.alloc( MH_CURSOR_STATE_SIZE );
+	if (!batchSize || (batchSize < 1)) batchSize = MH_CURSOR_BATCH_SIZE;
 	
-	return this._remove( keyBuf );
+	return new Promise( function(resolve, reject) {
+		function nextBatch() {
+			self._scanAsync( state, batchSize ).then( function(packed) {
+				if (!packed.count) return resolve(total);
+				
+				var pairs = unpackPairs(packed);
+				total += pairs.length;
+				
+				return Promise.resolve( callback(pairs) ).then( function(result) {
+					if (result === false) resolve(total);
+					else nextBatch();
+				} );
+			} ).catch( reject );
+		}
+		nextBatch();
+	} );
 };
 
-MegaHash.prototype.nextKey = function(key) {
-	// get next key given previous (or omit for first key)
-	// convert all keys to strings
-	if (typeof(key) == 'undefined') {
-		var keyBuf = this._firstKey();
-		return keyBuf ? keyBuf.toString() : undefined;
+function HashIterator(hash, mode, batchSize) {
+	// iterates over hash using native cursor, fetching keys or entries in batches
+	// mode is one of 'keys', 'values' or 'entries'
+	this.hash = hash;
+	this.mode = mode;
+	this.batchSize = (batchSize > 0) ? batchSize : MH_CURSOR_BATCH_SIZE;
+	this.state = Buffer.alloc( MH_CURSOR_STATE_SIZE );
+	this.packed = null;
+	this.offset = 0;
+	this.done = false;
+}
+
+HashIterator.prototype[Symbol.iterator] = function() {
+	return this;
+};
+
+HashIterator.prototype.next = function() {
+	// return next key, value or [key, value] entry, decoding straight from the packed batch
+	var packed = this.packed;
+	
+	if (!packed || (this.offset >= packed.length)) {
+		if (this.done) return { done: true, value: undefined };
+		packed = this.packed = this.hash._cursorNext( this.state, this.batchSize, this.mode != 'keys' );
+		this.offset = 0;
+		if (!packed.length) {
+			this.done = true;
+			this.packed = null;
+			return { done: true, value: undefined };
+		}
 	}
-	else {
-		var keyBuf = this._nextKey( Buffer.isBuffer(key) ? key : Buffer.from(''+key, 'utf8') );
-		return keyBuf ? keyBuf.toString() : undefined;
+	
+	var offset = this.offset;
+	var keyLen = packed.readUInt16LE( offset );
+	var key = (this.mode != 'values') ? packed.toString( 'utf8', offset + 2, offset + 2 + keyLen ) : null;
+	offset += 2 + keyLen;
+	
+	if (this.mode == 'keys') {
+		this.offset = offset;
+		return { done: false, value: key };
 	}
+	
+	var flags = packed.readUInt8( offset );
+	var valueLen = packed.readUInt32LE( offset + 1 );
+	offset += 5;
+	
+	// buffer values are views into the batch buffer (which is never reused)
+	var value = packed.subarray( offset, offset + valueLen );
+	if (flags) value = decodeValue( value, flags );
+	this.offset = offset + valueLen;
+	
+	return { done: false, value: (this.mode == 'values') ? value : [ key, value ] };
+};
+
+MegaHash.prototype.keys = function(batchSize) {
+	// iterate over all keys (as strings), fetching batchSize keys per native call
+	return new HashIterator( this, 'keys', batchSize );
+};
+
+MegaHash.prototype.values = function(batchSize) {
+	// iterate over all values, fetching batchSize values per native call
+	return new HashIterator( this, 'values', batchSize );
+};
+
+MegaHash.prototype.entries = MegaHash.prototype[Symbol.iterator] = function(batchSize) {
+	// iterate over all [key, value] entries, fetching batchSize entries per native call
+	return new HashIterator( this, 'entries', batchSize );
+};
+
+MegaHash.prototype.getMany = function(keys) {
+	// fetch many values in one native call, returns array of values (undefined if not found)
+	var count = keys.length;
+	var data = this._getMany( packKeys(keys), count );
+	var offsets = data.offsets;
+	var flags = data.flags;
+	var values = new Array(count);
+	var start, end, value;
+	
+	for (var idx = 0; idx < count; idx++) {
+		if (flags[idx] == MH_FLAGS_MISSING) continue;
+		start = offsets.readUInt32LE( idx * 4 );
+		end = offsets.readUInt32LE( (idx + 1) * 4 );
+		
+		// buffer values are views into the shared result buffer
+		value = data.subarray( start, end );
+		values[idx] = flags[idx] ? decodeValue( value, flags[idx] ) : value;
+	}
+	
+	return values;
+};
+
+MegaHash.prototype.hasMany = function(keys) {
+	// check existence of many keys in one native call, returns array of booleans
+	var results = this._hasMany( packKeys(keys), keys.length );
+	var bools = new Array(keys.length);
+	for (var idx = 0; idx < keys.length; idx++) bools[idx] = !!results[idx];
+	return bools;
+};
+
+MegaHash.prototype.removeMany = MegaHash.prototype.deleteMany = function(keys) {
+	// remove many keys in one native call, returns array of booleans (true if found)
+	var results = this._removeMany( packKeys(keys), keys.length );
+	var bools = new Array(keys.length);
+	for (var idx = 0; idx < keys.length; idx++) bools[idx] = !!results[idx];
+	return bools;
+};
+
+MegaHash.prototype.share = function() {
+	// get handle for sharing this hash with worker_threads (see MegaHash.attach)
+	// this switches the hash into concurrent mode, if it isn't already
+	return this._share();
+};
+
+MegaHash.attach = function(handle) {
+	// attach to hash shared by another thread, given handle from share()
+	if (typeof(handle) != 'number') throw new Error("Invalid shared hash handle");
+	return new MegaHash({ attach: handle });
+};
+
+MegaHash.prototype.save = function(path) {
+	// save all keys/values to binary snapshot file (see MegaHash.load)
+	return this._save( '' + path );
+};
+
+MegaHash.prototype.saveAsync = function(path) {
+	// save binary snapshot file on the threadpool, returns promise
+	return this._saveAsync( '' + path );
+};
+
+function numThreads(opts) {
+	// number of threads for snapshot loads and bulk stores, defaults to one per CPU
+	var threads = (opts && opts.threads) ? parseInt(opts.threads, 10) : os.cpus().length;
+	return (threads > 0) ? threads : 1;
+}
+
+MegaHash.load = function(path, opts) {
+	// create new hash from binary snapshot file written by save()
+	// opts are passed to the constructor, plus optional threads (the hash algorithm comes from the file)
+	var hash = new MegaHash(opts);
+	hash._load( '' + path, numThreads(opts) );
+	return hash;
+};
+
+MegaHash.loadAsync = function(path, opts) {
+	// create new hash from binary snapshot file on the threadpool, returns promise of hash
+	var hash = new MegaHash(opts);
+	return hash._loadAsync( '' + path, numThreads(opts) ).then( function() {
+		return hash;
+	} );
 };
 
 MegaHash.prototype.length = function() {
@@ -123,4 +551,101 @@ MegaHash.prototype.length = function() {
 	return this.stats().numKeys;
 }
 
+// IntMap: hash table for non-negative integer keys (Numbers or BigInts)
+// numbers, bigints, booleans, null and strings are converted natively, so only objects need any work here
+
+function decodeIntValue(value) {
+	// values come back in their original type, except objects which could not be packed (JSON buffers with flags)
+	return (Buffer.isBuffer(value) && value.flags) ? decodeValue( value, value.flags ) : value;
+}
+
+IntMap.prototype.set = function(key, value) {
+	// store key/value in table, returns result code (same as MegaHash)
+	if ((typeof(value) == 'object') && (value !== null) && !Buffer.isBuffer(value)) {
+		return this._set( key, JSON.stringify(value), MH_TYPE_PACKED );
+	}
+	if ((typeof(value) == 'undefined') || (typeof(value) == 'function')) value = '' + value;
+	return this._set( key, value );
+};
+
+IntMap.prototype.get = function(key) {
+	// fetch value given key, in its original type
+	return decodeIntValue( this._get(key) );
+};
+
+IntMap.prototype.has = function(key) {
+	// check existence of key
+	return this._has( key );
+};
+
+IntMap.prototype.remove = IntMap.prototype.delete = function(key) {
+	// remove key/value pair given key
+	return this._remove( key );
+};
+
+IntMap.prototype.length = function() {
+	// shortcut for numKeys
+	return this.stats().numKeys;
+};
+
+const MH_INTMAP_MODES = { keys: 0, values: 1, entries: 2 };
+
+function IntMapIterator(map, mode, batchSize) {
+	// iterates over IntMap using native cursor, fetching keys, values or entries in batches
+	// each batch is a flat array (key, value, key, value... for entries)
+	this.map = map;
+	this.mode = MH_INTMAP_MODES[mode];
+	this.batchSize = (batchSize > 0) ? batchSize : MH_CURSOR_BATCH_SIZE;
+	this.state = Buffer.alloc( MH_INTMAP_STATE_SIZE );
+	this.batch = null;
+	this.offset = 0;
+	this.done = false;
+}
+
+IntMapIterator.prototype[Symbol.iterator] = function() {
+	return this;
+};
+
+IntMapIterator.prototype.next = function() {
+	// return next key, value or [key, value] entry
+	var batch = this.batch;
+	
+	if (!batch || (this.offset >= batch.length)) {
+		if (this.done) return { done: true, value: undefined };
+		batch = this.batch = this.map._cursorNext( this.state, this.batchSize, this.mode );
+		this.offset = 0;
+		if (!batch.length) {
+			this.done = true;
+			this.batch = null;
+			return { done: true, value: undefined };
+		}
+	}
+	
+	if (this.mode == MH_INTMAP_MODES.entries) {
+		var entry = [ batch[this.offset], decodeIntValue(batch[this.offset + 1]) ];
+		this.offset += 2;
+		return { done: false, value: entry };
+	}
+	
+	var value = batch[ this.offset++ ];
+	return { done: false, value: (this.mode == MH_INTMAP_MODES.values) ? decodeIntValue(value) : value };
+};
+
+IntMap.prototype.keys = function(batchSize) {
+	// iterate over all keys (Numbers, or BigInts above 2^53 - 1), fetching batchSize keys per native call
+	return new IntMapIterator( this, 'keys', batchSize );
+};
+
+IntMap.prototype.values = function(batchSize) {
+	// iterate over all values, fetching batchSize values per native call
+	return new IntMapIterator( this, 'values', batchSize );
+};
+
+IntMap.prototype.entries = IntMap.prototype[Symbol.iterator] = function(batchSize) {
+	// iterate over all [key, value] entries, fetching batchSize entries per native call
+	return new IntMapIterator( this, 'entries', batchSize );
+};
+
+MegaHash.IntMap = IntMap;
+
 module.exports = MegaHash;
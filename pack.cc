@@ -0,0 +1,632 @@
+// MegaHash v1.0
+// Copyright (c) 2019 Joseph Huckaby
+// Based on DeepHash, (c) 2003 Joseph Huckaby
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include "pack.h"
+
+// Object values are stored in MessagePack format (https://msgpack.org), which is smaller than JSON,
+// and can be walked to read a single field without converting the rest.  V8's own JSON.stringify()
+// and JSON.parse() are still used at the edges, as they are far faster at turning objects into text
+// and back than walking them property by property through napi.  So packJSON() transcodes JSON text
+// into MessagePack, and unpacking writes JSON text back out, which is handed to JSON.parse().
+// Only the subset needed for JSON is used: nil, booleans, integers, float64, strings, arrays, and maps.
+// Strings may hold lone surrogates (valid in JSON text, e.g. "\ud800"), which are kept as 3-byte
+// sequences (WTF-8) and escaped again on the way out, so every value comes back exactly as JSON would.
+
+/** Largest integer stored in an int format (2^53 - 1, the largest a JS Number holds exactly). */
+#define MH_PACK_MAX_SAFE 9007199254740991.0
+
+/** \name Decoded MessagePack token kinds: */
+//@{
+#define MH_TOKEN_NIL 0
+#define MH_TOKEN_BOOL 1
+#define MH_TOKEN_INT 2
+#define MH_TOKEN_FLOAT 3
+#define MH_TOKEN_STR 4
+#define MH_TOKEN_ARRAY 5
+#define MH_TOKEN_MAP 6
+//@}
+
+static void putBE(std::string &out, uint64_t value, int numBytes) {
+	// append big-endian unsigned integer
+	for (int idx = numBytes - 1; idx >= 0; idx--) out.push_back( (char)((value >> (idx * 8)) & 0xFF) );
+}
+
+static uint64_t getBE(unsigned char *ptr, int numBytes) {
+	// read big-endian unsigned integer
+	uint64_t value = 0;
+	for (int idx = 0; idx < numBytes; idx++) value = (value << 8) | ptr[idx];
+	return value;
+}
+
+static void putUTF8(std::string &out, uint32_t code) {
+	// append code point as UTF-8 (surrogates come out as 3 bytes, like any other BMP char)
+	if (code < 0x80) out.push_back( (char)code );
+	else if (code < 0x800) {
+		out.push_back( (char)(0xC0 | (code >> 6)) );
+		out.push_back( (char)(0x80 | (code & 0x3F)) );
+	}
+	else if (code < 0x10000) {
+		out.push_back( (char)(0xE0 | (code >> 12)) );
+		out.push_back( (char)(0x80 | ((code >> 6) & 0x3F)) );
+		out.push_back( (char)(0x80 | (code & 0x3F)) );
+	}
+	else {
+		out.push_back( (char)(0xF0 | (code >> 18)) );
+		out.push_back( (char)(0x80 | ((code >> 12) & 0x3F)) );
+		out.push_back( (char)(0x80 | ((code >> 6) & 0x3F)) );
+		out.push_back( (char)(0x80 | (code & 0x3F)) );
+	}
+}
+
+static void packNumber(std::string &out, double num) {
+	// integers use the smallest int format that fits, everything else is float64
+	if ((num == floor(num)) && (fabs(num) <= MH_PACK_MAX_SAFE)) {
+		int64_t value = (int64_t)num;
+		if (value >= 0) {
+			if (value < 0x80) out.push_back( (char)value );
+			else if (value <= 0xFF) { out.push_back( (char)0xCC ); putBE( out, value, 1 ); }
+			else if (value <= 0xFFFF) { out.push_back( (char)0xCD ); putBE( out, value, 2 ); }
+			else if (value <= 0xFFFFFFFFLL) { out.push_back( (char)0xCE ); putBE( out, value, 4 ); }
+			else { out.push_back( (char)0xCF ); putBE( out, value, 8 ); }
+		}
+		else {
+			if (value >= -32) out.push_back( (char)(uint8_t)value );
+			else if (value >= -128) { out.push_back( (char)0xD0 ); putBE( out, (uint64_t)value, 1 ); }
+			else if (value >= -32768) { out.push_back( (char)0xD1 ); putBE( out, (uint64_t)value, 2 ); }
+			else if (value >= -2147483648LL) { out.push_back( (char)0xD2 ); putBE( out, (uint64_t)value, 4 ); }
+			else { out.push_back( (char)0xD3 ); putBE( out, (uint64_t)value, 8 ); }
+		}
+		return;
+	}
+	
+	uint64_t bits;
+	memcpy( (void *)&bits, (void *)&num, sizeof(double) );
+	out.push_back( (char)0xCB );
+	putBE( out, bits, 8 );
+}
+
+static size_t packHeader(unsigned char *header, unsigned char fixType, uint32_t fixMax, unsigned char type8, unsigned char type16, uint32_t count) {
+	// build str, array or map header for count into header (up to 5 bytes), returns its size
+	// (type8 is 0 for arrays and maps, which have no 8-bit form, and the 32-bit type always follows the 16-bit one)
+	if (count <= fixMax) { header[0] = (unsigned char)(fixType | count); return 1; }
+	if (type8 && (count <= 0xFF)) { header[0] = type8; header[1] = (unsigned char)count; return 2; }
+	if (count <= 0xFFFF) { header[0] = type16; header[1] = (unsigned char)(count >> 8); header[2] = (unsigned char)count; return 3; }
+	
+	header[0] = (unsigned char)(type16 + 1);
+	for (int idx = 0; idx < 4; idx++) header[1 + idx] = (unsigned char)(count >> (24 - (idx * 8)));
+	return 5;
+}
+
+static void fixHeader(std::string &out, size_t pos, unsigned char fixType, uint32_t fixMax, unsigned char type8, unsigned char type16, uint32_t count) {
+	// write header into the 5 bytes reserved at pos, once the count is known, sliding the body down if it is shorter
+	unsigned char header[5];
+	size_t headerSize = packHeader( header, fixType, fixMax, type8, type16, count );
+	
+	if (headerSize < 5) memmove( (void *)&out[pos + headerSize], (void *)&out[pos + 5], out.size() - (pos + 5) );
+	memcpy( (void *)&out[pos], (void *)header, headerSize );
+	out.resize( out.size() - (5 - headerSize) );
+}
+
+class JSONPacker {
+public:
+	// transcodes JSON text into MessagePack
+	// any malformed input sets error (JSON.stringify() output never is, but _pack() takes any string)
+	const char *ptr;
+	const char *end;
+	std::string &out;
+	int error;
+	
+	JSONPacker(const char *json, size_t length, std::string &newOut) : out(newOut) {
+		ptr = json;
+		end = json + length;
+		error = 0;
+	}
+	
+	void skipSpace() {
+		while ((ptr < end) && ((*ptr == ' ') || (*ptr == '\t') || (*ptr == '\n') || (*ptr == '\r'))) ptr++;
+	}
+	
+	int fail() {
+		error = 1;
+		return 0;
+	}
+	
+	int literal(const char *word, unsigned char type) {
+		// true, false or null
+		size_t length = strlen(word);
+		if (((size_t)(end - ptr) < length) || memcmp(ptr, word, length)) return fail();
+		ptr += length;
+		out.push_back( (char)type );
+		return 1;
+	}
+	
+	int hex4(uint32_t *code) {
+		// read 4 hex digits of a \u escape
+		if (end - ptr < 4) return fail();
+		code[0] = 0;
+		for (int idx = 0; idx < 4; idx++) {
+			char ch = *ptr++;
+			code[0] <<= 4;
+			if ((ch >= '0') && (ch <= '9')) code[0] |= (uint32_t)(ch - '0');
+			else if ((ch >= 'a') && (ch <= 'f')) code[0] |= (uint32_t)(ch - 'a' + 10);
+			else if ((ch >= 'A') && (ch <= 'F')) code[0] |= (uint32_t)(ch - 'A' + 10);
+			else return fail();
+		}
+		return 1;
+	}
+	
+	int string() {
+		// copy runs of plain bytes at once, decoding escapes in between (raw control chars are not allowed)
+		// most strings have no escapes at all, so their length is known before anything is written
+		const char *start = ++ptr;
+		while ((ptr < end) && (*ptr != '"') && (*ptr != '\\') && ((unsigned char)*ptr >= 0x20)) ptr++;
+		if ((ptr < end) && (*ptr == '"')) {
+			unsigned char header[5];
+			out.append( (char *)header, packHeader(header, 0xA0, 0x1F, 0xD9, 0xDA, (uint32_t)(ptr - start)) );
+			out.append( start, ptr - start );
+			ptr++;
+			return 1;
+		}
+		
+		size_t pos = out.size();
+		out.append( 5, '\0' );
+		ptr = start;
+		
+		for (;;) {
+			const char *run = ptr;
+			while ((ptr < end) && (*ptr != '"') && (*ptr != '\\') && ((unsigned char)*ptr >= 0x20)) ptr++;
+			out.append( run, ptr - run );
+			if ((ptr >= end) || ((unsigned char)*ptr < 0x20)) return fail();
+			if (*ptr++ == '"') break;
+			
+			if (ptr >= end) return fail();
+			char ch = *ptr++;
+			uint32_t code;
+			switch (ch) {
+				case '"': case '\\': case '/': out.push_back( ch ); break;
+				case 'b': out.push_back( '\b' ); break;
+				case 'f': out.push_back( '\f' ); break;
+				case 'n': out.push_back( '\n' ); break;
+				case 'r': out.push_back( '\r' ); break;
+				case 't': out.push_back( '\t' ); break;
+				
+				case 'u':
+					if (!hex4(&code)) return 0;
+					if ((code >= 0xD800) && (code < 0xDC00) && (end - ptr >= 6) && (ptr[0] == '\\') && (ptr[1] == 'u')) {
+						// surrogate pair, unless the next escape turns out not to be a low surrogate
+						const char *save = ptr;
+						uint32_t low;
+						ptr += 2;
+						if (hex4(&low) && (low >= 0xDC00) && (low < 0xE000)) code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+						else { ptr = save; error = 0; }
+					}
+					putUTF8( out, code );
+				break;
+				
+				default: return fail();
+			}
+		}
+		
+		fixHeader( out, pos, 0xA0, 0x1F, 0xD9, 0xDA, (uint32_t)(out.size() - pos - 5) );
+		return 1;
+	}
+	
+	int isDigit() {
+		return (ptr < end) && (*ptr >= '0') && (*ptr <= '9');
+	}
+	
+	int number() {
+		// JSON number syntax, converted with strtod unless it is short enough to convert exactly right here:
+		// up to 15 digits and no exponent means both the digits and the power of 10 are exact doubles,
+		// and division is correctly rounded, so the result is the same as strtod's
+		static const double powers[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15 };
+		const char *start = ptr;
+		int negative = 0;
+		if ((ptr < end) && (*ptr == '-')) { negative = 1; ptr++; }
+		if (!isDigit()) return fail();
+		if ((*ptr == '0') && (ptr + 1 < end) && (ptr[1] >= '0') && (ptr[1] <= '9')) return fail();
+		
+		int64_t value = 0;
+		int numDigits = 0;
+		int places = 0;
+		while (isDigit() && (numDigits < 15)) { value = (value * 10) + (*ptr++ - '0'); numDigits++; }
+		if ((ptr < end) && (*ptr == '.')) {
+			ptr++;
+			if (!isDigit()) return fail();
+			while (isDigit() && (numDigits < 15)) { value = (value * 10) + (*ptr++ - '0'); numDigits++; places++; }
+		}
+		if (!isDigit() && ((ptr >= end) || ((*ptr != '.') && (*ptr != 'e') && (*ptr != 'E')))) {
+			double num = (double)value / powers[places];
+			packNumber( out, negative ? -num : num );
+			return 1;
+		}
+		
+		while ((ptr < end) && (((*ptr >= '0') && (*ptr <= '9')) || (*ptr == '.') || (*ptr == 'e') || (*ptr == 'E') || (*ptr == '+') || (*ptr == '-'))) ptr++;
+		
+		char buf[64];
+		std::string longBuf;
+		const char *text = buf;
+		size_t length = ptr - start;
+		if (length < sizeof(buf)) { memcpy( buf, start, length ); buf[length] = '\0'; }
+		else { longBuf.assign( start, length ); text = longBuf.c_str(); }
+		
+		char *numEnd = NULL;
+		double num = strtod( text, &numEnd );
+		if ((size_t)(numEnd - text) != length) return fail();
+		packNumber( out, num );
+		return 1;
+	}
+	
+	int value(int depth) {
+		// transcode next value
+		skipSpace();
+		if (ptr >= end) return fail();
+		
+		switch (*ptr) {
+			case '{': return container( depth, '}' );
+			case '[': return container( depth, ']' );
+			case '"': return string();
+			case 't': return literal( "true", 0xC3 );
+			case 'f': return literal( "false", 0xC2 );
+			case 'n': return literal( "null", 0xC0 );
+		}
+		return number();
+	}
+	
+	int container(int depth, char close) {
+		// array or object, header is written once the count is known
+		if (depth >= MH_PACK_MAX_DEPTH) return fail();
+		size_t pos = out.size();
+		uint32_t count = 0;
+		out.append( 5, '\0' );
+		ptr++;
+		
+		skipSpace();
+		if ((ptr < end) && (*ptr == close)) ptr++;
+		else for (;;) {
+			if (close == '}') {
+				skipSpace();
+				if ((ptr >= end) || (*ptr != '"') || !string()) return fail();
+				skipSpace();
+				if ((ptr >= end) || (*ptr++ != ':')) return fail();
+			}
+			if (!value(depth + 1)) return 0;
+			count++;
+			
+			skipSpace();
+			if (ptr >= end) return fail();
+			if (*ptr == close) { ptr++; break; }
+			if (*ptr++ != ',') return fail();
+		}
+		
+		if (close == '}') fixHeader( out, pos, 0x80, 0x0F, 0, 0xDE, count );
+		else fixHeader( out, pos, 0x90, 0x0F, 0, 0xDC, count );
+		return 1;
+	}
+};
+
+int packJSON(const char *json, size_t length, std::string &out) {
+	// transcode JSON text into MessagePack bytes, returns 0 if it is malformed (or nested too deep)
+	JSONPacker packer( json, length, out );
+	out.reserve( length );
+	if (!packer.value(0)) return 0;
+	packer.skipSpace();
+	return (packer.ptr == packer.end) ? 1 : 0;
+}
+
+class PackToken {
+public:
+	// one decoded MessagePack item (for arrays and maps, just the header)
+	unsigned char kind;
+	uint32_t length; /**< String length in bytes, or number of array elements or map pairs. */
+	double num;
+	unsigned char *str;
+};
+
+class JSONUnpacker {
+public:
+	// reads MessagePack bytes and writes them back out as JSON text
+	// any malformed or truncated input sets error
+	unsigned char *ptr;
+	unsigned char *end;
+	std::string out;
+	int error;
+	
+	JSONUnpacker(unsigned char *data, size_t length) {
+		ptr = data;
+		end = data + length;
+		error = 0;
+	}
+	
+	int need(size_t numBytes) {
+		// make sure numBytes are left, sets error if not
+		if ((size_t)(end - ptr) >= numBytes) return 1;
+		error = 1;
+		return 0;
+	}
+	
+	int readNumber(PackToken *token, int numBytes, int isSigned, int isFloat) {
+		// read int or float body following the type byte
+		if (!need(numBytes)) return 0;
+		uint64_t bits = getBE( ptr, numBytes );
+		ptr += numBytes;
+		
+		if (isFloat && (numBytes == 4)) {
+			uint32_t bits32 = (uint32_t)bits;
+			float value;
+			memcpy( (void *)&value, (void *)&bits32, sizeof(float) );
+			token->num = value;
+		}
+		else if (isFloat) memcpy( (void *)&token->num, (void *)&bits, sizeof(double) );
+		else if (isSigned) {
+			// sign extend
+			int shift = 64 - (numBytes * 8);
+			token->num = (double)((int64_t)(bits << shift) >> shift);
+		}
+		else token->num = (double)bits;
+		
+		token->kind = isFloat ? MH_TOKEN_FLOAT : MH_TOKEN_INT;
+		return 1;
+	}
+	
+	int readLength(PackToken *token, unsigned char kind, int numBytes) {
+		// read str, array or map length following the type byte (numBytes 0 means it was in the type byte)
+		if (numBytes) {
+			if (!need(numBytes)) return 0;
+			token->length = (uint32_t)getBE( ptr, numBytes );
+			ptr += numBytes;
+		}
+		token->kind = kind;
+		
+		// every array element is at least one byte, so this also catches bogus counts early
+		if (!need(token->length)) return 0;
+		if (kind == MH_TOKEN_STR) {
+			token->str = ptr;
+			ptr += token->length;
+		}
+		return 1;
+	}
+	
+	int next(PackToken *token) {
+		// read next token
+		if (!need(1)) return 0;
+		unsigned char type = *ptr++;
+		
+		if (type < 0x80) { token->kind = MH_TOKEN_INT; token->num = type; return 1; }
+		if (type >= 0xE0) { token->kind = MH_TOKEN_INT; token->num = (double)(int8_t)type; return 1; }
+		if (type < 0x90) { token->length = type & 0x0F; return readLength(token, MH_TOKEN_MAP, 0); }
+		if (type < 0xA0) { token->length = type & 0x0F; return readLength(token, MH_TOKEN_ARRAY, 0); }
+		if (type < 0xC0) { token->length = type & 0x1F; return readLength(token, MH_TOKEN_STR, 0); }
+		
+		switch (type) {
+			case 0xC0: token->kind = MH_TOKEN_NIL; return 1;
+			case 0xC2: token->kind = MH_TOKEN_BOOL; token->num = 0; return 1;
+			case 0xC3: token->kind = MH_TOKEN_BOOL; token->num = 1; return 1;
+			case 0xCA: return readNumber(token, 4, 0, 1);
+			case 0xCB: return readNumber(token, 8, 0, 1);
+			case 0xCC: return readNumber(token, 1, 0, 0);
+			case 0xCD: return readNumber(token, 2, 0, 0);
+			case 0xCE: return readNumber(token, 4, 0, 0);
+			case 0xCF: return readNumber(token, 8, 0, 0);
+			case 0xD0: return readNumber(token, 1, 1, 0);
+			case 0xD1: return readNumber(token, 2, 1, 0);
+			case 0xD2: return readNumber(token, 4, 1, 0);
+			case 0xD3: return readNumber(token, 8, 1, 0);
+			case 0xD9: return readLength(token, MH_TOKEN_STR, 1);
+			case 0xDA: return readLength(token, MH_TOKEN_STR, 2);
+			case 0xDB: return readLength(token, MH_TOKEN_STR, 4);
+			case 0xDC: return readLength(token, MH_TOKEN_ARRAY, 2);
+			case 0xDD: return readLength(token, MH_TOKEN_ARRAY, 4);
+			case 0xDE: return readLength(token, MH_TOKEN_MAP, 2);
+			case 0xDF: return readLength(token, MH_TOKEN_MAP, 4);
+		}
+		
+		// bin and ext types are never written
+		error = 1;
+		return 0;
+	}
+	
+	int skip(int depth) {
+		// skip over next value without writing anything
+		PackToken token;
+		if (!next(&token)) return 0;
+		if ((token.kind != MH_TOKEN_ARRAY) && (token.kind != MH_TOKEN_MAP)) return 1;
+		if (depth >= MH_PACK_MAX_DEPTH) { error = 1; return 0; }
+		
+		uint64_t count = (token.kind == MH_TOKEN_MAP) ? (uint64_t)token.length * 2 : token.length;
+		for (uint64_t idx = 0; idx < count; idx++) {
+			if (!skip(depth + 1)) return 0;
+		}
+		return 1;
+	}
+	
+	void writeDecimal(uint64_t value, int negative, int places) {
+		// write value with a decimal point places digits from the right (digits go backwards from the end of buf)
+		char buf[32];
+		char *digit = buf + sizeof(buf);
+		for (int idx = 0; idx < places; idx++) { *--digit = (char)('0' + (value % 10)); value /= 10; }
+		if (places) *--digit = '.';
+		do { *--digit = (char)('0' + (value % 10)); value /= 10; } while (value);
+		if (negative) *--digit = '-';
+		out.append( digit, buf + sizeof(buf) - digit );
+	}
+	
+	void writeNumber(double num) {
+		// text which parses back to exactly the same double (not always the same text JSON.stringify() would use)
+		if ((num == floor(num)) && (fabs(num) <= MH_PACK_MAX_SAFE)) {
+			writeDecimal( (uint64_t)fabs(num), (num < 0), 0 );
+			return;
+		}
+		if (!isfinite(num)) {
+			out.append( "null" );
+			return;
+		}
+		
+		// most fractions have only a few decimal places: if the scaled digits divide back to exactly
+		// this double, the decimal text does too (both parts are exact, and division is correctly rounded)
+		double scale = 1;
+		for (int places = 1; (places <= 8) && (fabs(num) < 1e7); places++) {
+			scale *= 10;
+			double digits = floor( (fabs(num) * scale) + 0.5 );
+			if ((digits / scale) == fabs(num)) {
+				writeDecimal( (uint64_t)digits, (num < 0), places );
+				return;
+			}
+		}
+		
+		char buf[32];
+		snprintf( buf, sizeof(buf), "%.15g", num );
+		if (strtod(buf, NULL) != num) snprintf( buf, sizeof(buf), "%.17g", num );
+		out.append( buf );
+	}
+	
+	void writeString(unsigned char *str, uint32_t length) {
+		// quote and escape string, copying runs of plain bytes at once
+		static const char *hex = "0123456789abcdef";
+		unsigned char *strEnd = str + length;
+		out.push_back( '"' );
+		
+		while (str < strEnd) {
+			unsigned char *run = str;
+			while ((str < strEnd) && (*str >= 0x20) && (*str != '"') && (*str != '\\') && (*str != 0xED)) str++;
+			out.append( (char *)run, str - run );
+			if (str >= strEnd) break;
+			
+			unsigned char ch = *str++;
+			if ((ch == 0xED) && (strEnd - str >= 2) && (str[0] >= 0xA0)) {
+				// lone surrogate (WTF-8), which has to go back out as an escape
+				uint32_t code = 0xD000 | ((uint32_t)(str[0] & 0x3F) << 6) | (str[1] & 0x3F);
+				str += 2;
+				out.append( "\\u" );
+				for (int shift = 12; shift >= 0; shift -= 4) out.push_back( hex[(code >> shift) & 0xF] );
+			}
+			else if (ch == 0xED) out.push_back( (char)ch );
+			else if (ch == '"') out.append( "\\\"" );
+			else if (ch == '\\') out.append( "\\\\" );
+			else if (ch == '\n') out.append( "\\n" );
+			else if (ch == '\r') out.append( "\\r" );
+			else if (ch == '\t') out.append( "\\t" );
+			else {
+				out.append( "\\u00" );
+				out.push_back( hex[ch >> 4] );
+				out.push_back( hex[ch & 0xF] );
+			}
+		}
+		
+		out.push_back( '"' );
+	}
+	
+	int write(int depth) {
+		// write next value as JSON text
+		PackToken token;
+		if (!next(&token)) return 0;
+		
+		switch (token.kind) {
+			case MH_TOKEN_NIL: out.append( "null" ); break;
+			case MH_TOKEN_BOOL: out.append( token.num ? "true" : "false" ); break;
+			case MH_TOKEN_INT:
+			case MH_TOKEN_FLOAT: writeNumber( token.num ); break;
+			case MH_TOKEN_STR: writeString( token.str, token.length ); break;
+			
+			case MH_TOKEN_ARRAY:
+			case MH_TOKEN_MAP: {
+				if (depth >= MH_PACK_MAX_DEPTH) { error = 1; return 0; }
+				int isMap = (token.kind == MH_TOKEN_MAP);
+				out.push_back( isMap ? '{' : '[' );
+				
+				for (uint32_t idx = 0; idx < token.length; idx++) {
+					if (idx) out.push_back( ',' );
+					if (isMap) {
+						PackToken key;
+						if (!next(&key)) return 0;
+						if (key.kind != MH_TOKEN_STR) { error = 1; return 0; }
+						writeString( key.str, key.length );
+						out.push_back( ':' );
+					}
+					if (!write(depth + 1)) return 0;
+				}
+				
+				out.push_back( isMap ? '}' : ']' );
+			} break;
+		}
+		
+		return 1;
+	}
+	
+	int find(std::string &name) {
+		// move to value at name (map key, or array index) within the next value, returns 0 if not there
+		PackToken token;
+		if (!next(&token)) return 0;
+		
+		if (token.kind == MH_TOKEN_ARRAY) {
+			// index must be plain decimal digits
+			if (name.empty() || (name.size() > 10) || ((name[0] == '0') && (name.size() > 1))) return 0;
+			uint64_t index = 0;
+			for (size_t pos = 0; pos < name.size(); pos++) {
+				if ((name[pos] < '0') || (name[pos] > '9')) return 0;
+				index = (index * 10) + (name[pos] - '0');
+			}
+			if (index >= token.length) return 0;
+			
+			for (uint64_t idx = 0; idx < index; idx++) {
+				if (!skip(0)) return 0;
+			}
+			return 1;
+		}
+		
+		if (token.kind == MH_TOKEN_MAP) {
+			// the last matching key wins, same as JSON.parse() with duplicate keys
+			unsigned char *found = NULL;
+			for (uint32_t idx = 0; idx < token.length; idx++) {
+				PackToken key;
+				if (!next(&key) || (key.kind != MH_TOKEN_STR)) return 0;
+				if ((key.length == name.size()) && !memcmp(key.str, name.data(), key.length)) found = ptr;
+				if (!skip(0)) return 0;
+			}
+			if (!found) return 0;
+			ptr = found;
+			return 1;
+		}
+		
+		return 0;
+	}
+};
+
+static Napi::Value parseJSON(Napi::Env env, std::string &json) {
+	// hand JSON text to V8's JSON.parse()
+	napi_value global, jsonObj, parse, text, result;
+	napi_get_global( env, &global );
+	napi_get_named_property( env, global, "JSON", &jsonObj );
+	napi_get_named_property( env, jsonObj, "parse", &parse );
+	napi_create_string_utf8( env, json.data(), json.size(), &text );
+	if (napi_call_function(env, jsonObj, parse, 1, &text, &result) != napi_ok) return env.Undefined();
+	return Napi::Value(env, result);
+}
+
+Napi::Value unpackValue(Napi::Env env, unsigned char *data, size_t length) {
+	// convert MessagePack bytes back into JS value (undefined if malformed)
+	// (JSON text is always longer than the packed form, so reserve a bit extra up front)
+	JSONUnpacker unpacker( data, length );
+	unpacker.out.reserve( length + (length / 2) );
+	if (!unpacker.write(0)) return env.Undefined();
+	return parseJSON( env, unpacker.out );
+}
+
+Napi::Value unpackField(Napi::Env env, unsigned char *data, size_t length, std::vector<std::string> &path) {
+	// walk path of map keys and array indexes, and convert only the value found there
+	// returns undefined if any part of the path is missing
+	JSONUnpacker unpacker( data, length );
+	
+	for (size_t idx = 0; idx < path.size(); idx++) {
+		if (!unpacker.find(path[idx])) return env.Undefined();
+	}
+	
+	if (!unpacker.write(0)) return env.Undefined();
+	return parseJSON( env, unpacker.out );
+}
@@ -0,0 +1,19 @@
+// MegaHash v1.0
+// Copyright (c) 2019 Joseph Huckaby
+// Based on DeepHash, (c) 2003 Joseph Huckaby
+
+#ifndef MH_PACK_H
+#define MH_PACK_H
+
+#include <string>
+#include <vector>
+#include <napi.h>
+
+/** Max nesting of arrays and objects in packed values (deeper values are stored as JSON instead). */
+#define MH_PACK_MAX_DEPTH 256
+
+int packJSON(const char *json, size_t length, std::string &out);
+Napi::Value unpackValue(Napi::Env env, unsigned char *data, size_t length);
+Napi::Value unpackField(Napi::Env env, unsigned char *data, size_t length, std::vector<std::string> &path);
+
+#endif
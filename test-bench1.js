@@ -16,12 +16,14 @@ if (metrics_log_file) {
 var hash = new MegaHash();
 // var map = new Map();
 
-const MAX_KEYS = 100000000;
-const MAX_READS = 4000000;
+const MAX_KEYS = parseInt( args.keys || 100000000 );
+const MAX_READS = parseInt( args.reads || 4000000 );
+const MAX_REPLACES = parseInt( args.replaces || 0 ); // replace-heavy mode, e.g. --replaces 10000000
 const METRICS_EVERY = 1000000;
 
 print("\nMax Keys: " + Tools.commify(MAX_KEYS) + "\n");
 print("Max Reads: " + Tools.commify(MAX_READS) + "\n");
+if (MAX_REPLACES) print("Max Replaces: " + Tools.commify(MAX_REPLACES) + "\n");
 
 print("\nWriting...\n");
 
@@ -67,6 +69,37 @@ print("Overall writes/sec: " + Tools.commify( Math.floor(MAX_KEYS / elapsed) ) +
 print("Raw Data Size: " + Tools.getTextFromBytes(dataBytes) + " (" + Tools.commify(dataBytes) + " bytes)\n");
 memReport();
 
+if (MAX_REPLACES) {
+	// rewrite random existing keys with same-sized values (counter style workload)
+	print("\nReplacing...\n");
+	
+	time_start = Tools.timeNow();
+	last_report = Date.now();
+	iter_per_sec = 0;
+	
+	for (idx = 0; idx < MAX_REPLACES; idx++) {
+		var ridx = Math.floor( Math.random() * MAX_KEYS );
+		keyBuf = Buffer.from('' + ridx);
+		valueBuf = Buffer.from( 'b66f91437d85f726506c3e14b56b3ef474f9e8e5af623f110775d999cc3a46150e20d307201d696a40fe39347576d51d229e8661cef8aa70aa6d45d5b3e49aef'.substring( ridx % 32 ) );
+		valueBuf.writeUInt32BE( idx % 4294967296, 0 );
+		
+		if (hash.set( keyBuf, valueBuf ) != 2) die("Failed to replace key " + idx + ": " + ridx + "\n");
+		
+		if (idx && (idx % METRICS_EVERY == 0)) {
+			now = Date.now();
+			iter_per_sec = Math.floor( METRICS_EVERY / ((now - last_report) / 1000) );
+			mem = process.memoryUsage();
+			print("Replaces/sec: " + Tools.commify(iter_per_sec) + ", Memory: " + Tools.getTextFromBytes(mem.rss) + "\n");
+			last_report = now;
+		}
+	}
+	
+	elapsed = Tools.timeNow() - time_start;
+	print("\n");
+	print("Overall replaces/sec: " + Tools.commify( Math.floor(MAX_REPLACES / elapsed) ) + "\n");
+	memReport();
+}
+
 print("\nReading...\n");
 
 time_start = Tools.timeNow();
@@ -0,0 +1,76 @@
+// Benchmark comparing key digest algorithms (DJB2 vs. wyhash) for MegaHash
+// Uses the same sequential numeric keys as test-bench1.js
+// Usage: node test-bench2.js --keys 10000000 --reads 4000000
+
+var MegaHash = require('.');
+var Tools = require('pixl-tools');
+var cli = require('pixl-cli');
+cli.global();
+
+var args = cli.args;
+
+const MAX_KEYS = parseInt( args.keys || 10000000 );
+const MAX_READS = parseInt( args.reads || 4000000 );
+const VALUE = 'b66f91437d85f726506c3e14b56b3ef474f9e8e5af623f110775d999cc3a46150e20d307201d696a40fe39347576d51d229e8661cef8aa70aa6d45d5b3e49aef';
+
+print("\nMax Keys: " + Tools.commify(MAX_KEYS) + "\n");
+print("Max Reads: " + Tools.commify(MAX_READS) + "\n");
+
+var results = {};
+
+["djb2", "wyhash"].forEach( function(algo) {
+	var hash = new MegaHash({ hash: algo });
+	var idx, ridx, keyBuf, valueBuf, time_start, elapsed;
+
+	print("\nWriting (" + algo + ")...\n");
+	time_start = Tools.timeNow();
+
+	for (idx = 0; idx < MAX_KEYS; idx++) {
+		keyBuf = Buffer.from('' + idx);
+		valueBuf = Buffer.from( VALUE.substring(idx % 32) );
+		hash.set( keyBuf, valueBuf );
+	}
+
+	elapsed = Tools.timeNow() - time_start;
+	var writesSec = Math.floor( MAX_KEYS / elapsed );
+
+	print("Reading (" + algo + ")...\n");
+	time_start = Tools.timeNow();
+
+	for (idx = 0; idx < MAX_READS; idx++) {
+		ridx = Math.floor( Math.random() * MAX_KEYS );
+		keyBuf = Buffer.from('' + ridx);
+		if (!hash.get(keyBuf)) die("Failed to fetch key " + idx + ": " + ridx + "\n");
+	}
+
+	elapsed = Tools.timeNow() - time_start;
+	var readsSec = Math.floor( MAX_READS / elapsed );
+
+	var stats = hash.stats({ detailed: true });
+	results[algo] = {
+		writesSec: writesSec,
+		readsSec: readsSec,
+		stats: stats
+	};
+
+	hash.clear();
+} );
+
+print("\n");
+print( "Algorithm".padEnd(10) + "Writes/sec".padStart(14) + "Reads/sec".padStart(14) + "Indexes".padStart(12) + "Avg Chain".padStart(12) + "Max Chain".padStart(12) + "Max Depth".padStart(12) + "\n" );
+
+for (var algo in results) {
+	var result = results[algo];
+	var stats = result.stats;
+
+	print( algo.padEnd(10) +
+		Tools.commify(result.writesSec).padStart(14) +
+		Tools.commify(result.readsSec).padStart(14) +
+		Tools.commify(stats.numIndexes).padStart(12) +
+		stats.avgChainLength.toFixed(2).padStart(12) +
+		Tools.commify(stats.maxChainLength).padStart(12) +
+		Tools.commify(stats.maxDepth).padStart(12) + "\n"
+	);
+}
+
+print("\n");
@@ -0,0 +1,95 @@
+// Benchmark comparing value compression off, on, and on with a shared dictionary
+// Values are JSON user records of about 200 to 700 bytes, which share most of their field names and text
+// Usage: node test-bench3.js --keys 1000000 --reads 1000000
+
+var MegaHash = require('.');
+var Tools = require('pixl-tools');
+var cli = require('pixl-cli');
+cli.global();
+
+var args = cli.args;
+
+const MAX_KEYS = parseInt( args.keys || 1000000 );
+const MAX_READS = parseInt( args.reads || 1000000 );
+const STATUSES = ['active', 'suspended', 'pending', 'deleted'];
+const BIO = 'Enjoys hiking, photography and long walks on the beach.  Software engineer by day, amateur astronomer by night. ';
+
+function makeRecord(idx) {
+	// build sample record for key index (same every run)
+	return {
+		id: idx,
+		username: 'user' + idx,
+		email: 'user' + idx + '@example.com',
+		created: 1570000000 + (idx * 37),
+		status: STATUSES[ idx % STATUSES.length ],
+		roles: (idx % 5) ? ['member'] : ['member', 'admin'],
+		prefs: { theme: (idx % 2) ? 'dark' : 'light', notifications: !!(idx % 3), language: 'en-US' },
+		bio: BIO.repeat( 1 + (idx % 5) )
+	};
+}
+
+// dictionary is just a few sample records, which is typical
+var dictionary = Buffer.from( [0, 1, 2, 3, 4].map( function(idx) { return JSON.stringify(makeRecord(idx + 1000000000)); } ).join('') );
+
+print("\nMax Keys: " + Tools.commify(MAX_KEYS) + "\n");
+print("Max Reads: " + Tools.commify(MAX_READS) + "\n");
+
+var configs = {
+	"none": {},
+	"compress": { compress: true },
+	"dictionary": { compress: true, dictionary: dictionary }
+};
+var results = {};
+
+for (var name in configs) {
+	var hash = new MegaHash( configs[name] );
+	var idx, ridx, time_start, elapsed;
+
+	print("\nWriting (" + name + ")...\n");
+	time_start = Tools.timeNow();
+
+	for (idx = 0; idx < MAX_KEYS; idx++) {
+		hash.set( 'key' + idx, makeRecord(idx) );
+	}
+
+	elapsed = Tools.timeNow() - time_start;
+	var writesSec = Math.floor( MAX_KEYS / elapsed );
+
+	print("Reading (" + name + ")...\n");
+	time_start = Tools.timeNow();
+
+	for (idx = 0; idx < MAX_READS; idx++) {
+		ridx = Math.floor( Math.random() * MAX_KEYS );
+		if (!hash.get('key' + ridx)) die("Failed to fetch key " + idx + ": " + ridx + "\n");
+	}
+
+	elapsed = Tools.timeNow() - time_start;
+	var readsSec = Math.floor( MAX_READS / elapsed );
+
+	results[name] = {
+		writesSec: writesSec,
+		readsSec: readsSec,
+		stats: hash.stats()
+	};
+
+	hash.clear();
+}
+
+print("\n");
+print( "Config".padEnd(12) + "Writes/sec".padStart(14) + "Reads/sec".padStart(14) + "Data Size".padStart(14) + "Total Size".padStart(14) + "Ratio".padStart(8) + "\n" );
+
+for (var name in results) {
+	var result = results[name];
+	var stats = result.stats;
+	var ratio = stats.rawSize ? (stats.compressedSize / stats.rawSize) : 1;
+
+	print( name.padEnd(12) +
+		Tools.commify(result.writesSec).padStart(14) +
+		Tools.commify(result.readsSec).padStart(14) +
+		Tools.getTextFromBytes(stats.dataSize).padStart(14) +
+		Tools.getTextFromBytes(stats.indexSize + stats.metaSize + stats.dataSize).padStart(14) +
+		ratio.toFixed(2).padStart(8) + "\n"
+	);
+}
+
+print("\n");
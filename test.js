@@ -182,6 +182,46 @@ module.exports = {
 			test.done();
 		},
 		
+		function testPackedObjects(test) {
+			// objects are stored packed, and must come back exactly as a JSON round trip would
+			var hash = new MegaHash();
+			var values = [
+				{ ints: [ 0, 1, -1, 127, 128, -33, 255, 65536, -70000, 5e9, -5e9, Math.pow(2, 53) - 1 ] },
+				{ floats: [ 0.1, -2.5, 1/3, 37.7749, 1e21, 5e-324, -0, NaN, Infinity ] },
+				{ strs: [ "", "x".repeat(40), "y".repeat(70000), "é€😀", "\ud800 lone", "\"quote\\\n\u0001" ] },
+				{ misc: [ null, true, false, undefined, function() {} ], skip: undefined, date: new Date(0) },
+				JSON.parse('{"__proto__": {"evil": 1}, "2": "two", "1": "one"}'),
+				[ [ [ { a: [ { b: {} } ] } ] ], [] ]
+			];
+			var deep = {};
+			for (var idx = 0, cur = deep; idx < 300; idx++) { cur.x = {}; cur = cur.x; }
+			values.push( deep );
+			
+			values.forEach( function(value, idx) {
+				hash.set( "obj" + idx, value );
+				test.ok( JSON.stringify(hash.get("obj" + idx)) === JSON.stringify(value), "Object " + idx + " is correct" );
+			} );
+			test.ok( hash.get("obj4").evil === undefined, "__proto__ key is not a prototype" );
+			
+			hash.set( "rec", { user: { name: "Joe", tags: [ "a", "b", { c: 3 } ] }, n: 5 } );
+			test.ok( hash.getField("rec", "user.name") === "Joe", "getField with dot path" );
+			test.ok( hash.getField("rec", [ "user", "tags", 2, "c" ]) === 3, "getField with array path" );
+			test.ok( hash.getField("rec", "user.tags").length === 3, "getField of array" );
+			test.ok( hash.getField("rec", "user.tags.length") === undefined, "getField only sees own fields" );
+			test.ok( hash.getField("rec", "user.nope") === undefined, "getField of missing field" );
+			test.ok( hash.getField("rec", []).n === 5, "getField with empty path" );
+			test.ok( hash.getField("nope", "a") === undefined, "getField of missing key" );
+			
+			hash.set( "str", "hello" );
+			test.ok( hash.getField("str", "length") === undefined, "getField of non-object" );
+			
+			// values stored as plain JSON are still readable
+			hash._set( "json", JSON.stringify({ a: [ 1, 2 ] }), 4 );
+			test.ok( hash.get("json").a[1] === 2, "JSON value is correct" );
+			test.ok( hash.getField("json", "a.1") === 2, "getField of JSON value" );
+			test.done();
+		},
+		
 		function testManyKeys(test) {
 			var hash = new MegaHash();
 			for (var idx = 0; idx < 1000; idx++) {
@@ -210,6 +250,156 @@ module.exports = {
 			test.done();
 		},
 		
+		function testReplaceInPlace(test) {
+			// same size values are overwritten in place, other sizes are reallocated
+			var hash = new MegaHash();
+			var buf = Buffer.alloc(8);
+			
+			for (var idx = 0; idx < 1000; idx++) {
+				buf.writeUInt32BE(idx, 4);
+				hash.set("counter", buf);
+				hash.set("key" + idx, "value" + idx);
+			}
+			
+			var value = hash.get("counter");
+			test.ok( Buffer.isBuffer(value) && (value.length === 8), "Counter is 8 byte buffer" );
+			test.ok( value.readUInt32BE(4) === 999, "Counter value is correct: " + value.readUInt32BE(4) );
+			
+			// shrink and grow
+			hash.set("counter", "a");
+			test.ok( hash.get("counter") === "a", "Shrunk value is correct" );
+			hash.set("counter", "abcdefghijklmnopqrstuvwxyz");
+			test.ok( hash.get("counter") === "abcdefghijklmnopqrstuvwxyz", "Grown value is correct" );
+			hash.set("counter", "abcdefghijklmnopqrstuvwxyZ");
+			test.ok( hash.get("counter") === "abcdefghijklmnopqrstuvwxyZ", "Replaced value is correct" );
+			
+			// make sure neighbors were not clobbered
+			for (var idx = 0; idx < 1000; idx++) {
+				test.ok( hash.get("key" + idx) === "value" + idx, "Neighbor value is correct: " + idx );
+			}
+			
+			var stats = hash.stats();
+			test.ok( stats.numKeys === 1001, "1001 keys in stats" );
+			test.ok( stats.dataSize === 7 + 26 + 5890 + 7890, "Data size is correct: " + stats.dataSize );
+			test.done();
+		},
+		
+		function testLengthEncoding(test) {
+			// lengths are stored as varints, so values crossing 128 and 16K bytes change the bucket layout
+			var hash = new MegaHash();
+			hash.set( "num", 1.5 );
+			test.ok( hash.stats().metaSize === 19, "Small pair has 19 bytes of overhead: " + hash.stats().metaSize );
+			
+			var sizes = [ 0, 1, 127, 128, 129, 16383, 16384, 70000, 127, 0, 16384, 128 ];
+			var longKey = "k".repeat(200);
+			sizes.forEach( function(size) {
+				var buf = Buffer.alloc(size, size % 251);
+				hash.set( "grow", buf );
+				hash.set( longKey, buf );
+				test.ok( hash.get("grow").equals(buf), "Value is correct at length " + size );
+				test.ok( hash.get(longKey).equals(buf), "Value under long key is correct at length " + size );
+			} );
+			
+			test.ok( hash.get("num") === 1.5, "Neighbor value is correct" );
+			hash.remove( "num" );
+			hash.remove( "grow" );
+			hash.remove( longKey );
+			var stats = hash.stats();
+			test.ok( !stats.numKeys && !stats.metaSize && !stats.dataSize, "Sizes back to zero" );
+			test.done();
+		},
+		
+		function testIntMap(test) {
+			// integer key table, with values converted natively
+			var map = new MegaHash.IntMap();
+			test.ok( map.set(1, 1.5) == 1, "Unique key returns 1 on set" );
+			test.ok( map.set(1, 2.5) == 2, "Replaced key returns 2 on set" );
+			map.set( 2, "hello" );
+			map.set( 3, { foo: "bar" } );
+			map.set( 4, Buffer.from("raw") );
+			map.set( 5, null );
+			map.set( 6, false );
+			map.set( 7, -12345678901234n );
+			map.set( 18446744073709551615n, "max" );
+			
+			test.ok( map.get(1) === 2.5, "Number value is correct" );
+			test.ok( map.get(2n) === "hello", "String value is correct (BigInt key)" );
+			test.ok( map.get(3).foo === "bar", "Object value is correct" );
+			test.ok( map.get(4).toString() === "raw", "Buffer value is correct" );
+			test.ok( map.get(5) === null, "Null value is correct" );
+			test.ok( map.get(6) === false, "Boolean value is correct" );
+			test.ok( map.get(7) === -12345678901234n, "BigInt value is correct" );
+			test.ok( map.get(18446744073709551615n) === "max", "Largest key is correct" );
+			test.ok( map.get(8) === undefined, "Missing key is undefined" );
+			test.ok( map.has(7) && !map.has(8), "has is correct" );
+			
+			var bad = [ -1, 1.5, "1", NaN, 2 ** 53, -1n, 2n ** 64n ];
+			bad.forEach( function(key) {
+				var threw = false;
+				try { map.get(key); } catch (err) { threw = true; }
+				test.ok( threw, "Bad key throws: " + String(key) );
+			} );
+			
+			var keys = Array.from( map.keys() );
+			test.ok( keys.length === 8, "Correct number of keys iterated" );
+			test.ok( keys.indexOf(18446744073709551615n) > -1, "Large key iterated as BigInt" );
+			test.ok( keys.indexOf(7) > -1, "Small key iterated as Number" );
+			test.ok( Array.from(map).length === 8, "Correct number of entries iterated" );
+			
+			// enough keys for several resizes, with removes mixed in
+			for (var idx = 0; idx < 100000; idx++) map.set( idx * 3 + 100, idx );
+			for (var idx = 0; idx < 100000; idx += 2) map.remove( idx * 3 + 100 );
+			var good = true;
+			for (var idx = 0; idx < 100000; idx++) {
+				if (map.get(idx * 3 + 100) !== ((idx % 2) ? idx : undefined)) good = false;
+			}
+			test.ok( good, "All values correct after resizes and removes" );
+			test.ok( map.length() === 50008, "Correct number of keys: " + map.length() );
+			
+			// removing keys while iterating is safe
+			var count = 0;
+			for (var [key, value] of map.entries(100)) {
+				if ((typeof(key) == "number") && (key >= 100)) map.delete( key );
+				count++;
+			}
+			test.ok( count === 50008, "All entries visited while removing: " + count );
+			test.ok( map.length() === 8, "Keys removed during iteration" );
+			
+			map.clear();
+			var stats = map.stats();
+			test.ok( !stats.numKeys && !stats.dataSize, "Stats are zero after clear" );
+			test.ok( map.get(1) === undefined, "Key gone after clear" );
+			test.done();
+		},
+		
+		function testStringArgs(test) {
+			// strings are UTF-8 encoded natively (on the stack if short), so try lengths around the scratch size
+			var hash = new MegaHash();
+			var good = true;
+			
+			for (var len = 240; len < 260; len++) {
+				[ "a", "\u00e9", "\u20ac", "\ud83d\ude00" ].forEach( function(ch) {
+					var str = "x".repeat(len) + ch;
+					hash.set( str, str + "!" );
+					if (hash.get(str) !== str + "!") good = false;
+					if (hash.get(Buffer.from(str)) !== str + "!") good = false;
+				} );
+			}
+			test.ok( good, "Keys and values around scratch size are correct" );
+			
+			var big = "\u20ac".repeat(20000);
+			hash.set( big.substring(0, 10000), big );
+			test.ok( hash.get(big.substring(0, 10000)) === big, "Long key and value are correct" );
+			
+			hash.set( "\ud800", "lone" );
+			test.ok( hash.get(Buffer.from("\ud800")) === "lone", "Lone surrogate encoded same as Buffer.from" );
+			
+			hash.set( 12345, "num" );
+			test.ok( hash.get("12345") === "num", "Number key is same as string key" );
+			test.ok( hash.has("12345") && hash.remove(12345) && !hash.has(12345), "has and remove with string keys" );
+			test.done();
+		},
+		
 		function testSetReturnValue(test) {
 			// make sure set() returns the expected return values
 			var hash = new MegaHash();
@@ -501,7 +691,759 @@ module.exports = {
 			test.ok( hash.get(key1) === "value1_REPLACED", "Key '" + key1 + "' does not equal expected value.");
 			test.ok( hash.get(key2) === "value2", "Key '" + key2 + "' does not equal expected value.");
 			test.done();
-		}
+		},
+		
+		function testWyHash(test) {
+			// use 64-bit wyhash digest with 16 index levels
+			var hash = new MegaHash({ hash: "wyhash" });
+			for (var idx = 0; idx < 10000; idx++) {
+				hash.set( "key" + idx, "value here " + idx );
+			}
+			for (var idx = 0; idx < 10000; idx++) {
+				var value = hash.get("key" + idx);
+				if (value !== "value here " + idx) {
+					test.ok( false, "Key " + idx + " does not match spec with wyhash: " + value );
+				}
+			}
+			for (var idx = 0; idx < 10000; idx += 2) {
+				hash.remove( "key" + idx );
+			}
+			
+			var key = hash.nextKey();
+			var count = 0;
+			while (key) {
+				test.ok( key.match(/^key\d*[13579]$/), "Key is odd: " + key );
+				count++;
+				key = hash.nextKey(key);
+			}
+			
+			test.ok( count == 5000, "Iterated exactly 5000 times: " + count );
+			test.ok( hash.stats().numIndexes > 1, "More indexes in stats" );
+			test.done();
+		},
+		
+		function testBadHashType(test) {
+			test.expect(1);
+			try {
+				var hash = new MegaHash({ hash: "md5" });
+			}
+			catch (err) {
+				test.ok( !!err, "Expected error with unknown hash algorithm" );
+			}
+			test.done();
+		},
+		
+		function testDetailedStats(test) {
+			var hash = new MegaHash();
+			for (var idx = 0; idx < 10000; idx++) {
+				hash.set( "key" + idx, "value here " + idx );
+			}
+			
+			var stats = hash.stats({ detailed: true });
+			test.ok( stats.numKeys === 10000, "10000 keys in stats" );
+			test.ok( stats.numChains > 0, "Chains in detailed stats: " + stats.numChains );
+			test.ok( stats.maxChainLength > 0, "Max chain length in detailed stats: " + stats.maxChainLength );
+			test.ok( stats.avgChainLength > 0, "Avg chain length in detailed stats: " + stats.avgChainLength );
+			test.ok( stats.maxDepth > 1, "Max depth in detailed stats: " + stats.maxDepth );
+			test.ok( !("numChains" in hash.stats()), "Basic stats do not scan" );
+			
+			var total = stats.chainLengths.reduce( function(a, b) { return a + b; }, 0 );
+			test.ok( total === stats.numChains, "Chain length histogram adds up to chains: " + total );
+			total = stats.keyDepths.reduce( function(a, b) { return a + b; }, 0 );
+			test.ok( total === 10000, "Key depth histogram adds up to keys: " + total );
+			test.ok( stats.keyDepths.length === stats.maxDepth + 1, "Deepest key is under deepest index" );
+			test.ok( stats.numReindexes > 0, "Reindexes counted: " + stats.numReindexes );
+			test.ok( stats.reindexedKeys > stats.numReindexes, "Reindexed keys counted: " + stats.reindexedKeys );
+			test.ok( !("hits" in stats), "No hot path counters unless instrumented" );
+			test.done();
+		},
+		
+		function testInstrument(test) {
+			// hot path counters and sampled latency
+			var hash = new MegaHash({ instrument: true });
+			for (var idx = 0; idx < 1000; idx++) {
+				hash.set( "key" + idx, "value here " + idx );
+			}
+			for (var idx = 0; idx < 2000; idx++) {
+				hash.get( "key" + idx );
+			}
+			for (var idx = 0; idx < 500; idx++) {
+				hash.delete( "key" + idx );
+			}
+			
+			var stats = hash.stats({ detailed: true });
+			test.ok( stats.hits === 1000, "1000 hits: " + stats.hits );
+			test.ok( stats.misses === 1000, "1000 misses: " + stats.misses );
+			test.ok( stats.avgLevels >= 1, "Avg levels: " + stats.avgLevels );
+			test.ok( stats.avgProbes > 0, "Avg probes: " + stats.avgProbes );
+			
+			var total = stats.probeLengths.reduce( function(a, b) { return a + b; }, 0 );
+			test.ok( total === 2000, "Probe length histogram adds up to lookups: " + total );
+			
+			// one in 64 operations is timed, counting all kinds
+			test.ok( Math.floor(2000 / 64) <= stats.latency.get.samples && stats.latency.get.samples <= Math.ceil(2000 / 64), "Sampled get latency: " + stats.latency.get.samples );
+			test.ok( stats.latency.set.samples > 0, "Sampled set latency: " + stats.latency.set.samples );
+			test.ok( stats.latency.delete.samples > 0, "Sampled delete latency: " + stats.latency.delete.samples );
+			
+			var get = stats.latency.get;
+			test.ok( get.p50 > 0 && get.p50 <= get.p90 && get.p90 <= get.p99 && get.p99 <= get.p999 && get.p999 <= get.max, "Percentiles in order" );
+			total = get.histogram.reduce( function(a, pair) { return a + pair[1]; }, 0 );
+			test.ok( total === get.samples, "Latency histogram adds up to samples" );
+			test.done();
+		},
+		
+		function testGetInto(test) {
+			// copy raw value bytes into caller's buffer
+			var hash = new MegaHash();
+			hash.set("hello", "there");
+			
+			var buf = Buffer.alloc(16);
+			var len = hash.getInto("hello", buf, 4);
+			test.ok( len === 5, "getInto returns value length: " + len );
+			test.ok( buf.toString('utf8', 4, 4 + len) === "there", "Value was copied at offset" );
+			
+			test.ok( hash.getInto("nope", buf) === -1, "Missing key returns -1" );
+			
+			var small = Buffer.alloc(2);
+			test.ok( hash.getInto("hello", small) === 5, "Full length returned if value does not fit" );
+			test.ok( small[0] === 0, "Nothing copied if value does not fit" );
+			test.done();
+		},
+		
+		function testGetView(test) {
+			// fetch values without copying
+			var hash = new MegaHash();
+			hash.set("str", "there");
+			hash.set("num", 12345);
+			hash.set("buf", Buffer.from("raw bytes"));
+			
+			test.ok( hash.getView("str") === "there", "String view is correct" );
+			test.ok( hash.getView("num") === 12345, "Number view is correct" );
+			test.ok( hash.getView("buf").toString() === "raw bytes", "Buffer view is correct" );
+			test.ok( hash.getView("nope") === undefined, "Missing key is undefined" );
+			test.done();
+		},
+		
+		function testSharedWorkers(test) {
+			// share one hash with several worker threads, all writing in parallel
+			var Worker = require('worker_threads').Worker;
+			var hash = new MegaHash();
+			hash.set("main", "hello");
+			var handle = hash.share();
+			test.ok( typeof(handle) == 'number', "Share handle is a number" );
+			
+			var code = [
+				"const { workerData, parentPort } = require('worker_threads');",
+				"const MegaHash = require(workerData.path);",
+				"var hash = MegaHash.attach(workerData.handle);",
+				"for (var idx = 0; idx < 10000; idx++) hash.set('w' + workerData.id + '_' + idx, 'value ' + idx);",
+				"for (var idx = 0; idx < 10000; idx += 2) hash.remove('w' + workerData.id + '_' + idx);",
+				"parentPort.postMessage( hash.get('main') );"
+			].join("\n");
+			
+			var numWorkers = 4;
+			var numDone = 0;
+			
+			for (var idx = 0; idx < numWorkers; idx++) {
+				var worker = new Worker( code, { eval: true, workerData: { path: __dirname, handle: handle, id: idx } } );
+				worker.on('message', function(msg) {
+					test.ok( msg === "hello", "Worker can read main thread keys" );
+				});
+				worker.on('error', function(err) {
+					test.ok( false, "Worker error: " + err );
+				});
+				worker.on('exit', function() {
+					if (++numDone < numWorkers) return;
+					
+					test.ok( hash.length() === 1 + (numWorkers * 5000), "All worker keys in hash: " + hash.length() );
+					test.ok( hash.get("w3_9999") === "value 9999", "Worker key is readable from main thread" );
+					test.ok( !hash.has("w3_9998"), "Worker removal is visible to main thread" );
+					test.done();
+				});
+			}
+		},
+		
+		function testAttachBad(test) {
+			test.expect(1);
+			try {
+				var hash = MegaHash.attach(999999);
+			}
+			catch (err) {
+				test.ok( !!err, "Expected error attaching to unknown handle" );
+			}
+			test.done();
+		},
+		
+		function testTTL(test) {
+			// keys with a ttl become misses once expired, and are reclaimed lazily or by sweep()
+			var hash = new MegaHash();
+			for (var idx = 0; idx < 1000; idx++) {
+				hash.set( "temp" + idx, "value here " + idx, { ttl: 50 } );
+			}
+			hash.set( "perm", "forever" );
+			hash.set( "renewed", "first", { ttl: 50 } );
+			hash.set( "renewed", "second" );
+			hash.set( "obj", { foo: "bar" }, { ttl: 60000 } );
+			
+			test.ok( hash.get("temp0") === "value here 0", "Key is there before expiry" );
+			test.ok( hash.get("obj").foo === "bar", "Value type survives ttl" );
+			test.ok( hash.length() === 1003, "All keys counted" );
+			
+			setTimeout( function() {
+				test.ok( hash.get("temp0") === undefined, "Expired key is a miss" );
+				test.ok( !hash.has("temp1"), "has() is false for expired key" );
+				test.ok( hash.length() === 1001, "Expired keys reclaimed on access: " + hash.length() );
+				test.ok( hash.get("perm") === "forever", "Key without ttl is still there" );
+				test.ok( hash.get("renewed") === "second", "Replacing a key drops its ttl" );
+				test.ok( hash.get("obj").foo === "bar", "Key with long ttl is still there" );
+				test.ok( Array.from( hash.keys() ).length === 3, "Iteration skips expired keys" );
+				test.ok( hash.set("temp2", "back") === 1, "Setting an expired key counts as an add" );
+				
+				var total = 0;
+				var reclaimed;
+				for (var pass = 0; pass < 1000; pass++) {
+					reclaimed = hash.sweep(100);
+					test.ok( reclaimed <= 110, "Sweep stays near its work limit: " + reclaimed );
+					total += reclaimed;
+					if (hash.length() == 4) break;
+				}
+				test.ok( total === 997, "Sweep reclaimed the rest: " + total );
+				test.ok( hash.sweep() === 0, "Nothing left to sweep" );
+				
+				// in concurrent mode, reads never reclaim, so sweep does it all
+				var shared = new MegaHash({ concurrent: true });
+				shared.set( "temp", "value", { ttl: 1 } );
+				setTimeout( function() {
+					test.ok( shared.get("temp") === undefined, "Expired key is a miss in concurrent mode" );
+					test.ok( shared.length() === 1, "Not reclaimed by reads in concurrent mode" );
+					test.ok( shared.sweep() === 1 && shared.length() === 0, "Reclaimed by sweep in concurrent mode" );
+					test.done();
+				}, 10 );
+			}, 100 );
+		},
+		
+		function testMaxBytes(test) {
+			// memory-bounded mode evicts keys on set, giving recently read keys a second chance
+			var hash = new MegaHash({ maxBytes: 200000 });
+			hash.set( "hot", "keep me" );
+			for (var idx = 0; idx < 20000; idx++) {
+				hash.set( "key" + idx, "value here " + idx );
+				if (idx % 10 == 0) test.ok( hash.get("hot") === "keep me", "Hot key survives eviction: " + idx );
+			}
+			
+			var stats = hash.stats();
+			test.ok( stats.indexSize + stats.metaSize + stats.dataSize <= 200000, "Memory stays under limit" );
+			test.ok( stats.numKeys < 20000, "Some keys were evicted: " + stats.numKeys );
+			test.ok( stats.numEvictions + stats.numKeys === 20001, "Every key is either there or evicted: " + stats.numEvictions );
+			test.ok( stats.evictedBytes > 0, "Evicted bytes counted" );
+			test.ok( hash.get("key19999") === "value here 19999", "Newest key is there" );
+			test.ok( hash.set("huge", Buffer.alloc(300000)) === 0, "Value larger than limit is refused" );
+			
+			hash.clear();
+			test.ok( hash.stats().numEvictions === stats.numEvictions, "Eviction stats survive clear" );
+			
+			var unbounded = new MegaHash();
+			for (var idx = 0; idx < 20000; idx++) unbounded.set( "key" + idx, "value here " + idx );
+			test.ok( unbounded.length() === 20000 && !unbounded.stats().numEvictions, "No eviction without maxBytes" );
+			
+			var shared = new MegaHash({ maxBytes: 200000, concurrent: true });
+			for (var idx = 0; idx < 20000; idx++) shared.set( "key" + idx, "value here " + idx );
+			stats = shared.stats();
+			test.ok( stats.indexSize + stats.metaSize + stats.dataSize <= 200000, "Memory stays under limit in concurrent mode" );
+			test.ok( stats.numEvictions + stats.numKeys === 20000, "Evictions counted in concurrent mode" );
+			test.done();
+		},
+		
+		function testCollapse(test) {
+			// removing keys frees and merges index levels, and compact() tidies up the rest
+			var hash = new MegaHash();
+			for (var idx = 0; idx < 100000; idx++) {
+				hash.set( "key" + idx, "value here " + idx );
+			}
+			var full = hash.stats();
+			test.ok( full.numIndexes > 1000, "Many index levels when full: " + full.numIndexes );
+			
+			for (var idx = 0; idx < 100000; idx++) {
+				if (idx % 100) hash.remove( "key" + idx );
+			}
+			var sparse = hash.stats();
+			test.ok( sparse.numKeys === 1000, "1000 keys left" );
+			test.ok( sparse.indexSize < full.indexSize / 2, "Index memory was reclaimed: " + sparse.indexSize );
+			
+			var freed = hash.compact();
+			test.ok( typeof(freed) == 'number' && freed >= 0, "compact() returns bytes freed: " + freed );
+			test.ok( hash.get("key500") === "value here 500", "Remaining keys are intact" );
+			test.ok( hash.get("key501") === undefined, "Removed keys are gone" );
+			
+			for (var idx = 0; idx < 100000; idx += 100) hash.remove( "key" + idx );
+			test.ok( hash.stats().numIndexes === 1, "Only main index left when empty" );
+			test.done();
+		},
+		
+		function testIterators(test) {
+			// keys(), values(), entries() and for..of, fetched in batches through a native cursor
+			var hash = new MegaHash();
+			for (var idx = 0; idx < 1000; idx++) {
+				hash.set( "key" + idx, "value here " + idx );
+			}
+			hash.set( "num", 42 );
+			hash.set( Buffer.from("buf"), Buffer.from("raw") );
+			
+			var keys = Array.from( hash.keys(7) );
+			test.ok( keys.length === 1002, "keys() visits every key: " + keys.length );
+			test.ok( (new Set(keys)).size === 1002, "keys() visits each key once" );
+			
+			var values = Array.from( hash.values() );
+			test.ok( values.length === 1002, "values() visits every value" );
+			test.ok( values.indexOf(42) > -1, "values() decodes numbers" );
+			
+			var count = 0;
+			for (var [key, value] of hash) {
+				if ((key == "buf") && (value.toString() !== "raw")) test.ok( false, "Bad buffer entry" );
+				else if ((key.indexOf("key") == 0) && (value !== "value here " + key.substring(3))) test.ok( false, "Bad entry: " + key );
+				count++;
+			}
+			test.ok( count === 1002, "for..of visits every entry" );
+			test.ok( Array.from( hash.entries(1) ).length === 1002, "entries() with batch size 1" );
+			
+			// keys present for the whole iteration are visited exactly once, even while the hash changes
+			var seen = {};
+			var added = 0;
+			for (var key of hash.keys(10)) {
+				if (seen[key]) test.ok( false, "Key visited twice: " + key );
+				seen[key] = 1;
+				hash.set( "new" + (added++), "added during iteration" );
+				if (key.indexOf("key") == 0) hash.remove( key );
+			}
+			for (var idx = 0; idx < 1000; idx++) {
+				if (!seen["key" + idx]) test.ok( false, "Key missed during iteration: key" + idx );
+			}
+			test.ok( !hash.has("key0") && hash.has("new0"), "Hash was modified during iteration" );
+			
+			test.ok( Array.from( (new MegaHash()).keys() ).length === 0, "Empty hash has no keys" );
+			test.done();
+		},
+		
+		function testEngines(test) {
+			// swiss groups hold the same keys as bucket lists, and either can load the other's snapshots
+			var fs = require('fs');
+			var file = require('os').tmpdir() + '/megahash-test-engine-' + process.pid + '.snap';
+			var chain = new MegaHash({ engine: "chain" });
+			var swiss = new MegaHash({ engine: "swiss" });
+			
+			for (var idx = 0; idx < 20000; idx++) {
+				chain.set( "key" + idx, "value here " + idx );
+				swiss.set( "key" + idx, "value here " + idx );
+			}
+			for (var idx = 0; idx < 20000; idx += 2) {
+				test.ok( swiss.remove("key" + idx) === true, "Removed key " + idx );
+				chain.remove( "key" + idx );
+			}
+			for (var idx = 0; idx < 20000; idx++) {
+				var expected = (idx % 2) ? ("value here " + idx) : undefined;
+				if (swiss.get("key" + idx) !== expected) test.ok( false, "Key " + idx + " does not match in swiss engine" );
+			}
+			
+			var stats = swiss.stats({ detailed: true });
+			test.ok( stats.numKeys === 10000, "10000 keys in swiss stats" );
+			test.ok( stats.maxChainLength <= 16, "Groups never hold more than 16 keys: " + stats.maxChainLength );
+			test.ok( stats.metaSize === chain.stats().metaSize, "Same bucket overhead in both engines" );
+			
+			var count = 0;
+			for (var key of swiss.keys()) count++;
+			test.ok( count === 10000, "Iterated swiss keys: " + count );
+			
+			test.ok( swiss.save(file) === true, "Swiss snapshot saved" );
+			var copy = MegaHash.load( file, { engine: "chain" } );
+			test.ok( copy.stats().numKeys === 10000 && copy.get("key9999") === "value here 9999", "Swiss snapshot loads into chain engine" );
+			chain.save( file );
+			copy = MegaHash.load( file, { engine: "swiss" } );
+			test.ok( copy.stats().numKeys === 10000 && copy.get("key1") === "value here 1", "Chain snapshot loads into swiss engine" );
+			fs.unlinkSync( file );
+			
+			try { new MegaHash({ engine: "cuckoo" }); test.ok( false, "Unknown engine should throw" ); }
+			catch (err) { test.ok( !!err, "Expected error with unknown engine" ); }
+			test.done();
+		},
 		
+		function testSnapshot(test) {
+			// save to binary snapshot, then load back with multiple threads
+			var fs = require('fs');
+			var file = require('os').tmpdir() + '/megahash-test-' + process.pid + '.snap';
+			var hash = new MegaHash({ hash: "wyhash" });
+			for (var idx = 0; idx < 10000; idx++) {
+				hash.set( "key" + idx, "value here " + idx );
+			}
+			hash.set( "num", 42 );
+			hash.set( "obj", { foo: "bar" } );
+			hash.set( Buffer.from("buf"), Buffer.from("raw") );
+			hash.set( "empty", "" );
+			
+			test.ok( hash.save(file) === true, "Snapshot saved" );
+			
+			var copy = MegaHash.load( file, { threads: 4 } );
+			test.ok( copy.length() === hash.length(), "Loaded key count matches: " + copy.length() );
+			
+			// hash algorithm comes from the snapshot, so keys are still found without passing it in
+			test.ok( copy.get("key9999") === "value here 9999", "String value is correct" );
+			test.ok( copy.get("num") === 42, "Number value is correct" );
+			test.ok( copy.get("obj").foo === "bar", "Object value is correct" );
+			test.ok( copy.get("buf").toString() === "raw", "Buffer value is correct" );
+			test.ok( copy.get("empty") === "", "Empty value is correct" );
+			
+			var single = MegaHash.load( file, { threads: 1 } );
+			test.ok( single.length() === hash.length(), "Single thread load key count matches" );
+			
+			// memory limit and compression options apply to the loaded keys too
+			var big = new MegaHash();
+			var text = "Lorem ipsum dolor sit amet, consectetur adipiscing elit. ".repeat(4);
+			for (var idx = 0; idx < 5000; idx++) {
+				big.set( "key" + idx, text + idx );
+			}
+			test.ok( big.save(file) === true, "Big snapshot saved" );
+			
+			var packed = MegaHash.load( file, { compress: true, maxBytes: 4 * 1024 * 1024 } );
+			var stats = packed.stats();
+			test.ok( packed.length() === 5000, "Loaded all keys with limit and compression" );
+			test.ok( stats.compressedSize > 0 && stats.compressedSize < stats.rawSize, "Values compressed on load: " + stats.compressedSize );
+			test.ok( stats.indexSize + stats.metaSize + stats.dataSize <= 4 * 1024 * 1024, "Loaded hash fits in maxBytes" );
+			test.ok( packed.get("key4999") === text + "4999", "Compressed value is correct" );
+			
+			try { MegaHash.load( file, { maxBytes: 256 * 1024, threads: 4 } ); test.ok( false, "Oversized snapshot should throw" ); }
+			catch (err) { test.ok( /maxBytes/.test(err.message), "Oversized snapshot throws: " + err.message ); }
+			test.ok( hash.save(file) === true, "Snapshot saved again" );
+			
+			// flip one byte in the middle of a record, which must fail the group checksum
+			var data = fs.readFileSync( file );
+			data[ Math.floor(data.length / 2) ] ^= 0x55;
+			fs.writeFileSync( file, data );
+			try { MegaHash.load( file ); test.ok( false, "Corrupt snapshot should throw" ); }
+			catch (err) { test.ok( !!err, "Corrupt snapshot throws: " + err.message ); }
+			
+			fs.writeFileSync( file, data.subarray(0, data.length - 10) );
+			try { MegaHash.load( file ); test.ok( false, "Truncated snapshot should throw" ); }
+			catch (err) { test.ok( !!err, "Truncated snapshot throws: " + err.message ); }
+			
+			hash.saveAsync( file ).then( function() {
+				return MegaHash.loadAsync( file );
+			} ).then( function(copy) {
+				test.ok( copy.length() === hash.length(), "Async loaded key count matches" );
+				test.ok( copy.get("key0") === "value here 0", "Async loaded value is correct" );
+				fs.unlinkSync( file );
+				test.done();
+			} ).catch( function(err) {
+				test.ok( false, "Async snapshot error: " + err );
+				test.done();
+			} );
+		},
+		
+		function testCompression(test) {
+			// values over the threshold are stored compressed, and every read path expands them
+			var fs = require('fs');
+			var file = require('os').tmpdir() + '/megahash-test-comp-' + process.pid + '.snap';
+			var text = "Lorem ipsum dolor sit amet, consectetur adipiscing elit. ".repeat(20);
+			var hash = new MegaHash({ compress: true });
+			for (var idx = 0; idx < 1000; idx++) {
+				hash.set( "key" + idx, text + idx );
+			}
+			hash.set( "short", "too short to compress" );
+			hash.set( "obj", { text: text, list: [1, 2, 3] } );
+			hash.set( "buf", Buffer.from(text) );
+			
+			var stats = hash.stats();
+			test.ok( stats.compressedSize > 0 && stats.compressedSize < stats.rawSize / 4, "Values are compressed: " + stats.compressedSize + " / " + stats.rawSize );
+			test.ok( stats.dataSize < stats.rawSize, "Data size counts compressed bytes" );
+			
+			test.ok( hash.get("key999") === text + "999", "String value is correct" );
+			test.ok( hash.get("short") === "too short to compress", "Short value is correct" );
+			test.ok( hash.get("obj").text === text, "Object value is correct" );
+			test.ok( hash.getField("obj", "list.2") === 3, "getField works on compressed object" );
+			test.ok( hash.get("buf").toString() === text, "Buffer value is correct" );
+			test.ok( hash.getView("buf").toString() === text, "getView returns expanded copy" );
+			
+			var target = Buffer.alloc( text.length + 10 );
+			test.ok( hash.getInto("key5", target) === text.length + 1, "getInto returns original length" );
+			test.ok( target.toString("utf8", 0, text.length + 1) === text + "5", "getInto decompresses into target" );
+			test.ok( hash.getInto("key55", Buffer.alloc(10)) === text.length + 2, "getInto reports length when too small" );
+			
+			var values = hash.getMany([ "key1", "short", "obj", "nope" ]);
+			test.ok( values[0] === text + "1" && values[1] === "too short to compress" && values[2].text === text && values[3] === undefined, "getMany expands values" );
+			
+			var count = 0;
+			for (var entry of hash) {
+				if (entry[0] === "key7") test.ok( entry[1] === text + "7", "Iterated value is correct" );
+				count++;
+			}
+			test.ok( count === 1003, "Iterated all entries: " + count );
+			
+			// replacing and removing keeps the compressed totals in step
+			hash.set( "key0", "now short" );
+			hash.remove( "key1" );
+			test.ok( hash.get("key0") === "now short", "Replaced value is correct" );
+			for (var idx = 0; idx < 1000; idx++) hash.remove( "key" + idx );
+			hash.remove( "obj" );
+			hash.remove( "buf" );
+			stats = hash.stats();
+			test.ok( stats.compressedSize === 0 && stats.rawSize === 0, "Compressed totals return to zero" );
+			
+			var threshold = new MegaHash({ compress: 100000 });
+			threshold.set( "key", text );
+			test.ok( threshold.stats().compressedSize === 0, "Values under threshold are not compressed" );
+			
+			// shared dictionary, which must match when loading a snapshot
+			var dictionary = Buffer.from( text );
+			var dhash = new MegaHash({ compress: 64, dictionary: dictionary });
+			for (var idx = 0; idx < 100; idx++) {
+				dhash.set( "key" + idx, "Item " + idx + ": " + text.substring(0, 100 + idx) );
+			}
+			test.ok( dhash.stats().compressedSize < dhash.stats().rawSize / 4, "Dictionary compresses short values" );
+			test.ok( dhash.get("key42") === "Item 42: " + text.substring(0, 142), "Dictionary value is correct" );
+			
+			test.ok( dhash.save(file) === true, "Snapshot saved" );
+			var copy = MegaHash.load( file, { compress: 64, dictionary: dictionary } );
+			test.ok( copy.get("key99") === "Item 99: " + text.substring(0, 199), "Loaded value is correct" );
+			test.ok( copy.stats().compressedSize === dhash.stats().compressedSize, "Loaded values stay compressed" );
+			
+			try { MegaHash.load( file, { compress: 64, dictionary: Buffer.from("some other dictionary") } ); test.ok( false, "Wrong dictionary should throw" ); }
+			catch (err) { test.ok( !!err, "Wrong dictionary throws: " + err.message ); }
+			try { MegaHash.load( file ); test.ok( false, "Missing dictionary should throw" ); }
+			catch (err) { test.ok( !!err, "Missing dictionary throws: " + err.message ); }
+			
+			// snapshots without a dictionary load anywhere, as is
+			hash.set( "big", text );
+			hash.save( file );
+			test.ok( MegaHash.load(file).get("big") === text, "Compressed snapshot loads without compression" );
+			
+			fs.unlinkSync( file );
+			test.done();
+		},
+		
+		function testAsync(test) {
+			// setManyAsync, forEachBatchAsync and clearAsync run on the threadpool
+			var hash = new MegaHash();
+			var pairs = [];
+			for (var idx = 0; idx < 10000; idx++) {
+				pairs.push([ "key" + idx, "value here " + idx ]);
+			}
+			
+			var promise = hash.setManyAsync( pairs );
+			
+			try { hash.set("hello", "there"); test.ok( false, "Sync call should throw while busy" ); }
+			catch (err) { test.ok( !!err, "Sync call throws while busy" ); }
+			
+			hash.clearAsync().then( function() {
+				test.ok( false, "Second async call should reject while busy" );
+			}, function(err) {
+				test.ok( !!err, "Second async call rejects while busy" );
+			} );
+			
+			promise.then( function(results) {
+				test.ok( results.length === 10000, "One result per pair" );
+				test.ok( hash.length() === 10000, "10000 keys in hash" );
+				
+				var seen = {};
+				return hash.forEachBatchAsync( 1000, function(batch) {
+					test.ok( batch.length <= 1000, "Batch is not larger than requested" );
+					batch.forEach( function(pair) {
+						if (pair[1] !== "value here " + pair[0].substring(3)) test.ok( false, "Bad pair: " + pair );
+						seen[ pair[0] ] = 1;
+					} );
+				} ).then( function(total) {
+					test.ok( total === 10000, "Scanned all pairs: " + total );
+					test.ok( Object.keys(seen).length === 10000, "Saw every key once" );
+					return hash.forEachBatchAsync( 1000, function() { return false; } );
+				} );
+			} ).then( function(total) {
+				test.ok( total === 1000, "Scan stops early when callback returns false" );
+				return hash.clearAsync();
+			} ).then( function() {
+				test.ok( hash.length() === 0, "Hash is empty after clearAsync" );
+				hash.set("hello", "there");
+				test.ok( hash.get("hello") === "there", "Hash is usable after clearAsync" );
+				test.done();
+			} ).catch( function(err) {
+				test.ok( false, "Async error: " + err );
+				test.done();
+			} );
+		},
+		
+		function testBatch(test) {
+			// setMany / getMany / hasMany / removeMany in one native call each
+			var hash = new MegaHash();
+			var pairs = [];
+			for (var idx = 0; idx < 1000; idx++) {
+				pairs.push([ "key" + idx, "value here " + idx ]);
+			}
+			pairs.push([ "num", 42 ], [ "obj", { foo: "bar" } ], [ Buffer.from("buf"), Buffer.from("raw") ], [ "nil", null ], [ "key0", "replaced" ]);
+			
+			var results = hash.setMany( pairs );
+			test.ok( results.length === 1005, "One result per pair" );
+			test.ok( results[0] === 1 && results[1004] === 2, "Result codes match set(): " + results[0] + ", " + results[1004] );
+			test.ok( hash.length() === 1004, "1004 keys in hash" );
+			
+			var values = hash.getMany([ "key0", "key999", "num", "obj", "buf", "nil", "nope" ]);
+			test.ok( values[0] === "replaced", "Replaced value is correct" );
+			test.ok( values[1] === "value here 999", "String value is correct" );
+			test.ok( values[2] === 42, "Number value is correct" );
+			test.ok( values[3].foo === "bar", "Object value is correct" );
+			test.ok( Buffer.isBuffer(values[4]) && (values[4].toString() === "raw"), "Buffer value is correct" );
+			test.ok( values[5] === null, "Null value is correct" );
+			test.ok( values[6] === undefined, "Missing key is undefined" );
+			
+			test.ok( hash.hasMany([ "key1", "nope" ]).join(",") === "true,false", "hasMany is correct" );
+			test.ok( hash.removeMany([ "key1", "nope" ]).join(",") === "true,false", "removeMany is correct" );
+			test.ok( !hash.has("key1"), "Key was removed" );
+			
+			hash.setMany({ a: 1, b: 2 });
+			hash.setMany(new Map([ ["c", 3] ]));
+			test.ok( hash.getMany([ "a", "b", "c" ]).join(",") === "1,2,3", "Object and Map input" );
+			test.ok( hash.getMany([]).length === 0, "Empty batch" );
+			test.done();
+		},
+		
+		function testBatchLookup(test) {
+			// getMany and hasMany fetch keys in lock-step batches, which must match get() and has() key for key
+			var hash = new MegaHash();
+			var keys = [];
+			for (var idx = 0; idx < 5000; idx++) {
+				if (idx % 3) hash.set( "key" + idx, "value here " + idx, (idx % 7) ? {} : { ttl: 250 } );
+				keys.push( "key" + idx );
+			}
+			keys.push( "key1", "key1", "nope" );
+			
+			var values = hash.getMany( keys );
+			var found = hash.hasMany( keys );
+			var ok = (values.length === keys.length) && (found.length === keys.length);
+			for (var idx = 0; ok && (idx < keys.length); idx++) {
+				ok = (values[idx] === hash.get(keys[idx])) && (found[idx] === hash.has(keys[idx]));
+			}
+			test.ok( ok, "Batch results match single lookups" );
+			test.ok( values[1] === "value here 1" && values[3] === undefined && values[5001] === "value here 1", "Hits, misses and repeats" );
+			
+			setTimeout( function() {
+				var values = hash.getMany( keys );
+				test.ok( values[7] === undefined && values[8] === "value here 8", "Expired keys are misses" );
+				test.ok( hash.hasMany([ "key14", "key13" ]).join(",") === "false,true", "hasMany skips expired keys" );
+				test.ok( hash.length() === 5000 - 1667 - 476, "Expired keys reclaimed by getMany: " + hash.length() );
+				test.done();
+			}, 300 );
+		},
+		
+		function testIncr(test) {
+			// native read-modify-write on Number and BigInt values
+			var hash = new MegaHash();
+			test.ok( hash.incr("hits") === 1, "Missing key starts at 0" );
+			test.ok( hash.incr("hits", 41) === 42, "Incremented by delta" );
+			test.ok( hash.incr("hits", -0.5) === 41.5, "Fractional delta" );
+			test.ok( hash.get("hits") === 41.5, "Stored as a Number" );
+			
+			var size = hash.stats().dataSize;
+			for (var idx = 0; idx < 100; idx++) hash.incr("hits");
+			test.ok( hash.stats().dataSize === size, "Counter is updated in place" );
+			
+			test.ok( hash.incr("big", 5n) === 5n, "BigInt delta on missing key" );
+			test.ok( hash.incr("big", 2) === 7n, "Number delta on BigInt value" );
+			test.ok( hash.get("big") === 7n, "Stored as a BigInt" );
+			test.ok( hash.incr("big", 9223372036854775807n) === -9223372036854775802n, "BigInt wraps at 64 bits" );
+			
+			hash.set("str", "hello");
+			var err = null;
+			try { hash.incr("str"); } catch (e) { err = e; }
+			test.ok( !!err, "Cannot increment a string" );
+			test.ok( hash.get("str") === "hello", "String was left alone" );
+			
+			err = null;
+			try { hash.incr("big", 0.5); } catch (e) { err = e; }
+			test.ok( !!err, "Cannot add fractional delta to a BigInt" );
+			
+			hash.set("temp", 10, { ttl: 60000 });
+			hash.incr("temp");
+			test.ok( hash.get("temp") === 11, "Expiring counter incremented" );
+			test.done();
+		},
+		
+		function testAppend(test) {
+			// native append to string and Buffer values
+			var hash = new MegaHash({ compress: true });
+			test.ok( hash.append("log", "abc") === 3, "Missing key starts empty" );
+			test.ok( hash.append("log", Buffer.from("def")) === 6, "Appended Buffer to string" );
+			test.ok( hash.get("log") === "abcdef", "Value stays a string" );
+			
+			var chunk = "The quick brown fox jumps over the lazy dog. ".repeat(10);
+			for (var idx = 0; idx < 20; idx++) hash.append("log", chunk);
+			test.ok( hash.get("log") === "abcdef" + chunk.repeat(20), "Long value appended across compression" );
+			test.ok( hash.stats().compressedSize > 0, "Long value was compressed" );
+			
+			hash.append("buf", Buffer.from([1, 2]));
+			hash.append("buf", Buffer.from([3]));
+			test.ok( Buffer.compare(hash.get("buf"), Buffer.from([1, 2, 3])) === 0, "Appended to Buffer" );
+			
+			hash.set("num", 5);
+			var err = null;
+			try { hash.append("num", "x"); } catch (e) { err = e; }
+			test.ok( !!err, "Cannot append to a Number" );
+			test.done();
+		},
+		
+		function testCompareAndSet(test) {
+			// replace only if current value matches, and setIfAbsent / getOrSet
+			var hash = new MegaHash();
+			test.ok( hash.compareAndSet("k", undefined, "first") === true, "Stored when expected missing" );
+			test.ok( hash.compareAndSet("k", undefined, "second") === false, "Not stored when key exists" );
+			test.ok( hash.compareAndSet("k", "nope", "second") === false, "Not stored on mismatch" );
+			test.ok( hash.compareAndSet("k", "first", "second") === true, "Stored on match" );
+			test.ok( hash.get("k") === "second", "Value was swapped" );
+			test.ok( hash.compareAndSet("k", Buffer.from("second"), "third") === false, "Type must match too" );
+			
+			hash.set("obj", { a: 1, b: [1, 2] });
+			test.ok( hash.compareAndSet("obj", { a: 1, b: [1, 2] }, { a: 2 }) === true, "Objects compare by encoded form" );
+			test.ok( hash.get("obj").a === 2, "Object was swapped" );
+			test.ok( hash.compareAndSet("n", 1, 2) === false, "Missing key never matches a value" );
+			
+			test.ok( hash.setIfAbsent("once", 1) === true, "setIfAbsent stores missing key" );
+			test.ok( hash.setIfAbsent("once", 2) === false, "setIfAbsent leaves existing key" );
+			test.ok( hash.get("once") === 1, "Existing value kept" );
+			
+			test.ok( hash.getOrSet("cfg", { x: 1 }).x === 1, "getOrSet returns value it stored" );
+			test.ok( hash.getOrSet("cfg", { x: 2 }).x === 1, "getOrSet returns existing value" );
+			test.ok( hash.getOrSet("flag", false) === false, "getOrSet with boolean" );
+			test.ok( hash.getOrSet("flag", true) === false, "getOrSet returns existing boolean" );
+			test.ok( hash.length() === 5, "5 keys in hash" );
+			test.done();
+		},
+		
+		function testBulkThreads(test) {
+			// big batches are stored by several threads, each owning whole main index slots
+			var hash = new MegaHash();
+			var pairs = [];
+			for (var idx = 0; idx < 50000; idx++) {
+				pairs.push([ "key" + idx, "value here " + idx ]);
+			}
+			pairs.push([ "key0", "first" ], [ "key0", "second" ]);
+			
+			var results = hash.setMany( pairs, { threads: 4 } );
+			test.ok( results.length === 50002, "One result per pair" );
+			test.ok( results[0] === 1 && results[50000] === 2 && results[50001] === 2, "Result codes match set()" );
+			test.ok( hash.length() === 50000, "50000 keys in hash: " + hash.length() );
+			test.ok( hash.get("key0") === "second", "Same key is stored in order given" );
+			
+			var ok = true;
+			for (var idx = 1; idx < 50000; idx++) {
+				if (hash.get("key" + idx) !== "value here " + idx) { ok = false; break; }
+			}
+			test.ok( ok, "All values are correct" );
+			
+			// shared hash, where each slot's stripe is locked while it is stored
+			var shared = new MegaHash({ concurrent: true });
+			shared.setMany( pairs, { threads: 4 } );
+			test.ok( shared.length() === 50000, "50000 keys in concurrent hash" );
+			
+			shared.setManyAsync( pairs, { threads: 4 } ).then( function(results) {
+				test.ok( results[1] === 2, "Async bulk store replaces" );
+				test.ok( shared.get("key49999") === "value here 49999", "Async bulk store value is correct" );
+				test.done();
+			} );
+		}
+	
 	]
 };
@@ -0,0 +1,94 @@
+// wyhash - The FASTEST QUALITY hash function, random number generators (PRNG) and hash map.
+// Author: Wang Yi <godspeed_china@yeah.net>
+// This is free and unencumbered software released into the public domain (The Unlicense).
+// See http://unlicense.org/ and https://github.com/wangyi-fudan/wyhash
+// Vendored for MegaHash: trimmed down to the 64-bit hash function only.
+
+#ifndef WYHASH_H
+#define WYHASH_H
+
+#include <stdint.h>
+#include <string.h>
+
+#if defined(_MSC_VER) && defined(_M_X64)
+#include <intrin.h>
+#pragma intrinsic(_umul128)
+#endif
+
+#if defined(__GNUC__) || defined(__INTEL_COMPILER) || defined(__clang__)
+#define _wy_likely_(x) __builtin_expect(x, 1)
+#define _wy_unlikely_(x) __builtin_expect(x, 0)
+#else
+#define _wy_likely_(x) (x)
+#define _wy_unlikely_(x) (x)
+#endif
+
+/** Default secret parameters. */
+static const uint64_t _wyp[4] = { 0xa0761d6478bd642full, 0xe7037ed1a0b428dbull, 0x8ebc6af09c88c6e3ull, 0x589965cc75374cc3ull };
+
+/** 128-bit multiply, returning low 64 bits in A and high 64 bits in B. */
+static inline void _wymum(uint64_t *A, uint64_t *B) {
+#if defined(__SIZEOF_INT128__)
+	__uint128_t r = *A; r *= *B;
+	*A = (uint64_t)r; *B = (uint64_t)(r >> 64);
+#elif defined(_MSC_VER) && defined(_M_X64)
+	*A = _umul128(*A, *B, B);
+#else
+	uint64_t ha = *A >> 32, hb = *B >> 32, la = (uint32_t)*A, lb = (uint32_t)*B, hi, lo;
+	uint64_t rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb, t = rl + (rm0 << 32), c = t < rl;
+	lo = t + (rm1 << 32); c += lo < t; hi = rh + (rm0 >> 32) + (rm1 >> 32) + c;
+	*A = lo; *B = hi;
+#endif
+}
+
+/** Multiply and xor mix function, aka MUM. */
+static inline uint64_t _wymix(uint64_t A, uint64_t B) { _wymum(&A, &B); return A ^ B; }
+
+/** Little-endian unaligned reads. */
+static inline uint64_t _wyr8(const uint8_t *p) { uint64_t v; memcpy(&v, p, 8); return v; }
+static inline uint64_t _wyr4(const uint8_t *p) { uint32_t v; memcpy(&v, p, 4); return v; }
+static inline uint64_t _wyr3(const uint8_t *p, size_t k) { return (((uint64_t)p[0]) << 16) | (((uint64_t)p[k >> 1]) << 8) | p[k - 1]; }
+
+/** wyhash main function. */
+static inline uint64_t wyhash(const void *key, size_t len, uint64_t seed, const uint64_t *secret) {
+	const uint8_t *p = (const uint8_t *)key;
+	seed ^= _wymix(seed ^ secret[0], secret[1]);
+	uint64_t a, b;
+
+	if (_wy_likely_(len <= 16)) {
+		if (_wy_likely_(len >= 4)) {
+			a = (_wyr4(p) << 32) | _wyr4(p + ((len >> 3) << 2));
+			b = (_wyr4(p + len - 4) << 32) | _wyr4(p + len - 4 - ((len >> 3) << 2));
+		}
+		else if (_wy_likely_(len > 0)) {
+			a = _wyr3(p, len);
+			b = 0;
+		}
+		else a = b = 0;
+	}
+	else {
+		size_t i = len;
+		if (_wy_unlikely_(i > 48)) {
+			uint64_t see1 = seed, see2 = seed;
+			do {
+				seed = _wymix(_wyr8(p) ^ secret[1], _wyr8(p + 8) ^ seed);
+				see1 = _wymix(_wyr8(p + 16) ^ secret[2], _wyr8(p + 24) ^ see1);
+				see2 = _wymix(_wyr8(p + 32) ^ secret[3], _wyr8(p + 40) ^ see2);
+				p += 48; i -= 48;
+			} while (_wy_likely_(i > 48));
+			seed ^= see1 ^ see2;
+		}
+		while (_wy_unlikely_(i > 16)) {
+			seed = _wymix(_wyr8(p) ^ secret[1], _wyr8(p + 8) ^ seed);
+			i -= 16; p += 16;
+		}
+		a = _wyr8(p + i - 16);
+		b = _wyr8(p + i - 8);
+	}
+
+	a ^= secret[1]; b ^= seed;
+	_wymum(&a, &b);
+	return _wymix(a ^ secret[0] ^ len, b ^ secret[1]);
+}
+
+#endif